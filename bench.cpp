@@ -0,0 +1,288 @@
+/* ---------------------------------------------------------------------------
+** bench.cpp
+** Renders a fixed set of sample scenes with fixed seeds, resolutions and
+** photon counts, timing every step apart so builds can be compared. The
+** results are printed as a table and optionally saved as JSON.
+**
+** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+**         Santiago Gil Begué, NIA: 683482
+** -------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include "mathUtils.hpp"
+#include "renderStats.hpp"
+#include "scene.hpp"
+#include "sceneSamples.hpp"
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** A scene of the benchmark and the settings it's always rendered with. */
+struct BenchmarkCase
+{
+    string name;
+    function<Scene(void)> scene;
+    unsigned int width, height;
+    unsigned int photons, causticPhotons;
+    unsigned int kNearest;
+    uint32_t seed;
+};
+
+/** Seconds taken by every step of a render, the fastest of all the repetitions. */
+struct BenchmarkResult
+{
+    const BenchmarkCase *benchmarkCase;
+    double emission = 0.0, balance = 0.0, render = 0.0, save = 0.0;
+    /** Camera, shadow and specular rays traced by the render, 0 if they aren't counted. */
+    uint64_t rays = 0;
+};
+
+/**
+ * @return The scenes measured by the benchmark. Changing them makes older results incomparable.
+ */
+vector<BenchmarkCase> GetBenchmarkCases()
+{
+    return {
+        {"cornell", &CornellBox, 320, 180, 100000, 0, 100, 1},
+        {"caustic", &Caustic, 320, 180, 100000, 20000, 100, 1},
+        {"cornell_media", &CornellBoxWithMedia, 320, 180, 100000, 0, 100, 1},
+        {"teapot", &Teapot, 320, 180, 100000, 0, 100, 1},
+        {"dragon", &Dragon, 320, 180, 100000, 0, 100, 1},
+        {"menger_3", &Menger<3>, 320, 180, 100000, 0, 100, 1}
+    };
+}
+
+/**
+ * @param start Time at which the measured step began.
+ * @return Seconds elapsed since start.
+ */
+double SecondsSince(const chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Renders the case once and keeps the fastest time of every step in result.
+ *
+ * @param benchmarkCase Scene and settings to render.
+ * @param threadCount Number of threads used to render.
+ * @param result Times of the previous repetitions, 0 if there are none.
+ */
+void RunCase(const BenchmarkCase &benchmarkCase, const unsigned int threadCount, BenchmarkResult &result)
+{
+    Scene scene = benchmarkCase.scene();
+    scene.SetImageDimensions(benchmarkCase.width, benchmarkCase.height);
+    scene.SetEmitedPhotons(benchmarkCase.photons);
+    scene.SetCausticPhotons(benchmarkCase.causticPhotons);
+    scene.SetKNearestNeighbours(benchmarkCase.kNearest);
+    SetRandomSeed(benchmarkCase.seed);
+
+    const auto keepFastest = [](double &best, const double seconds)
+    {
+        if (best == 0.0 || seconds < best) best = seconds;
+    };
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    scene.TracePhotons();
+    keepFastest(result.emission, SecondsSince(start));
+
+    start = chrono::steady_clock::now();
+    scene.BalancePhotonMaps();
+    keepFastest(result.balance, SecondsSince(start));
+
+    // Only the render threads are counted, the photons traced by this thread are left out.
+    RenderStats::Reset();
+    start = chrono::steady_clock::now();
+    const unique_ptr<Image> image = scene.RenderMultiThread(threadCount);
+    keepFastest(result.render, SecondsSince(start));
+    result.rays = RenderStats::GetTotal(CAMERA_RAYS) + RenderStats::GetTotal(SHADOW_RAYS) +
+                  RenderStats::GetTotal(SPECULAR_RAYS);
+
+    start = chrono::steady_clock::now();
+    image->Save(benchmarkCase.name + "_bench.ppm", CLAMP);
+    keepFastest(result.save, SecondsSince(start));
+}
+
+/**
+ * @param result Times of a case.
+ * @return Pixels rendered per second.
+ */
+double PixelsPerSecond(const BenchmarkResult &result)
+{
+    return result.benchmarkCase->width * result.benchmarkCase->height / result.render;
+}
+
+/**
+ * @param result Times of a case.
+ * @return Camera, shadow and specular rays traced per second while rendering, 0 if they aren't counted.
+ */
+double RaysPerSecond(const BenchmarkResult &result)
+{
+    return result.rays / result.render;
+}
+
+/**
+ * @param result Times of a case.
+ * @return Photons emitted per second, including the caustic ones.
+ */
+double PhotonsPerSecond(const BenchmarkResult &result)
+{
+    return (result.benchmarkCase->photons + result.benchmarkCase->causticPhotons) / result.emission;
+}
+
+/**
+ * Writes the results in a JSON file.
+ *
+ * @param filename Path of the file, overwritten if it exists.
+ * @param results Times of every case rendered.
+ * @param skipped Names of the cases that couldn't be rendered.
+ * @param threadCount Number of threads used to render.
+ * @param repetitions Number of times every case was rendered.
+ * @return true if the file was written successfully.
+ */
+bool SaveJson(const string &filename, const vector<BenchmarkResult> &results, const vector<string> &skipped,
+              const unsigned int threadCount, const unsigned int repetitions)
+{
+    ofstream file(filename);
+    file << setprecision(6);
+    file << "{\n";
+#ifdef RAY_TRACER_SIMD
+    file << "  \"simd\": true,\n";
+#else
+    file << "  \"simd\": false,\n";
+#endif
+    file << "  \"threads\": " << threadCount << ",\n";
+    file << "  \"repetitions\": " << repetitions << ",\n";
+    file << "  \"scenes\": [";
+    for (unsigned int i = 0; i < results.size(); ++i)
+    {
+        const BenchmarkResult &result = results[i];
+        const BenchmarkCase &benchmarkCase = *result.benchmarkCase;
+        file << (i == 0 ? "\n" : ",\n")
+             << "    {\"name\": \"" << benchmarkCase.name << "\", "
+             << "\"width\": " << benchmarkCase.width << ", \"height\": " << benchmarkCase.height << ", "
+             << "\"photons\": " << benchmarkCase.photons << ", "
+             << "\"caustic_photons\": " << benchmarkCase.causticPhotons << ", "
+             << "\"k\": " << benchmarkCase.kNearest << ", \"seed\": " << benchmarkCase.seed << ",\n"
+             << "     \"emission_s\": " << result.emission << ", \"balance_s\": " << result.balance << ", "
+             << "\"render_s\": " << result.render << ", \"save_s\": " << result.save << ",\n"
+             << "     \"pixels_per_s\": " << PixelsPerSecond(result) << ", "
+#ifdef RAY_TRACER_STATS
+             << "\"rays_per_s\": " << RaysPerSecond(result) << ", "
+#endif
+             << "\"photons_per_s\": " << PhotonsPerSecond(result) << "}";
+    }
+    file << "\n  ],\n";
+    file << "  \"skipped\": [";
+    for (unsigned int i = 0; i < skipped.size(); ++i)
+    {
+        file << (i == 0 ? "" : ", ") << '"' << skipped[i] << '"';
+    }
+    file << "]\n}\n";
+    return static_cast<bool>(file);
+}
+
+/**
+ * Main function. Renders the benchmark scenes and reports their times.
+ * @return 0 if everything worked fine, 1 otherwise.
+ */
+int main(int argc, char * argv[])
+{
+    unsigned int threadCount = thread::hardware_concurrency();
+    unsigned int repetitions = 1;
+    string jsonFile;
+    vector<string> selected;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string option = argv[i];
+        if (option == "-h")
+        {
+            cout << "Usage: render_bench [OPTION]...\n"
+                    "Renders a fixed set of scenes timing the emission, balance, render and save steps.\n\n"
+                    "Available options:\n"
+                    "\t-h : Print this helpful text.\n"
+                    "\t--json <FILE> : Also saves the results in FILE as JSON.\n"
+                    "\t--threads <INTEGER> : Renders with INTEGER threads. All available threads by default.\n"
+                    "\t--repeat <INTEGER> : Renders every scene INTEGER times, keeping the fastest time of every "
+                    "step.\n"
+                    "\t--scene <NAME> : Only renders the scene NAME, can be given several times.\n\n"
+                    "Scenes:\n";
+            for (const BenchmarkCase &benchmarkCase : GetBenchmarkCases()) cout << '\t' << benchmarkCase.name << '\n';
+            return 0;
+        }
+        else if (i + 1 < argc && option == "--json") jsonFile = argv[++i];
+        else if (i + 1 < argc && option == "--scene") selected.push_back(argv[++i]);
+        else if (i + 1 < argc && (option == "--threads" || option == "--repeat"))
+        {
+            const int value = atoi(argv[++i]);
+            if (value <= 0)
+            {
+                cerr << option << " needs a positive integer\n";
+                return 1;
+            }
+            (option == "--threads" ? threadCount : repetitions) = static_cast<unsigned int>(value);
+        }
+        else
+        {
+            cerr << "Unknown option " << option << ", use -h to see the available ones\n";
+            return 1;
+        }
+    }
+    if (threadCount == 0) threadCount = 1;
+
+    const vector<BenchmarkCase> cases = GetBenchmarkCases();
+    vector<BenchmarkResult> results;
+    vector<string> skipped;
+    for (const BenchmarkCase &benchmarkCase : cases)
+    {
+        if (!selected.empty() && find(selected.begin(), selected.end(), benchmarkCase.name) == selected.end())
+            continue;
+        BenchmarkResult result;
+        result.benchmarkCase = &benchmarkCase;
+        try
+        {
+            for (unsigned int i = 0; i < repetitions; ++i) RunCase(benchmarkCase, threadCount, result);
+        }
+        catch (...)
+        {
+            // Scenes whose resources aren't available.
+            cerr << "\nSkipping " << benchmarkCase.name << ", it couldn't be rendered\n";
+            skipped.push_back(benchmarkCase.name);
+            continue;
+        }
+        results.push_back(result);
+    }
+
+    cout << '\n' << left << setw(16) << "scene" << right << setw(12) << "emission s" << setw(12) << "balance s"
+         << setw(12) << "render s" << setw(12) << "save s" << setw(14) << "pixels/s"
+#ifdef RAY_TRACER_STATS
+         << setw(14) << "rays/s"
+#endif
+         << setw(14) << "photons/s" << '\n';
+    cout << fixed;
+    for (const BenchmarkResult &result : results)
+    {
+        cout << left << setw(16) << result.benchmarkCase->name << right << setprecision(3)
+             << setw(12) << result.emission << setw(12) << result.balance
+             << setw(12) << result.render << setw(12) << result.save << setprecision(0)
+             << setw(14) << PixelsPerSecond(result)
+#ifdef RAY_TRACER_STATS
+             << setw(14) << RaysPerSecond(result)
+#endif
+             << setw(14) << PhotonsPerSecond(result) << '\n';
+    }
+
+    if (!jsonFile.empty() && !SaveJson(jsonFile, results, skipped, threadCount, repetitions))
+    {
+        cerr << "Couldn't save the results in " << jsonFile << '\n';
+        return 1;
+    }
+    return 0;
+}
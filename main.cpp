@@ -8,11 +8,15 @@
 ** -------------------------------------------------------------------------*/
 
 #include <functional>
+#include "hash.hpp"
 #include <iostream>
+#include "mathUtils.hpp"
 #include "pinhole.hpp"
+#include "renderStats.hpp"
 #include "scene.hpp"
 #include "sceneSamples.hpp"
 #include <thread>
+#include "trace.hpp"
 #include <sstream>
 #include <map>
 
@@ -59,6 +63,24 @@ void PrintHelp()
             "\t-p <INTEGER> : Emits INTEGER photons. The default value is 100,000.\n"
             "\t-k <INTEGER> : When tracing rays search for the INTEGER nearest photons. The default value is 300.\n"
             "\t-s [SCENE_NAME] : Selects the scene to render.\n"
+            "\t--crop <X,Y,WIDTH,HEIGHT> : Renders only the given rectangle of the image and saves it as SCENE_NAME_X_Y.ppm.\n"
+            "\t--tiles <COLUMNSxROWS> --tile <ID> : Renders only the ID'th tile (row by row, starting at 0) of the image split in COLUMNSxROWS tiles.\n"
+            "\t--seed <INTEGER> : Seeds the random generator, so renders with the same seed and options give the same image with any number of threads. All the parts of an image rendered separately must use the same seed.\n"
+            "\t--caustic-photons <INTEGER> : Emits INTEGER more photons only towards the shapes that cause caustics.\n"
+            "\t--importance : Emits the photons towards the directions that light what the camera sees.\n"
+            "\t--save-photons <FILE> : Saves the photon maps in FILE after emitting the photons.\n"
+            "\t--load-photons <FILE> : Loads the photon maps saved in FILE for the same scene and number of photons (and, with --importance, the same camera and resolution) instead of emitting the photons.\n"
+            "\t--spp <INTEGER> : Takes INTEGER jittered samples inside every pixel. The default value is 1.\n"
+            "\t--adaptive <FLOAT> : Keeps sampling the pixels whose relative error is greater than FLOAT.\n"
+            "\t--max-spp <INTEGER> : Maximum samples per pixel with adaptive sampling or progressive rendering. The default value with adaptive sampling is 64.\n"
+            "\t--progressive : Renders one sample per pixel at a time until --time-budget, --target-noise or --max-spp is reached.\n"
+            "\t--time-budget <SECONDS> : Stops a progressive render before going over SECONDS.\n"
+            "\t--target-noise <FLOAT> : Stops a progressive render when the mean relative error of the pixels is under FLOAT.\n"
+            "\t--snapshot <SECONDS> : Saves the image of a progressive render every SECONDS.\n"
+            "\t--stats : Prints the time of every phase, the number of rays, intersection tests, visited nodes and stored photons and the work done by every thread.\n"
+            "\t--stats-json <FILE> : Saves the same statistics as --stats in FILE as JSON.\n"
+            "\t--trace <FILE> : Saves a timeline of the scene construction, photon emission, photon map balance, the tiles rendered by every thread and the image save in FILE, in the Chrome trace format (chrome://tracing or Perfetto).\n"
+            "\t--heatmap <time|tests|knn> : Also saves the cost of every pixel (nanoseconds, intersection tests or visited photon map nodes) as SCENE_NAME_heatmap.pfm. Not available with --progressive.\n"
             "\n"
             "Available scenes:\n";
     for (const auto &scenePair: SCENE_NAMES)
@@ -84,6 +106,8 @@ void InitializeSceneNames()
     SCENE_NAMES["menger_3"] = &Menger<3>;
     SCENE_NAMES["menger_4"] = &Menger<4>;
     SCENE_NAMES["menger_5"] = &Menger<5>;
+    SCENE_NAMES["menger_6"] = &Menger<6>;
+    SCENE_NAMES["menger_8"] = &Menger<8>;
     SCENE_NAMES["phong_spheres"] = &PhongSphereSamples;
     SCENE_NAMES["quartz_sphere"] = &RefractiveSphereTest<4>;
     SCENE_NAMES["room"] = &Room;
@@ -113,7 +137,23 @@ int main(int argc, char * argv[])
     int width = -1, height = -1;
     unsigned int threadCount = thread::hardware_concurrency(); // Use all available threads by default.
     unsigned int photonCount = 100000;
+    unsigned int causticPhotonCount = 0;
     unsigned int k_nearest = 300;
+    unsigned int samplesPerPixel = 1;
+    unsigned int maxSamplesPerPixel = 64;
+    float adaptiveThreshold = 0.0f;
+    bool progressive = false, maxSamplesSet = false, importance = false;
+    ProgressiveSettings progressiveSettings;
+    vector<string> crop;
+    vector<string> tiles;
+    int tileId = -1;
+    uint64_t seed = ~0ull; // Not seeded.
+    string savePhotonsFile, loadPhotonsFile;
+    bool printStats = false;
+    string statsFile;
+    string traceFile;
+    bool heatmap = false;
+    HeatmapMetric heatmapMetric = HEATMAP_NANOSECONDS;
     SaveMode saveMode = CLAMP;
     string sceneName = "cornell";
 
@@ -185,6 +225,18 @@ int main(int argc, char * argv[])
                 }
             }catch(const invalid_argument& ){cerr << "Not a valid integer: " << arguments[i+1] << '\n'; return 1;}
         }
+        else if (arguments[i] == "--caustic-photons")
+        {
+            try
+            {
+                if (i + 1 < argnum)
+                {
+                    int tmp = stoi(arguments[i+1]);
+                    causticPhotonCount = (unsigned int) tmp;
+                    i++;
+                }
+            }catch(const invalid_argument& ){cerr << "Not a valid integer: " << arguments[i+1] << '\n'; return 1;}
+        }
         else if (arguments[i] == "-k")
         {
             try
@@ -197,6 +249,129 @@ int main(int argc, char * argv[])
                 }
             }catch(const invalid_argument&){cerr << "Not a valid integer: " << arguments[i+1] << '\n'; return 1;}
         }
+        else if (arguments[i] == "--spp" || arguments[i] == "--max-spp")
+        {
+            try
+            {
+                if (i + 1 < argnum)
+                {
+                    int tmp = stoi(arguments[i+1]);
+                    (arguments[i] == "--spp" ? samplesPerPixel : maxSamplesPerPixel) = (unsigned int) tmp;
+                    maxSamplesSet |= arguments[i] == "--max-spp";
+                    i++;
+                }
+            }catch(const invalid_argument&){cerr << "Not a valid integer: " << arguments[i+1] << '\n'; return 1;}
+        }
+        else if (arguments[i] == "--adaptive")
+        {
+            try
+            {
+                if (i + 1 < argnum)
+                {
+                    adaptiveThreshold = stof(arguments[i+1]);
+                    i++;
+                }
+            }catch(const invalid_argument&){cerr << "Not a valid number: " << arguments[i+1] << '\n'; return 1;}
+        }
+        else if (arguments[i] == "--importance")
+        {
+            importance = true;
+        }
+        else if (arguments[i] == "--progressive")
+        {
+            progressive = true;
+        }
+        else if (arguments[i] == "--time-budget" || arguments[i] == "--target-noise" || arguments[i] == "--snapshot")
+        {
+            try
+            {
+                if (i + 1 < argnum)
+                {
+                    float tmp = stof(arguments[i+1]);
+                    if (arguments[i] == "--time-budget") progressiveSettings.timeBudget = tmp;
+                    else if (arguments[i] == "--target-noise") progressiveSettings.targetNoise = tmp;
+                    else progressiveSettings.snapshotInterval = tmp;
+                    i++;
+                }
+            }catch(const invalid_argument&){cerr << "Not a valid number: " << arguments[i+1] << '\n'; return 1;}
+        }
+        else if (arguments[i] == "--crop" || arguments[i] == "--tiles")
+        {
+            if (i + 1 >= argnum)
+            {
+                cerr << "You need to specify the crop as X,Y,WIDTH,HEIGHT and the tiles as COLUMNSxROWS\n"; return 1;
+            }
+            if (arguments[i] == "--crop") crop = split(arguments[i+1], ',');
+            else tiles = split(arguments[i+1], 'x');
+            ++i;
+        }
+        else if (arguments[i] == "--tile" || arguments[i] == "--seed")
+        {
+            try
+            {
+                if (i + 1 < argnum)
+                {
+                    int tmp = stoi(arguments[i+1]);
+                    if (arguments[i] == "--tile") tileId = tmp;
+                    else
+                    {
+                        seed = (uint64_t) tmp;
+                        SetRandomSeed((uint32_t) tmp);
+                    }
+                    i++;
+                }
+            }catch(const invalid_argument&){cerr << "Not a valid integer: " << arguments[i+1] << '\n'; return 1;}
+        }
+        else if (arguments[i] == "--stats")
+        {
+            printStats = true;
+        }
+        else if (arguments[i] == "--stats-json")
+        {
+            if (i + 1 >= argnum)
+            {
+                cerr << "You need to specify the statistics file\n"; return 1;
+            }
+            statsFile = arguments[i+1];
+            ++i;
+        }
+        else if (arguments[i] == "--trace")
+        {
+            if (i + 1 >= argnum)
+            {
+                cerr << "You need to specify the trace file\n"; return 1;
+            }
+            traceFile = arguments[i+1];
+            ++i;
+        }
+        else if (arguments[i] == "--heatmap")
+        {
+            const map<string, HeatmapMetric> metrics = {{"time", HEATMAP_NANOSECONDS},
+                                                        {"tests", HEATMAP_INTERSECTION_TESTS},
+                                                        {"knn", HEATMAP_KNN_NODES}};
+            if (i + 1 >= argnum || metrics.find(arguments[i+1]) == metrics.end())
+            {
+                cerr << "You need to specify the cost of the heatmap: time, tests or knn\n"; return 1;
+            }
+#ifndef RAY_TRACER_STATS
+            if (arguments[i+1] != "time")
+            {
+                cerr << "Counting heatmaps need a build with RAY_TRACER_STATS\n"; return 1;
+            }
+#endif
+            heatmap = true;
+            heatmapMetric = metrics.at(arguments[i+1]);
+            ++i;
+        }
+        else if (arguments[i] == "--save-photons" || arguments[i] == "--load-photons")
+        {
+            if (i + 1 >= argnum)
+            {
+                cerr << "You need to specify the photon maps file\n"; return 1;
+            }
+            (arguments[i] == "--save-photons" ? savePhotonsFile : loadPhotonsFile) = arguments[i+1];
+            ++i;
+        }
         else if (arguments[i] == "-s")
         {
             if (i + 1 < argnum)
@@ -222,10 +397,17 @@ int main(int argc, char * argv[])
         cout << "Rendering the default Cornell Box. Use the option '-h' if you want to see all available scenes.\n";
     }
 
+    if (!traceFile.empty())
+    {
+        Trace::Enable();
+        Trace::SetThreadName("main");
+    }
+
     Scene chosenScene;
     // Calls the chosen scene function from the scene name map.
     if (SCENE_NAMES.find(sceneName) != SCENE_NAMES.end())
     {
+        const PhaseTimer timer(SCENE_SETUP);
         chosenScene = SCENE_NAMES[sceneName]();
     }
     else
@@ -239,15 +421,133 @@ int main(int argc, char * argv[])
         chosenScene.SetImageDimensions((unsigned int)width, (unsigned int)height);
     }
 
+    // Region of the image to render, the full image by default.
+    const unsigned int fullWidth = width != -1 ? (unsigned int) width : chosenScene.GetImageWidth();
+    const unsigned int fullHeight = height != -1 ? (unsigned int) height : chosenScene.GetImageHeight();
+    unsigned int regionX = 0, regionY = 0, regionWidth = fullWidth, regionHeight = fullHeight;
+    try
+    {
+        if (crop.size() == 4)
+        {
+            // Knowingly not bothering to check if the arguments are ints.
+            regionX = (unsigned int) stoi(crop[0]);
+            regionY = (unsigned int) stoi(crop[1]);
+            regionWidth = (unsigned int) stoi(crop[2]);
+            regionHeight = (unsigned int) stoi(crop[3]);
+        }
+        else if (tiles.size() == 2 && tileId >= 0)
+        {
+            const unsigned int columns = (unsigned int) stoi(tiles[0]), rows = (unsigned int) stoi(tiles[1]);
+            if (columns == 0 || rows == 0 || (unsigned int) tileId >= columns * rows)
+            {
+                cerr << "The tile " << tileId << " doesn't exist in a " << columns << 'x' << rows << " split\n";
+                return 1;
+            }
+            // Tiles are as even as possible, their borders rounded down.
+            const unsigned int column = tileId % columns, row = tileId / columns;
+            regionX = column * fullWidth / columns;
+            regionY = row * fullHeight / rows;
+            regionWidth = (column + 1) * fullWidth / columns - regionX;
+            regionHeight = (row + 1) * fullHeight / rows - regionY;
+        }
+        else if (!crop.empty() || !tiles.empty() || tileId >= 0)
+        {
+            cerr << "Use either --crop X,Y,WIDTH,HEIGHT or both --tiles COLUMNSxROWS and --tile ID\n";
+            return 1;
+        }
+        chosenScene.SetRenderRegion(regionX, regionY, regionWidth, regionHeight);
+    }
+    catch (const invalid_argument &e)
+    {
+        cerr << "Invalid region to render: " << e.what() << '\n';
+        return 1;
+    }
+
+    // Partial images are named after their position and record it so they can be merged later.
+    const bool partial = regionWidth != fullWidth || regionHeight != fullHeight;
+    const string outputName = partial ? sceneName + '_' + to_string(regionX) + '_' + to_string(regionY) + ".ppm"
+                                      : sceneName + ".ppm";
+    const string regionComment = partial ? "region " + to_string(regionX) + ' ' + to_string(regionY) + ' ' +
+                                           to_string(fullWidth) + ' ' + to_string(fullHeight)
+                                         : "";
+
     chosenScene.SetEmitedPhotons(photonCount);
+    chosenScene.SetCausticPhotons(causticPhotonCount);
     chosenScene.SetKNearestNeighbours(k_nearest);
+    chosenScene.SetImportanceSampling(importance);
+    chosenScene.SetSamplesPerPixel(samplesPerPixel);
+    chosenScene.SetAdaptiveSampling(adaptiveThreshold, maxSamplesPerPixel);
 
-    chosenScene.EmitPhotons();
+    /* Reuse the photon maps if they were saved for this scene. Without importance sampling they don't depend on the
+     * camera, with it they're only reused for the same camera and image size. */
+    const uint64_t sceneHash = Hash(sceneName.data(), sceneName.size());
+    if (loadPhotonsFile.empty() || !chosenScene.LoadPhotonMaps(loadPhotonsFile, sceneHash, seed))
+    {
+        if (!loadPhotonsFile.empty()) cout << "Emitting the photons instead.\n";
+        chosenScene.EmitPhotons();
+    }
+    if (!savePhotonsFile.empty() && !chosenScene.SavePhotonMaps(savePhotonsFile, sceneHash, seed))
+    {
+        cerr << "Couldn't save the photon maps in " << savePhotonsFile << '\n';
+    }
 
     // Render the scene and save the resulting image
-    auto image = chosenScene.RenderMultiThread(threadCount);
-    image->Save(sceneName + ".ppm", saveMode);
+    unique_ptr<Image> image;
+    unique_ptr<Image> heatmapImage = heatmap ? make_unique<Image>(regionWidth, regionHeight) : nullptr;
+    if (progressive)
+    {
+        if (heatmap)
+        {
+            cerr << "A progressive render can't save a heatmap.\n";
+            return 1;
+        }
+        if (maxSamplesSet) progressiveSettings.maxPasses = maxSamplesPerPixel;
+        if (progressiveSettings.timeBudget <= 0 && progressiveSettings.targetNoise <= 0 &&
+            progressiveSettings.maxPasses == 0)
+        {
+            cerr << "A progressive render needs --time-budget, --target-noise or --max-spp to stop.\n";
+            return 1;
+        }
+        image = chosenScene.RenderProgressive(threadCount, progressiveSettings,
+                                              [&](const Image &snapshot, unsigned int passes)
+                                              {
+                                                  snapshot.Save(outputName, saveMode, regionComment);
+                                              });
+    }
+    else
+    {
+        image = chosenScene.RenderMultiThread(threadCount, heatmapImage.get(), heatmapMetric);
+    }
+    {
+        const PhaseTimer timer(IMAGE_SAVE);
+        image->Save(outputName, saveMode, regionComment);
+    }
+
+    cout << "\nSaved image " << outputName << '\n';
+    if (heatmap)
+    {
+        // Named after the image, without its extension.
+        const string heatmapName = outputName.substr(0, outputName.size() - 4) + "_heatmap.pfm";
+        if (!heatmapImage->SavePFM(heatmapName))
+        {
+            cerr << "Couldn't save the heatmap in " << heatmapName << '\n';
+            return 1;
+        }
+        cout << "Saved heatmap " << heatmapName << '\n';
+    }
 
-    cout << "\nSaved image " << sceneName << ".ppm\n";
+    // The photons are emitted by this thread, its counters are reported apart from the render threads.
+    RenderStats::FlushThread("main");
+    if (printStats) RenderStats::PrintReport(cout);
+    if (!statsFile.empty() && !RenderStats::SaveJson(statsFile))
+    {
+        cerr << "Couldn't save the statistics in " << statsFile << '\n';
+        return 1;
+    }
+    if (!traceFile.empty() && !Trace::Save(traceFile))
+    {
+        cerr << "Couldn't save the trace in " << traceFile << '\n';
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,115 @@
+/* ---------------------------------------------------------------------------
+** merge.cpp
+** Joins the partial images rendered with --crop or --tile into the full image.
+** The position of every part and the size of the full image are read from the
+** "region" comment that the renderer writes in the header of partial images.
+**
+** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+**         Santiago Gil Begué, NIA: 683482
+** -------------------------------------------------------------------------*/
+
+#include <fstream>
+#include "image.hpp"
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Reads the region comment in the header of a partial image.
+ *
+ * @param filename Path to the partial ppm image.
+ * @param x Column of the full image where the partial image begins.
+ * @param y Row of the full image where the partial image begins.
+ * @param fullWidth Width of the full image.
+ * @param fullHeight Height of the full image.
+ * @return true if the header contains a region comment.
+ */
+bool ReadRegion(const string &filename, unsigned int &x, unsigned int &y,
+                unsigned int &fullWidth, unsigned int &fullHeight)
+{
+    ifstream file(filename);
+    string line;
+    // Skip the magic number, the comments are right after it.
+    getline(file, line);
+    while (getline(file, line) && !line.empty() && line[0] == '#')
+    {
+        istringstream comment(line.substr(1));
+        string keyword;
+        if (comment >> keyword && keyword == "region" && comment >> x >> y >> fullWidth >> fullHeight)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Main function. Merges the partial images given as arguments into the output image.
+ * @return 0 if everything worked fine, 1 otherwise.
+ */
+int main(int argc, char * argv[])
+{
+    if (argc < 3)
+    {
+        cout << "Usage: render_merge OUTPUT PART...\n"
+                "Joins the parts of an image rendered with --crop or --tile into OUTPUT.\n";
+        return argc == 2 && string(argv[1]) == "-h" ? 0 : 1;
+    }
+
+    unique_ptr<Image> merged;
+    // Number of parts that wrote every pixel, to find gaps and overlaps.
+    vector<unsigned char> coverage;
+    for (int i = 2; i < argc; ++i)
+    {
+        unsigned int x, y, fullWidth, fullHeight;
+        if (!ReadRegion(argv[i], x, y, fullWidth, fullHeight))
+        {
+            cerr << argv[i] << " isn't a partial image, it has no region comment\n";
+            return 1;
+        }
+        if (!merged)
+        {
+            merged = make_unique<Image>(fullWidth, fullHeight);
+            coverage.assign(fullWidth * fullHeight, 0);
+        }
+        else if (merged->GetWidth() != fullWidth || merged->GetHeight() != fullHeight)
+        {
+            cerr << argv[i] << " belongs to an image of a different size\n";
+            return 1;
+        }
+
+        const Image part(argv[i]);
+        if (x + part.GetWidth() > fullWidth || y + part.GetHeight() > fullHeight)
+        {
+            cerr << argv[i] << " doesn't fit in the full image\n";
+            return 1;
+        }
+        for (unsigned int row = 0; row < part.GetHeight(); ++row)
+        {
+            const ConstImageRow source = part[row];
+            const ImageRow destination = (*merged)[y + row];
+            for (unsigned int column = 0; column < part.GetWidth(); ++column)
+            {
+                destination[x + column] = source[column];
+                ++coverage[(y + row) * fullWidth + x + column];
+            }
+        }
+    }
+
+    unsigned int missing = 0, overlapping = 0;
+    for (unsigned char count : coverage)
+    {
+        missing += count == 0;
+        overlapping += count > 1;
+    }
+    if (missing > 0) cerr << "Warning: " << missing << " pixels aren't covered by any part\n";
+    if (overlapping > 0) cerr << "Warning: " << overlapping << " pixels are covered by several parts\n";
+
+    // The parts are already tone mapped, clamping keeps their values.
+    merged->Save(argv[1], CLAMP);
+    cout << "Saved image " << argv[1] << '\n';
+    return 0;
+}
@@ -0,0 +1,357 @@
+/* ---------------------------------------------------------------------------
+** microbench.cpp
+** Times the hot kernels apart from a whole render: the intersection of every
+** kind of shape and the nearest neighbours search of the photon maps. The
+** rays, photons and queries are generated beforehand with a fixed seed, so
+** every run measures exactly the same work.
+**
+** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+**         Santiago Gil Begué, NIA: 683482
+** -------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include "box.hpp"
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include "kdtree.hpp"
+#include "mesh.hpp"
+#include <random>
+#include "rectangle.hpp"
+#include "sphere.hpp"
+#include "triangle.hpp"
+#include <vector>
+
+using namespace std;
+
+/** Seed of every random value generated by the benchmarks. */
+static constexpr uint32_t MICROBENCH_SEED = 1;
+
+/** A kernel measured by the benchmark. */
+struct MicroBenchmark
+{
+    string name;
+    /** Calls to the kernel made by every run, used to report the time per call. */
+    unsigned int calls;
+    /** Work done once before the runs, not measured. */
+    function<void(void)> prepare;
+    /** Calls the kernel for every ray or query, returning a checksum of the results so they aren't optimised away. */
+    function<double(void)> run;
+};
+
+/** Fastest time of all the runs of a benchmark. */
+struct MicroBenchmarkResult
+{
+    const MicroBenchmark *benchmark;
+    double seconds = 0.0;
+    double checksum = 0.0;
+};
+
+/**
+ * @param rayCount Number of rays generated.
+ * @param generator Random generator used, with a fixed seed.
+ * @return Rays starting in a sphere of radius 3 around the origin and aimed at a point of the cube of side 1.5 centered
+ *  at it, so they hit and miss the shapes of the benchmark, all of them smaller than that cube.
+ */
+vector<LightRay> GenerateRays(const unsigned int rayCount, mt19937 &generator)
+{
+    uniform_real_distribution<float> unit(0.0f, 1.0f), target(-0.75f, 0.75f);
+    vector<LightRay> rays;
+    rays.reserve(rayCount);
+    for (unsigned int i = 0; i < rayCount; ++i)
+    {
+        const float inclination = acos(2 * unit(generator) - 1);
+        const float azimuth = 2 * PI * unit(generator);
+        const Point source(3 * sin(inclination) * cos(azimuth), 3 * sin(inclination) * sin(azimuth),
+                           3 * cos(inclination));
+        const Point destination(target(generator), target(generator), target(generator));
+        rays.push_back(LightRay(source, destination));
+    }
+    return rays;
+}
+
+/**
+ * @param count Number of points generated.
+ * @param generator Random generator used, with a fixed seed.
+ * @return Points uniformly distributed in the cube of side 2 centered at the origin.
+ */
+vector<Point> GeneratePoints(const unsigned int count, mt19937 &generator)
+{
+    uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    vector<Point> points;
+    points.reserve(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        points.push_back(Point(coordinate(generator), coordinate(generator), coordinate(generator)));
+    }
+    return points;
+}
+
+/**
+ * Adds the benchmarks of both intersection methods of a shape.
+ *
+ * @param name Name of the shape, used as prefix of the benchmarks.
+ * @param build Builds the shape. It's called by the prepare step, so missing resources only skip its benchmarks.
+ * @param rays Rays intersected with the shape.
+ * @param benchmarks Updated with the new benchmarks.
+ */
+void AddShapeBenchmarks(const string &name, function<shared_ptr<Shape>(void)> build, const vector<LightRay> &rays,
+                        vector<MicroBenchmark> &benchmarks)
+{
+    const shared_ptr<shared_ptr<Shape>> shape = make_shared<shared_ptr<Shape>>();
+    const auto prepare = [shape, build]()
+    {
+        if (*shape == nullptr) *shape = build();
+    };
+    benchmarks.push_back({name + "_intersect", static_cast<unsigned int>(rays.size()), prepare, [shape, &rays]()
+    {
+        const Shape &target = **shape;
+        double checksum = 0.0;
+        for (const LightRay &ray : rays)
+        {
+            const float t = target.Intersect(ray);
+            if (t < FLT_MAX) checksum += t;
+        }
+        return checksum;
+    }});
+    benchmarks.push_back({name + "_intersect_hit", static_cast<unsigned int>(rays.size()), prepare, [shape, &rays]()
+    {
+        const Shape &target = **shape;
+        double checksum = 0.0;
+        for (const LightRay &ray : rays)
+        {
+            HitRecord hit;
+            target.Intersect(ray, hit);
+            if (hit.shape != nullptr) checksum += hit.t;
+        }
+        return checksum;
+    }});
+}
+
+/**
+ * Adds the benchmarks of the nearest neighbours search over a photon map of the given size.
+ *
+ * @param name Name of the photon map, used as prefix of the benchmarks.
+ * @param photonCount Photons stored in the map, uniformly distributed in the cube of side 2 centered at the origin.
+ * @param queries Points whose nearest photons are searched, the first ones are used by the biggest searches.
+ * @param benchmarks Updated with the new benchmarks.
+ */
+void AddKDTreeBenchmarks(const string &name, const unsigned int photonCount, const vector<Point> &queries,
+                         vector<MicroBenchmark> &benchmarks)
+{
+    const shared_ptr<KDTree> tree = make_shared<KDTree>();
+    const auto prepare = [tree, photonCount]()
+    {
+        if (!tree->IsEmpty()) return;
+        mt19937 generator(MICROBENCH_SEED + photonCount);
+        for (const Point &point : GeneratePoints(photonCount, generator))
+        {
+            tree->Store(point, Photon(Color(1, 1, 1), Vect(0, 1, 0)));
+        }
+        tree->Balance();
+    };
+    // Searching more neighbours is slower, so fewer queries keep every benchmark in the same order of time.
+    const vector<pair<unsigned int, unsigned int>> kAndQueries = {{50, 20000}, {300, 5000}, {5000, 500}};
+    for (const pair<unsigned int, unsigned int> &searched : kAndQueries)
+    {
+        const unsigned int k = searched.first;
+        const unsigned int queryCount = min(searched.second, static_cast<unsigned int>(queries.size()));
+        benchmarks.push_back({name + "_k" + to_string(k), queryCount, prepare, [tree, k, queryCount, &queries]()
+        {
+            double checksum = 0.0;
+            vector<const Node *> nodes;
+            for (unsigned int i = 0; i < queryCount; ++i)
+            {
+                float radius;
+                nodes.clear();
+                tree->Find(queries[i], k, nodes, radius);
+                checksum += nodes.size() + radius;
+            }
+            return checksum;
+        }});
+    }
+}
+
+/**
+ * @param rays Rays intersected with the shapes.
+ * @param queries Points searched in the photon maps.
+ * @return Every kernel measured by the benchmark.
+ */
+vector<MicroBenchmark> GetMicroBenchmarks(const vector<LightRay> &rays, const vector<Point> &queries)
+{
+    vector<MicroBenchmark> benchmarks;
+    AddShapeBenchmarks("sphere", []()
+    {
+        return make_shared<Sphere>(Point(0, 0, 0), 0.5f);
+    }, rays, benchmarks);
+    AddShapeBenchmarks("triangle", []()
+    {
+        return make_shared<Triangle>(Point(-0.5f, -0.5f, 0), Point(0.5f, -0.5f, 0), Point(0, 0.5f, 0.2f));
+    }, rays, benchmarks);
+    AddShapeBenchmarks("rectangle", []()
+    {
+        return make_shared<Rectangle>(Vect(0, 0, 1), Point(-0.5f, -0.5f, 0), Point(0.5f, 0.5f, 0));
+    }, rays, benchmarks);
+    AddShapeBenchmarks("box", []()
+    {
+        return make_shared<Box>(Rectangle(Vect(0, 1, 0), Point(-0.5f, -0.5f, -0.5f), Point(0.5f, -0.5f, 0.5f)), 1.0f);
+    }, rays, benchmarks);
+    for (const char *model : {"tetrahedron", "utah_teapot", "electric_rat", "woman", "monster", "darth_head",
+                                "iron_giant"})
+    {
+        AddShapeBenchmarks(string("mesh_") + model, [model]()
+        {
+            return make_shared<Mesh>(Mesh::LoadObjFile(string(PROJECT_DIR) + "/resources/" + model + ".obj", 0.5f,
+                                                       Vect(0, 0, 0)));
+        }, rays, benchmarks);
+    }
+    AddKDTreeBenchmarks("kdtree_1M", 1000000, queries, benchmarks);
+    AddKDTreeBenchmarks("kdtree_10M", 10000000, queries, benchmarks);
+    return benchmarks;
+}
+
+/**
+ * Writes the results in a JSON file.
+ *
+ * @param filename Path of the file, overwritten if it exists.
+ * @param results Times of every benchmark run.
+ * @param skipped Names of the benchmarks that couldn't be run.
+ * @param repetitions Number of times every benchmark was run.
+ * @return true if the file was written successfully.
+ */
+bool SaveJson(const string &filename, const vector<MicroBenchmarkResult> &results, const vector<string> &skipped,
+              const unsigned int repetitions)
+{
+    ofstream file(filename);
+    file << setprecision(9);
+    file << "{\n";
+#ifdef RAY_TRACER_SIMD
+    file << "  \"simd\": true,\n";
+#else
+    file << "  \"simd\": false,\n";
+#endif
+    file << "  \"seed\": " << MICROBENCH_SEED << ",\n";
+    file << "  \"repetitions\": " << repetitions << ",\n";
+    file << "  \"kernels\": [";
+    for (unsigned int i = 0; i < results.size(); ++i)
+    {
+        const MicroBenchmarkResult &result = results[i];
+        file << (i == 0 ? "\n" : ",\n")
+             << "    {\"name\": \"" << result.benchmark->name << "\", \"calls\": " << result.benchmark->calls << ", "
+             << "\"seconds\": " << result.seconds << ", "
+             << "\"ns_per_call\": " << result.seconds * 1e9 / result.benchmark->calls << ", "
+             << "\"checksum\": " << result.checksum << "}";
+    }
+    file << "\n  ],\n";
+    file << "  \"skipped\": [";
+    for (unsigned int i = 0; i < skipped.size(); ++i)
+    {
+        file << (i == 0 ? "" : ", ") << '"' << skipped[i] << '"';
+    }
+    file << "]\n}\n";
+    return static_cast<bool>(file);
+}
+
+/**
+ * Main function. Runs the micro benchmarks and reports their times.
+ * @return 0 if everything worked fine, 1 otherwise.
+ */
+int main(int argc, char * argv[])
+{
+    unsigned int repetitions = 5;
+    unsigned int rayCount = 200000;
+    string jsonFile;
+    vector<string> filters;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string option = argv[i];
+        if (option == "-h")
+        {
+            cout << "Usage: render_microbench [OPTION]...\n"
+                    "Times the intersection and nearest neighbours search kernels over rays and queries generated "
+                    "with a fixed seed.\n\n"
+                    "Available options:\n"
+                    "\t-h : Print this helpful text.\n"
+                    "\t--json <FILE> : Also saves the results in FILE as JSON.\n"
+                    "\t--repeat <INTEGER> : Runs every kernel INTEGER times, keeping the fastest. 5 by default.\n"
+                    "\t--rays <INTEGER> : Intersects INTEGER rays with every shape. 200,000 by default.\n"
+                    "\t--filter <TEXT> : Only runs the kernels whose name contains TEXT, can be given several "
+                    "times.\n\n"
+                    "Kernels:\n";
+            const vector<LightRay> noRays;
+            const vector<Point> noQueries;
+            for (const MicroBenchmark &benchmark : GetMicroBenchmarks(noRays, noQueries))
+            {
+                cout << '\t' << benchmark.name << '\n';
+            }
+            return 0;
+        }
+        else if (i + 1 < argc && option == "--json") jsonFile = argv[++i];
+        else if (i + 1 < argc && option == "--filter") filters.push_back(argv[++i]);
+        else if (i + 1 < argc && (option == "--repeat" || option == "--rays"))
+        {
+            const int value = atoi(argv[++i]);
+            if (value <= 0)
+            {
+                cerr << option << " needs a positive integer\n";
+                return 1;
+            }
+            (option == "--repeat" ? repetitions : rayCount) = static_cast<unsigned int>(value);
+        }
+        else
+        {
+            cerr << "Unknown option " << option << ", use -h to see the available ones\n";
+            return 1;
+        }
+    }
+
+    mt19937 generator(MICROBENCH_SEED);
+    const vector<LightRay> rays = GenerateRays(rayCount, generator);
+    const vector<Point> queries = GeneratePoints(20000, generator);
+    const vector<MicroBenchmark> benchmarks = GetMicroBenchmarks(rays, queries);
+
+    vector<MicroBenchmarkResult> results;
+    vector<string> skipped;
+    for (const MicroBenchmark &benchmark : benchmarks)
+    {
+        if (!filters.empty() && none_of(filters.begin(), filters.end(), [&benchmark](const string &filter)
+                                        { return benchmark.name.find(filter) != string::npos; }))
+            continue;
+        try
+        {
+            benchmark.prepare();
+        }
+        catch (...)
+        {
+            // Meshes whose files aren't available.
+            cerr << "Skipping " << benchmark.name << ", it couldn't be prepared\n";
+            skipped.push_back(benchmark.name);
+            continue;
+        }
+        MicroBenchmarkResult result;
+        result.benchmark = &benchmark;
+        for (unsigned int i = 0; i < repetitions; ++i)
+        {
+            const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            result.checksum = benchmark.run();
+            const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (i == 0 || seconds < result.seconds) result.seconds = seconds;
+        }
+        results.push_back(result);
+        cout << left << setw(32) << benchmark.name << right << fixed << setprecision(1)
+             << setw(12) << result.seconds * 1e9 / benchmark.calls << " ns/call"
+             << setprecision(3) << setw(12) << benchmark.calls / result.seconds / 1e6 << " M calls/s"
+             << defaultfloat << setprecision(9) << "   checksum " << result.checksum << endl;
+    }
+
+    if (!jsonFile.empty() && !SaveJson(jsonFile, results, skipped, repetitions))
+    {
+        cerr << "Couldn't save the results in " << jsonFile << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -43,12 +43,11 @@ float Box::Intersect(const LightRay &lightRay) const
     return tMin;
 }
 
-void Box::Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                    shared_ptr<Shape> thisShape) const {
+void Box::Intersect(const LightRay &lightRay, HitRecord &hit) const {
     // Check if the ray of light intersects with any of the box's face.
     for (const auto &face : mFaces)
     {
-        face->Intersect(lightRay, minT, nearestShape, face);
+        face->Intersect(lightRay, hit);
     }
 }
 
@@ -9,6 +9,7 @@
 #ifndef RAY_TRACER_BOX_HPP
 #define RAY_TRACER_BOX_HPP
 
+#include <array>
 #include  "rectangle.hpp"
 
 class Box : public Shape
@@ -32,14 +33,10 @@ public:
 
     /**
      * @param lightRay Contains the point from which an intersection with this shape will measured.
-     * @param minT Minimum distance from the lightRay's origin to any shape so far. If this shape is closer to the origin
-     *  than this value then it will be updated to that distance.
-     * @param nearestShape Shape that is reportedly the closest to the lightray's origin so far. If any of the rectangles
-     * in this box is closer then it will be updated to that rectangle's pointer.
-     * @param thisShape Unused.
+     * @param hit Nearest intersection found so far. Updated to the intersection with the nearest face of this box if
+     *  it's closer to the lightRay's origin than hit.t.
      */
-    void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                   shared_ptr<Shape> thisShape) const;
+    void Intersect(const LightRay &lightRay, HitRecord &hit) const;
 
     /**
      * @param point Point to determine if it's inside this Box.
@@ -78,6 +78,11 @@ float Camera::GetPixelSize() const
     return mPixelSize;
 }
 
+float Camera::GetFootprint(const float distance) const
+{
+    return distance * mPixelSize / mViewPlaneDistance;
+}
+
 void Camera::SetImageDimensions(unsigned int width, unsigned int height)
 {
     mWidth = width;
@@ -91,6 +91,12 @@ public:
      */
     float GetPixelSize() const;
 
+    /**
+     * @param distance Distance travelled by a ray from the focal point.
+     * @return Width covered by the ray of a single pixel at the given distance.
+     */
+    float GetFootprint(const float distance) const;
+
 protected:
 
     /** This camera's vectors. */
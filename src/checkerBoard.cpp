@@ -7,14 +7,35 @@
 ** -------------------------------------------------------------------------*/
 
 #include "checkerBoard.hpp"
+#include <cmath>
+
+/**
+ * @param u Coordinate measured in squares of the pattern.
+ * @return Integral from 0 to u of the square wave that is 1 in even squares and -1 in odd ones.
+ */
+static inline float SquareWaveIntegral(const float u)
+{
+    return 1 - abs(u - 2 * floor(u / 2) - 1);
+}
+
+/**
+ * @param u Coordinate measured in squares of the pattern.
+ * @param width Width of the box filter measured in squares of the pattern.
+ * @return Mean of the square wave that is 1 in even squares and -1 in odd ones between u - width/2 and u + width/2.
+ */
+static inline float FilteredSquareWave(const float u, const float width)
+{
+    if (width < 1e-4f) return static_cast<int>(floor(u)) % 2 == 0 ? 1.0f : -1.0f;
+    return (SquareWaveIntegral(u + width / 2) - SquareWaveIntegral(u - width / 2)) / width;
+}
 
 CheckerBoard::CheckerBoard(const float squareSize, Color color1, Color color2)
-: Material(color1, BLACK, 0.0f, BLACK, BLACK),
+: Material(CHECKER_BOARD_DIFFUSE, color1, BLACK, 0.0f, BLACK, BLACK),
   mColor1(color1), mColor2(color2), mSquareSize(squareSize)
 {}
 
 CheckerBoard::CheckerBoard(const float squareSize, Color color1, Color color2, Color reflective)
-: Material(color1, BLACK, 0.0f, reflective, BLACK),
+: Material(CHECKER_BOARD_DIFFUSE, color1, BLACK, 0.0f, reflective, BLACK),
   mColor1(color1), mColor2(color2), mSquareSize(squareSize)
 {}
 
@@ -28,4 +49,23 @@ Color CheckerBoard::GetDiffuse(const Point &point) const
         return mColor1;
     else
         return mColor2;
+}
+
+Color CheckerBoard::GetFilteredDiffuse(const Point &point, const Vect &normal,
+                                       const Vect &direction, const float footprint) const
+{
+    const float widthX = GetFootprintWidth(normal, direction, footprint, X) / mSquareSize;
+    const float widthY = GetFootprintWidth(normal, direction, footprint, Y) / mSquareSize;
+    const float widthZ = GetFootprintWidth(normal, direction, footprint, Z) / mSquareSize;
+
+    // Small footprints fall inside a single square.
+    if (max(widthX, max(widthY, widthZ)) < 1e-4f) return GetDiffuse(point);
+
+    /* The pattern is the product of a square wave in each axis, being mColor2 where the product is 1 and mColor1 where
+     * it's -1. The box filtered product is approximated by the product of the box filtered waves. */
+    const float product = FilteredSquareWave(point.GetX() / mSquareSize, widthX) *
+                          FilteredSquareWave(point.GetY() / mSquareSize, widthY) *
+                          FilteredSquareWave(point.GetZ() / mSquareSize, widthZ);
+    const float weight1 = (1 - product) / 2;
+    return mColor1 * weight1 + mColor2 * (1 - weight1);
 }
\ No newline at end of file
@@ -47,11 +47,26 @@ public:
     CheckerBoard(const float squareSize, Color color1, Color color2, Color reflective);
 
     /**
+     * Material::GetDiffuse calls it for materials of kind CHECKER_BOARD_DIFFUSE.
+     *
      * @return This material's color at the given point. Depends on the point's values relative to the world's axis
      *  and the colors in this material.
      */
     Color GetDiffuse(const Point &point) const;
 
+    /**
+     * Analytic box filter of the pattern over the area covered by the ray, so far away squares blend into the mean of
+     * both colors instead of aliasing.
+     *
+     * @param point Point for which the diffuse value is returned.
+     * @param normal Normal to the surface in point.
+     * @param direction Direction of the ray that reached point.
+     * @param footprint Width of the ray when it reaches point, measured perpendicularly to its direction.
+     * @return This material's color averaged around the given point.
+     */
+    Color GetFilteredDiffuse(const Point &point, const Vect &normal,
+                             const Vect &direction, const float footprint) const;
+
 private:
 
     /** The two colors that form the pattern in this 3D texture. */
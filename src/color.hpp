@@ -13,6 +13,7 @@
 #include <algorithm>
 #include <climits>
 #include <cmath>
+#include "simd.hpp"
 
 using namespace std;
 
@@ -27,7 +28,7 @@ public:
      * @return a black Color.
      */
     constexpr Color()
-    : mR(0), mG(0), mB(0)
+    : mValues(MakeFloat3(0, 0, 0))
     {}
 
     /**
@@ -39,7 +40,15 @@ public:
      * @return a Color with the given RGB values.
      */
     constexpr Color(const float r, const float g, const float b)
-    : mR(r), mG(g), mB(b)
+    : mValues(MakeFloat3(r, g, b))
+    {}
+
+    /**
+     * @param values RGB values.
+     * @return a Color with the given RGB values.
+     */
+    constexpr explicit Color(const Float3 &values)
+    : mValues(values)
     {}
 
     /**
@@ -47,7 +56,7 @@ public:
      */
     constexpr float GetR() const
     {
-        return mR;
+        return mValues[0];
     }
 
     /**
@@ -55,7 +64,7 @@ public:
      */
     constexpr float GetG() const
     {
-        return mG;
+        return mValues[1];
     }
 
     /**
@@ -63,39 +72,33 @@ public:
      */
     constexpr float GetB() const
     {
-        return mB;
+        return mValues[2];
     }
 
     /**
      * @param color Color which values will be summed to this one's.
      * @return New color sum of this and the other color's RGB values.
      */
-    Color operator+(const Color &color) const
+    SIMD_CONSTEXPR Color operator+(const Color &color) const
     {
-        return Color(mR + color.mR,
-                     mG + color.mG,
-                     mB + color.mB);
+        return Color(Add(mValues, color.mValues));
     }
 
     /**
      * @param color Color which values will be summed to this one's.
      */
-    void operator+=(const Color &color)
+    SIMD_CONSTEXPR void operator+=(const Color &color)
     {
-        mR += color.mR;
-        mG += color.mG;
-        mB += color.mB;
+        mValues = Add(mValues, color.mValues);
     }
 
     /**
      * @param color Color by which this color's values will be multiplied.
      * @return New color product of this and the other color's RGB values.
      */
-    Color operator*(const Color &color) const
+    SIMD_CONSTEXPR Color operator*(const Color &color) const
     {
-        return Color(mR * color.mR,
-                     mG * color.mG,
-                     mB * color.mB);
+        return Color(Multiply(mValues, color.mValues));
     }
 
     /**
@@ -103,20 +106,18 @@ public:
      * or equal to 0 (negative colors are evil).
      * @return New color product of this one's RGB values and k.
      */
-    Color operator*(const float k) const
+    SIMD_CONSTEXPR Color operator*(const float k) const
     {
-        return Color(mR*k, mG*k, mB*k);
+        return Color(Scale(mValues, k));
     }
 
     /**
      * @param k Value by which this color's RGB values will be multiplied. k must be greater
      * or equal to 0 (negative colors are evil).
      */
-    void operator*=(const float k)
+    SIMD_CONSTEXPR void operator*=(const float k)
     {
-        mR *= k;
-        mG *= k;
-        mB *= k;
+        mValues = Scale(mValues, k);
     }
 
     /**
@@ -124,25 +125,25 @@ public:
      * or equal to 0 (negative colors are evil).
      * @return New color result of dividing the RGB values in this color by k.
      */
-    Color operator/(const float k) const
+    SIMD_CONSTEXPR Color operator/(const float k) const
     {
-        return Color(mR/k, mG/k, mB/k);
+        return Color(Divide(mValues, k));
     }
 
     /**
      * @param color Value with which this color's RGB values will be compared.
      * @return True if this Color is equal to color.
      */
-    bool operator==(const Color &color) const
+    SIMD_CONSTEXPR bool operator==(const Color &color) const
     {
-        return (color.mR == mR) && (color.mG == mG) && (color.mB == mB);
+        return Equal(mValues, color.mValues);
     }
 
     /**
      * @param color Value with which this color's RGB values will be compared.
      * @return False if this Color is equal to color.
      */
-    bool operator!=(const Color &color) const
+    SIMD_CONSTEXPR bool operator!=(const Color &color) const
     {
         return ! (*this == color);
     }
@@ -152,9 +153,9 @@ public:
      */
     Color Clamp() const
     {
-        return Color(max(0.0f, min(mR, 1.0f)),
-                     max(0.0f, min(mG, 1.0f)),
-                     max(0.0f, min(mB, 1.0f)));
+        return Color(max(0.0f, min(GetR(), 1.0f)),
+                     max(0.0f, min(GetG(), 1.0f)),
+                     max(0.0f, min(GetB(), 1.0f)));
     }
 
     /**
@@ -162,15 +163,15 @@ public:
      */
     Color GammaCorrect() const
     {
-        return Color(pow(mR, GAMMA), pow(mG, GAMMA), pow(mB, GAMMA));
+        return Color(pow(GetR(), GAMMA), pow(GetG(), GAMMA), pow(GetB(), GAMMA));
     }
 
     /**
      * @return The mean of the three channels RGB.
      */
-    float MeanRGB() const
+    constexpr float MeanRGB() const
     {
-        return (mR + mG + mB) / 3;
+        return (GetR() + GetG() + GetB()) / 3;
     }
 
 private:
@@ -179,9 +180,7 @@ private:
     static constexpr float GAMMA = 2.2f;
 
     /** This color's RGB values. */
-    float mR;
-    float mG;
-    float mB;
+    Float3 mValues;
 };
 
 /** Some color definitions to make life easier when making simple scenes. */
@@ -23,14 +23,13 @@ float CompositeShape::Intersect(const LightRay &lightRay) const
     return FLT_MAX;
 }
 
-void CompositeShape::Intersect(const LightRay& lightRay, float &minT, shared_ptr <Shape> &nearestShape,
-                               shared_ptr<Shape> thisShape) const
+void CompositeShape::Intersect(const LightRay& lightRay, HitRecord &hit) const
 {
     if (mBoundingShape->Intersect(lightRay) != FLT_MAX)
     {
         for (const shared_ptr<Shape> &shape : mShapesWithin)
         {
-            shape->Intersect(lightRay, minT, nearestShape, shape);
+            shape->Intersect(lightRay, hit);
         }
     }
 }
\ No newline at end of file
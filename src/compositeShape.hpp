@@ -53,15 +53,10 @@ public:
 
     /**
      * @param lightRay Contains the point from which an intersection with this shape will measured.
-     * @param minT Minimum distance from the lightRay's origin to any shape so far. If this shape is closer to the origin
-     *  than this value then it will be updated to that distance.
-     * @param nearestShape Shape that is reportedly the closest to the lightRay's origin so far. Updated to thisShape
-     *  if this shape is at a distance from the lightRay's origin smaller than minT and this shape doesn't contain any
-     *  sub-shapes.
-     * @param thisShape shared_ptr to this shape.
+     * @param hit Nearest intersection found so far. Updated to the intersection with the nearest of the shapes within
+     *  if it's closer to the lightRay's origin than hit.t.
      */
-    void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                   shared_ptr<Shape> thisShape) const;
+    void Intersect(const LightRay &lightRay, HitRecord &hit) const;
 
     /**
      * This method is not usable for this shape. Calling it will result in an exception. This is because a CompositeShape
@@ -0,0 +1,69 @@
+/** ---------------------------------------------------------------------------
+ ** emissionMap.cpp
+ ** Implementation for EmissionMap class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cmath>
+#include "emissionMap.hpp"
+#include "mathUtils.hpp"
+
+EmissionMap::EmissionMap(const unsigned int rows, const unsigned int columns)
+: mRows(rows), mColumns(columns), mImportance(rows * columns, 1.0f)
+{
+    Build();
+}
+
+unsigned int EmissionMap::GetCellCount() const
+{
+    return mRows * mColumns;
+}
+
+Vect EmissionMap::GetDirection(const unsigned int cell, const float u, const float v) const
+{
+    // Uniform steps in the cosine of the inclination give cells of equal area.
+    const float cosine = 1 - 2 * (cell / mColumns + v) / mRows;
+    const float sine = sqrt(max(0.0f, 1 - cosine * cosine));
+    const float azimuth = 2 * PI * (cell % mColumns + u) / mColumns;
+    return Vect(sine * cos(azimuth), sine * sin(azimuth), cosine);
+}
+
+void EmissionMap::SetImportance(const unsigned int cell, const float importance)
+{
+    mImportance[cell] = importance;
+}
+
+void EmissionMap::Build(const float minimumShare)
+{
+    const unsigned int cells = GetCellCount();
+    float total = 0.0f;
+    for (float importance : mImportance) total += importance;
+    const float minimum = total > 0 ? minimumShare * total / cells : 1.0f;
+
+    mCdf.resize(cells);
+    mWeights.resize(cells);
+    float accumulated = 0.0f;
+    for (unsigned int i = 0; i < cells; ++i)
+    {
+        mWeights[i] = max(mImportance[i], minimum);
+        accumulated += mWeights[i];
+        mCdf[i] = accumulated;
+    }
+    for (unsigned int i = 0; i < cells; ++i)
+    {
+        mCdf[i] /= accumulated;
+        // Uniform probability of the cell divided by its actual probability.
+        mWeights[i] = accumulated / (cells * mWeights[i]);
+    }
+    mCdf.back() = 1.0f;
+}
+
+tuple<Vect, float> EmissionMap::Sample(const float cellValue, const float u, const float v) const
+{
+    const unsigned int cell = min(static_cast<unsigned int>(upper_bound(mCdf.begin(), mCdf.end(), cellValue) -
+                                                            mCdf.begin()), GetCellCount() - 1);
+    return make_tuple(GetDirection(cell, u, v), mWeights[cell]);
+}
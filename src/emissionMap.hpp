@@ -0,0 +1,87 @@
+/** ---------------------------------------------------------------------------
+ ** emissionMap.hpp
+ ** Distribution of the photons emitted by a light source over the sphere of
+ ** directions. The sphere is split in cells of equal area (equal steps in the
+ ** cosine of the inclination and in the azimuth), each with an importance.
+ ** Directions are sampled proportionally to it and carry the weight that keeps
+ ** the photon map unbiased, so important directions get more, dimmer photons.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_EMISSION_MAP_HPP
+#define RAY_TRACER_EMISSION_MAP_HPP
+
+#include <tuple>
+#include "vect.hpp"
+#include <vector>
+
+using namespace std;
+
+class EmissionMap
+{
+
+public:
+
+    /**
+     * @param rows Number of cells in inclination.
+     * @param columns Number of cells in azimuth.
+     * @return New EmissionMap with the same importance in every cell (uniform emission).
+     */
+    EmissionMap(const unsigned int rows = 32, const unsigned int columns = 64);
+
+    /**
+     * @return Number of cells in this map.
+     */
+    unsigned int GetCellCount() const;
+
+    /**
+     * @param cell Index of the cell.
+     * @param u Horizontal (azimuth) position inside the cell, in [0, 1).
+     * @param v Vertical (inclination) position inside the cell, in [0, 1).
+     * @return Unit direction at the given position of the cell.
+     */
+    Vect GetDirection(const unsigned int cell, const float u, const float v) const;
+
+    /**
+     * Sets the importance of a cell. Build must be called before sampling again.
+     *
+     * @param cell Index of the cell.
+     * @param importance Non negative importance of the directions in the cell.
+     */
+    void SetImportance(const unsigned int cell, const float importance);
+
+    /**
+     * Builds the distribution used to sample the cells. Every cell keeps at least minimumShare times the mean
+     * importance, so no direction is left without photons. If no cell has any importance emission is uniform.
+     *
+     * @param minimumShare Minimum importance of a cell relative to the mean importance.
+     */
+    void Build(const float minimumShare = 0.5f);
+
+    /**
+     * @param cellValue Uniform random value in [0, 1) used to choose the cell.
+     * @param u Uniform random value in [0, 1) used for the azimuth inside the cell.
+     * @param v Uniform random value in [0, 1) used for the inclination inside the cell.
+     * @return Tuple with the sampled direction and its weight, the ratio between the probability of uniform emission
+     *  and the probability of sampling that direction.
+     */
+    tuple<Vect, float> Sample(const float cellValue, const float u, const float v) const;
+
+private:
+
+    /** Number of cells in inclination and azimuth. */
+    unsigned int mRows, mColumns;
+
+    /** Importance of every cell, row by row. */
+    vector<float> mImportance;
+
+    /** Cumulative importance of the cells, normalized to end in 1. */
+    vector<float> mCdf;
+
+    /** Weight of the photons emitted in every cell. */
+    vector<float> mWeights;
+};
+
+#endif // RAY_TRACER_EMISSION_MAP_HPP
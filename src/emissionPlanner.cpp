@@ -0,0 +1,97 @@
+/** ---------------------------------------------------------------------------
+ ** emissionPlanner.cpp
+ ** Implementation for EmissionPlanner class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cmath>
+#include "emissionPlanner.hpp"
+#include "mathUtils.hpp"
+#include <numeric>
+
+EmissionPlanner::EmissionPlanner(const vector<shared_ptr<LightSource>> &lightSources, const unsigned int photons)
+{
+    // Power of every point of every light source, flattened.
+    vector<double> power;
+    vector<Color> pointColor;
+    for (const shared_ptr<LightSource> &light : lightSources)
+    {
+        const size_t points = light->GetLights().size();
+        /* The photons of a light source with n points carry its base color over n in total, as they always did, and
+         * every point emits an n'th of that. */
+        const Color color = light->GetBaseColor() / points / points;
+        mPhotons.emplace_back(points, 0);
+        for (size_t i = 0; i < points; ++i)
+        {
+            power.push_back(max(0.0f, color.MeanRGB()));
+            pointColor.push_back(color);
+        }
+    }
+    if (power.empty()) return;
+
+    // Without any power, photons are split evenly.
+    double totalPower = accumulate(power.begin(), power.end(), 0.0);
+    if (totalPower <= 0)
+    {
+        fill(power.begin(), power.end(), 1.0);
+        totalPower = power.size();
+    }
+
+    // One photon for every point with some power, as long as there are enough.
+    vector<unsigned int> counts(power.size(), 0);
+    const unsigned int powered = count_if(power.begin(), power.end(), [](double p) { return p > 0; });
+    unsigned int remaining = photons;
+    if (photons >= powered)
+    {
+        for (size_t i = 0; i < power.size(); ++i) counts[i] = power[i] > 0;
+        remaining -= powered;
+    }
+
+    // The rest are split by power, the photons left by rounding down go to the largest remainders.
+    vector<double> remainders(power.size());
+    unsigned int assigned = 0;
+    for (size_t i = 0; i < power.size(); ++i)
+    {
+        const double share = remaining * power[i] / totalPower;
+        const unsigned int whole = static_cast<unsigned int>(floor(share));
+        counts[i] += whole;
+        assigned += whole;
+        remainders[i] = share - whole;
+    }
+    vector<size_t> order(power.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&remainders](size_t a, size_t b)
+    {
+        return remainders[a] > remainders[b];
+    });
+    for (size_t i = 0; assigned < remaining; i = (i + 1) % order.size(), ++assigned)
+    {
+        ++counts[order[i]];
+    }
+
+    // Every photon carries the power of its point over the sphere, divided by the photons it actually emits.
+    size_t index = 0;
+    for (vector<unsigned int> &lightPhotons : mPhotons)
+    {
+        mFlux.emplace_back();
+        for (unsigned int &pointPhotons : lightPhotons)
+        {
+            pointPhotons = counts[index];
+            mFlux.back().push_back(pointPhotons > 0 ? pointColor[index] * 4 * PI / pointPhotons : BLACK);
+            ++index;
+        }
+    }
+}
+
+unsigned int EmissionPlanner::GetPhotons(const unsigned int light, const unsigned int point) const
+{
+    return mPhotons.at(light).at(point);
+}
+
+Color EmissionPlanner::GetFlux(const unsigned int light, const unsigned int point) const
+{
+    return mFlux.at(light).at(point);
+}
@@ -0,0 +1,62 @@
+/** ---------------------------------------------------------------------------
+ ** emissionPlanner.hpp
+ ** Splits a budget of photons between the light sources of a scene and their
+ ** points, proportionally to the power of each one. Every photon of the
+ ** budget is assigned (largest remainder rounding), and the flux of each
+ ** photon is normalized by the number of photons its point actually emits.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_EMISSION_PLANNER_HPP
+#define RAY_TRACER_EMISSION_PLANNER_HPP
+
+#include "color.hpp"
+#include "lightSource.hpp"
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+class EmissionPlanner
+{
+
+public:
+
+    /**
+     * Plans the emission of the given number of photons. The points of a light source share its power evenly, which
+     * for a light source of n points is its base color over n (the indirect light of area lights is as bright as it
+     * always was). If the budget allows it, every point with some power emits at least one photon so no light is lost.
+     *
+     * @param lightSources Light sources that will emit the photons.
+     * @param photons Total number of photons to emit.
+     * @return New EmissionPlanner with the photons of every point of every light source.
+     */
+    EmissionPlanner(const vector<shared_ptr<LightSource>> &lightSources, const unsigned int photons);
+
+    /**
+     * @param light Index of the light source.
+     * @param point Index of the point in the light source.
+     * @return Number of photons that point must emit.
+     */
+    unsigned int GetPhotons(const unsigned int light, const unsigned int point) const;
+
+    /**
+     * @param light Index of the light source.
+     * @param point Index of the point in the light source.
+     * @return Flux of every photon emitted uniformly from that point, its power over the sphere divided by the number
+     * of photons it emits.
+     */
+    Color GetFlux(const unsigned int light, const unsigned int point) const;
+
+private:
+
+    /** Number of photons of every point of every light source. */
+    vector<vector<unsigned int>> mPhotons;
+
+    /** Flux of the photons of every point of every light source. */
+    vector<vector<Color>> mFlux;
+};
+
+#endif // RAY_TRACER_EMISSION_PLANNER_HPP
@@ -0,0 +1,87 @@
+/** ---------------------------------------------------------------------------
+ ** frame.hpp
+ ** Orthonormal basis around a unit vector, used to turn directions sampled
+ ** around the z axis into world directions without building a whole
+ ** PoseTransformationMatrix.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_FRAME_HPP
+#define RAY_TRACER_FRAME_HPP
+
+#include <cmath>
+#include "vect.hpp"
+
+class Frame
+{
+
+public:
+
+    /**
+     * Builds the basis without branches nor normalisations, as in Building an Orthonormal Basis, Revisited [Duff et
+     * al., 2017].
+     *
+     * @param normal Unit vector used as the z axis of the basis.
+     * @return New frame whose x and y axes are perpendicular to normal and to each other.
+     */
+    explicit Frame(const Vect &normal)
+    : mNormal(normal)
+    {
+        const float sign = copysign(1.0f, normal.GetZ());
+        const float a = -1.0f / (sign + normal.GetZ());
+        const float b = normal.GetX() * normal.GetY() * a;
+        mTangent = Vect(1.0f + sign * normal.GetX() * normal.GetX() * a, sign * b, -sign * normal.GetX());
+        mBitangent = Vect(b, sign + normal.GetY() * normal.GetY() * a, -normal.GetY());
+    }
+
+    /**
+     * @param local Vector expressed in this frame.
+     * @return The same vector expressed in world coordinates.
+     */
+    Vect ToWorld(const Vect &local) const
+    {
+        return mTangent * local.GetX() + mBitangent * local.GetY() + mNormal * local.GetZ();
+    }
+
+    /**
+     * @param world Vector expressed in world coordinates.
+     * @return The same vector expressed in this frame.
+     */
+    Vect ToLocal(const Vect &world) const
+    {
+        return Vect(world.DotProduct(mTangent), world.DotProduct(mBitangent), world.DotProduct(mNormal));
+    }
+
+    /**
+     * @return X axis of this frame.
+     */
+    const Vect &GetTangent() const
+    {
+        return mTangent;
+    }
+
+    /**
+     * @return Y axis of this frame.
+     */
+    const Vect &GetBitangent() const
+    {
+        return mBitangent;
+    }
+
+    /**
+     * @return Z axis of this frame, the vector it was built from.
+     */
+    const Vect &GetNormal() const
+    {
+        return mNormal;
+    }
+
+private:
+
+    /** Axes of the frame, all of them unit vectors. */
+    Vect mTangent, mBitangent, mNormal;
+};
+
+#endif // RAY_TRACER_FRAME_HPP
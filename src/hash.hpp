@@ -0,0 +1,57 @@
+/** ---------------------------------------------------------------------------
+ ** hash.hpp
+ ** Fast non cryptographic hash used to identify the contents of files and the
+ ** parameters used to load them, so cached versions can be reused safely.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_HASH_HPP
+#define RAY_TRACER_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/** Initial value of a hash. */
+static constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+/**
+ * FNV-1a hash, consuming 8 bytes per step instead of 1 to hash big files quickly.
+ *
+ * @param data Bytes to hash.
+ * @param size Number of bytes to hash.
+ * @param hash Hash of the previous data, to hash several values one after another.
+ * @return Hash of the previous data followed by the given bytes.
+ */
+inline static uint64_t Hash(const void *data, const size_t size, uint64_t hash = HASH_SEED)
+{
+    static constexpr uint64_t PRIME = 1099511628211ull;
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * PRIME;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @param value Value to hash.
+ * @param hash Hash of the previous data.
+ * @return Hash of the previous data followed by the bytes of value.
+ */
+template <class T>
+inline static uint64_t HashValue(const T &value, const uint64_t hash = HASH_SEED)
+{
+    return Hash(&value, sizeof(T), hash);
+}
+
+#endif // RAY_TRACER_HASH_HPP
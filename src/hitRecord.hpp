@@ -0,0 +1,58 @@
+/** ---------------------------------------------------------------------------
+ ** hitRecord.hpp
+ ** Nearest intersection of a ray of light with the shapes of a scene. It only
+ ** points to the primitive shape hit, owning shapes is up to the scene, so
+ ** finding the nearest intersection doesn't touch any reference count. Once
+ ** the nearest intersection is known, the shape fills in the surface data
+ ** (point, normals and material parameters) so shading and photon tracing
+ ** compute it only once.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_HIT_RECORD_HPP
+#define RAY_TRACER_HIT_RECORD_HPP
+
+#include <cfloat>
+#include "color.hpp"
+#include "point.hpp"
+#include "vect.hpp"
+
+class Material;
+class Shape;
+
+struct HitRecord
+{
+    /** Distance from the ray's origin to the intersection, FLT_MAX if nothing has been hit. */
+    float t = FLT_MAX;
+
+    /** Primitive shape hit, never a shape made of other shapes. nullptr if nothing has been hit. */
+    const Shape *shape = nullptr;
+
+    /** Barycentric coordinates of the intersection with respect to the second and third vertices of the triangle hit,
+     * the axis and sign of the normal of the face hit of a MengerSponge, 0 for any other shape. */
+    float u = 0.0f, v = 0.0f;
+
+    /* Surface data, only valid after Shape::FillHitRecord. */
+
+    /** Intersection point. */
+    Point point;
+
+    /** Normal of the shape at point, pointing wherever the shape defines it (outwards for closed shapes). */
+    Vect normal;
+
+    /** Normal used for shading, facing the ray and altered by the normal modifier of the shape if it has one. */
+    Vect visibleNormal;
+
+    /** Material of the shape hit. */
+    const Material *material = nullptr;
+
+    /** Parameters of the material at point. */
+    Color diffuse, specular, reflectance, transmittance;
+
+    /** Shininess of the material. */
+    float shininess = 0.0f;
+};
+
+#endif // RAY_TRACER_HIT_RECORD_HPP
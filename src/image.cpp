@@ -6,63 +6,191 @@
  **         Santiago Gil Begué, NIA: 683482
  ** -------------------------------------------------------------------------*/
 
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include "image.hpp"
 #include <iostream>
+#include "trace.hpp"
+#include <utility>
+#include <vector>
 
 Image::Image(const unsigned int width, const unsigned int height)
 {
-    // Resize the vector's height.
-    mImage.resize(height);
-    // Resize all rows to the desired width.
-    for (unsigned int i = 0; i < height; ++i)
+    Allocate(width, height);
+}
+
+Image::Image(const Image &image)
+{
+    *this = image;
+}
+
+Image::Image(Image &&image)
+: mData(nullptr)
+{
+    *this = move(image);
+}
+
+Image &Image::operator=(const Image &image)
+{
+    if (this != &image)
+    {
+        Allocate(image.mWidth, image.mHeight);
+        memcpy(mData, image.mData, BufferSize() * sizeof(float));
+    }
+    return *this;
+}
+
+Image &Image::operator=(Image &&image)
+{
+    if (this != &image)
     {
-        mImage.at(i).resize(width);
+        SetDimensions(image.mWidth, image.mHeight);
+        mBuffer = move(image.mBuffer);
+        mData = image.mData;
+        // Leave the moved image empty instead of pointing to the buffer it doesn't own anymore.
+        image.SetDimensions(0, 0);
+        image.mData = nullptr;
     }
+    return *this;
 }
 
-Image::Image(const string &filename) {
-    ifstream inputFile(filename);
-    string buffer;
+void Image::Allocate(const unsigned int width, const unsigned int height)
+{
+    SetDimensions(width, height);
 
-    if(!inputFile.good())
+    void *buffer = nullptr;
+    const size_t bytes = BufferSize() * sizeof(float);
+    if (posix_memalign(&buffer, CACHE_LINE, bytes > 0 ? bytes : CACHE_LINE) != 0)
     {
-        cout << "Can't read the file " << filename << '\n';
+        cerr << "Couldn't allocate an image of " << width << 'x' << height << '\n';
         throw 1;
     }
+    memset(buffer, 0, bytes);
+    mData = static_cast<float *>(buffer);
+    mBuffer = shared_ptr<float>(mData, free);
+}
+
+void Image::SetDimensions(const unsigned int width, const unsigned int height)
+{
+    mWidth = width;
+    mHeight = height;
+    // Pad each row to a whole number of aligned tiles so every row starts at a cache line.
+    mStride = (width + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+    mRowPitch = 3 * static_cast<size_t>(mStride);
+}
+
+size_t Image::BufferSize() const
+{
+    return 3 * static_cast<size_t>(mStride) * mHeight;
+}
+
+/** Header of the binary image files. The pixel buffer follows it exactly as it's laid out in memory. */
+struct BinaryImageHeader
+{
+    char magic[4];
+    uint32_t version;
+    /** Size and modification time of the file the image was loaded from, -1 if unknown. */
+    int64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    /** Keeps the pixels that follow the header aligned to a cache line. */
+    char padding[Image::CACHE_LINE - 4 - 4 * sizeof(uint32_t) - 2 * sizeof(int64_t)];
+};
+
+static_assert(sizeof(BinaryImageHeader) == Image::CACHE_LINE, "The binary image header must fill a cache line");
+
+/** First bytes of every binary image file. */
+static const char BINARY_MAGIC[4] = {'R', 'T', 'E', 'X'};
 
-    while(true)
+/** Version of the binary image format, increase it when the format changes. */
+static const uint32_t BINARY_VERSION = 1;
+
+/**
+ * @param current First character to check.
+ * @param end End of the buffer.
+ * @return First character after current that isn't whitespace nor part of a ppm comment.
+ */
+static const char *SkipSeparators(const char *current, const char *end)
+{
+    while (current < end)
     {
-        if (inputFile.peek() == '#')
+        if (*current == '#')
         {
             // Ignore the line as a comment.
-            getline(inputFile, buffer);
-            continue;
-        }
-        inputFile >> buffer;
-        if (buffer == "P3") break;
-        else
-        {
-            cout << "Can't find the ppm header for the file " << filename << '\n';
-            throw 1;
+            while (current < end && *current != '\n') ++current;
         }
+        else if (isspace(static_cast<unsigned char>(*current))) ++current;
+        else break;
     }
+    return current;
+}
 
-    unsigned int width = 0, height = 0;
-    while(true)
+/**
+ * @param current First character of the number.
+ * @param end End of the buffer.
+ * @param value Decimal value read. Left at 0 if current doesn't point to a digit.
+ * @return First character after the number.
+ */
+static const char *ParseUnsigned(const char *current, const char *end, unsigned int &value)
+{
+    value = 0;
+    while (current < end && *current >= '0' && *current <= '9')
     {
-        if (inputFile.peek() == '#' || inputFile.peek() == '\n')
-        {
-            // Ignore the line as a comment.
-            getline(inputFile, buffer);
-            continue;
-        }
-        else
-        {
-            inputFile >> width >> height;
-            break;
-        }
+        value = value * 10 + static_cast<unsigned int>(*current - '0');
+        ++current;
+    }
+    return current;
+}
+
+Image::Image(const string &filename)
+{
+    shared_ptr<MappedFile> file = make_shared<MappedFile>(filename);
+
+    if (file->GetSize() >= sizeof(BINARY_MAGIC) && memcmp(file->GetData(), BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0)
+    {
+        LoadBinary(file, filename);
+    }
+    else
+    {
+        LoadPPM(*file, filename);
+    }
+}
+
+Image::Image(const string &filename, const long long sourceSize, const long long sourceTime)
+{
+    shared_ptr<MappedFile> file = make_shared<MappedFile>(filename);
+    LoadBinary(file, filename);
+
+    const BinaryImageHeader *header = reinterpret_cast<const BinaryImageHeader *>(file->GetData());
+    if (header->sourceSize != sourceSize || header->sourceTime != sourceTime)
+    {
+        cout << "Outdated binary image " << filename << '\n';
+        throw 1;
     }
+}
+
+void Image::LoadPPM(const MappedFile &file, const string &filename)
+{
+    const char *current = file.GetData();
+    const char *end = current + file.GetSize();
+
+    current = SkipSeparators(current, end);
+    if (end - current < 2 || current[0] != 'P' || (current[1] != '3' && current[1] != '6'))
+    {
+        cout << "Can't find the ppm header for the file " << filename << '\n';
+        throw 1;
+    }
+    const bool binary = current[1] == '6';
+    current += 2;
+
+    unsigned int width = 0, height = 0;
+    current = ParseUnsigned(SkipSeparators(current, end), end, width);
+    current = ParseUnsigned(SkipSeparators(current, end), end, height);
 
     if ((width == 0) | (height == 0))
     {
@@ -71,81 +199,156 @@ Image::Image(const string &filename) {
     }
 
     unsigned int maxColorValue = 0;
-    while (true)
+    current = ParseUnsigned(SkipSeparators(current, end), end, maxColorValue);
+
+    if ((maxColorValue == 0) | (maxColorValue > 65535))
     {
-        if ((inputFile.peek() == '#') | (inputFile.peek() == '\n'))
+        cout << "Couldn't find maximum color value in " << filename << '\n';
+        throw 1;
+    }
+
+    // Allocate the buffer to account for all the values it'll hold.
+    Allocate(width, height);
+    const float scale = 1.0f / maxColorValue;
+
+    if (binary)
+    {
+        // A single whitespace separates the header from the raw values.
+        ++current;
+        const size_t bytesPerValue = maxColorValue > 255 ? 2 : 1;
+        if (current > end || static_cast<size_t>(end - current) < 3 * bytesPerValue * width * height)
         {
-            // Ignore the line as a comment.
-            getline(inputFile, buffer);
-            continue;
+            cout << "Not enough color values in " << filename << '\n';
+            throw 1;
         }
-        else
+
+        const unsigned char *values = reinterpret_cast<const unsigned char *>(current);
+        for (unsigned int i = 0; i < height; ++i)
         {
-            inputFile >> maxColorValue;
-            break;
+            float *row = mData + i * mRowPitch;
+            for (unsigned int j = 0; j < 3 * width; ++j)
+            {
+                const unsigned int value = bytesPerValue == 1 ? values[0] : (values[0] << 8) | values[1];
+                row[j] = value * scale;
+                values += bytesPerValue;
+            }
         }
     }
+    else
+    {
+        for (unsigned int i = 0; i < height; ++i)
+        {
+            float *row = mData + i * mRowPitch;
+            for (unsigned int j = 0; j < 3 * width; ++j)
+            {
+                unsigned int value;
+                current = SkipSeparators(current, end);
+                if (current == end)
+                {
+                    cout << "Not enough color values in " << filename << '\n';
+                    throw 1;
+                }
+                current = ParseUnsigned(current, end, value);
+                row[j] = value * scale;
+            }
+        }
+    }
+}
 
-    if (maxColorValue == 0)
+void Image::LoadBinary(const shared_ptr<MappedFile> file, const string &filename)
+{
+    const BinaryImageHeader *header = reinterpret_cast<const BinaryImageHeader *>(file->GetData());
+    if (file->GetSize() < sizeof(BinaryImageHeader) ||
+        memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 || header->version != BINARY_VERSION)
     {
-        cout << "Couldn't find maximum color value in " << filename << '\n';
+        cout << "Unsupported binary image " << filename << '\n';
         throw 1;
     }
 
-    float r, g, b;
-
-    // Resize mImage to account for all the values it'll hold.
-    mImage.resize(height);
-
-    for ( unsigned int i = 0; i < height; ++i)
+    SetDimensions(header->width, header->height);
+    if (mStride != header->stride || file->GetSize() != sizeof(BinaryImageHeader) + BufferSize() * sizeof(float))
     {
-        mImage[i].resize(width);
+        cout << "Corrupted binary image " << filename << '\n';
+        throw 1;
     }
 
-    // Read all rgb values into the image vector. If this goes wrong use a correct image and it won't.
-    for ( unsigned int i = 0; i < height; ++i)
+    // Use the mapped pixels in place, the image keeps the mapping alive.
+    mData = reinterpret_cast<float *>(file->GetData() + sizeof(BinaryImageHeader));
+    mBuffer = shared_ptr<float>(file, mData);
+}
+
+bool Image::SaveBinary(const string &filename, const long long sourceSize, const long long sourceTime) const
+{
+    BinaryImageHeader header = {};
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.width = mWidth;
+    header.height = mHeight;
+    header.stride = mStride;
+
+    ofstream outputFile(filename, ios::binary);
+    outputFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    outputFile.write(reinterpret_cast<const char *>(mData), BufferSize() * sizeof(float));
+    return outputFile.good();
+}
+
+bool Image::SavePFM(const string &filename) const
+{
+    ofstream outputFile(filename, ios::binary);
+    // A negative scale means the floats are little endian. Rows go from the bottom of the image to the top.
+    outputFile << "PF\n" << mWidth << ' ' << mHeight << "\n-1.0\n";
+    vector<float> values(3 * mWidth);
+    for (unsigned int i = mHeight; i-- > 0;)
     {
-        for (unsigned int j = 0; j < width; ++j)
+        const ConstImageRow row = (*this)[i];
+        for (unsigned int j = 0; j < mWidth; ++j)
         {
-            inputFile >> r >> g >> b;
-            r /= maxColorValue;
-            g /= maxColorValue;
-            b /= maxColorValue;
-
-            mImage[i][j] = Color(r, g, b);
+            const Color pixel = row[j];
+            values[3 * j] = pixel.GetR();
+            values[3 * j + 1] = pixel.GetG();
+            values[3 * j + 2] = pixel.GetB();
         }
+        outputFile.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(float));
     }
+    return outputFile.good();
 }
 
-void Image::Save(const string filename, SaveMode mode) const
+void Image::Save(const string filename, SaveMode mode, const string &comment) const
 {
+    const TraceScope scope("Image::Save", filename);
     ofstream outputFile(filename);
 
     outputFile << "P3" << '\n' <<          // Write the header of the ppm file.
-               "# " << filename << '\n' << // Write the name of the file as a comment.
-               mImage[0].size() << ' ' << mImage.size() << '\n' <<
+               "# " << filename << '\n';  // Write the name of the file as a comment.
+    if (!comment.empty()) outputFile << "# " << comment << '\n';
+    outputFile << mWidth << ' ' << mHeight << '\n' <<
                255 << '\n';
 
     // Find the largest single color value in the image to give it the value 255
     float largest = -1;
-    for (unsigned int i = 0; i < mImage.size(); ++i)
+    for (unsigned int i = 0; i < mHeight; ++i)
     {
-        for (unsigned int j = 0; j < mImage.at(i).size(); ++j)
+        const ConstImageRow row = (*this)[i];
+        for (unsigned int j = 0; j < mWidth; ++j)
         {
-            if (mImage.at(i).at(j).GetR() > largest) largest = mImage.at(i).at(j).GetR();
-            else if (mImage.at(i).at(j).GetG() > largest) largest = mImage.at(i).at(j).GetG();
-            else if (mImage.at(i).at(j).GetB() > largest) largest = mImage.at(i).at(j).GetB();
+            const Color pixel = row[j];
+            if (pixel.GetR() > largest) largest = pixel.GetR();
+            else if (pixel.GetG() > largest) largest = pixel.GetG();
+            else if (pixel.GetB() > largest) largest = pixel.GetB();
         }
     }
 
     largest = largest < 1.0f ? 1.0f : largest;
 
     // Write the image's 2-dimensional array.
-    for (unsigned int i = 0; i < mImage.size(); ++i)
+    for (unsigned int i = 0; i < mHeight; ++i)
     {
-        for (unsigned int j = 0; j < mImage[0].size(); ++j)
+        const ConstImageRow row = (*this)[i];
+        for (unsigned int j = 0; j < mWidth; ++j)
         {
-            Color tmp = mImage[i][j];
+            Color tmp = row[j];
 
             switch(mode)
             {
@@ -170,15 +373,28 @@ void Image::Save(const string filename, SaveMode mode) const
 
 unsigned int Image::GetWidth() const
 {
-    return static_cast<int>(mImage[0].size());
+    return mWidth;
 }
 
 unsigned int Image::GetHeight() const
 {
-    return static_cast<int>(mImage.size());
+    return mHeight;
+}
+
+ImageRow Image::operator[](const unsigned int i)
+{
+    return ImageRow(mData + i * mRowPitch, mWidth);
+}
+
+ConstImageRow Image::operator[](const unsigned int i) const
+{
+    return ConstImageRow(mData + i * mRowPitch, mWidth);
 }
 
-vector<Color>& Image::operator[](const unsigned int i)
+ImageTile Image::GetTile(const unsigned int x, const unsigned int y,
+                         const unsigned int width, const unsigned int height)
 {
-    return mImage[i];
-}
\ No newline at end of file
+    const unsigned int tileWidth = x + width > mWidth ? mWidth - x : width;
+    const unsigned int tileHeight = y + height > mHeight ? mHeight - y : height;
+    return ImageTile(mData + y * mRowPitch + 3 * x, x, y, tileWidth, tileHeight, mRowPitch);
+}
@@ -2,7 +2,12 @@
  ** image.hpp
  ** Container for an images grid of pixels. Each pixel is an RGB color. Contains
  ** an empty image constructor with width and height and a file input constructor.
- ** It can only load ppm image files.
+ ** It can load ppm image files (P3 and P6) and its own binary format, which is
+ ** memory mapped and used in place instead of being copied.
+ **
+ ** The pixels live in a single cache aligned buffer. Rows are padded so every row
+ ** (and every tile with a width multiple of TILE_ALIGNMENT) starts at a cache line,
+ ** which lets several threads write disjoint tiles without false sharing.
  **
  ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
  **         Santiago Gil Begué, NIA: 683482
@@ -12,18 +17,237 @@
 #define RAY_TRACER_IMAGE_HPP
 
 #include "color.hpp"
+#include <cstddef>
+#include "mappedFile.hpp"
+#include <memory>
 #include <string>
-#include <vector>
 
 using namespace std;
 
 enum SaveMode {DIM_TO_WHITE, GAMMA, CLAMP};
 
+/**
+ * Reference to a single pixel inside an Image, its red, green and blue values stored one after the other. Behaves like
+ * a Color&.
+ */
+class PixelRef
+{
+
+public:
+
+    /**
+     * @param red Pointer to the red value of the pixel.
+     */
+    explicit PixelRef(float *red)
+    : mRed(red)
+    {}
+
+    /**
+     * @return The color stored in the referenced pixel.
+     */
+    operator Color() const
+    {
+        return Color(mRed[0], mRed[1], mRed[2]);
+    }
+
+    /**
+     * @param color Color to write in the referenced pixel.
+     */
+    PixelRef &operator=(const Color &color)
+    {
+        mRed[0] = color.GetR();
+        mRed[1] = color.GetG();
+        mRed[2] = color.GetB();
+        return *this;
+    }
+
+    /**
+     * Copies the color of another pixel, not the reference itself.
+     *
+     * @param pixel Pixel which color will be written in the referenced pixel.
+     */
+    PixelRef &operator=(const PixelRef &pixel)
+    {
+        return *this = static_cast<Color>(pixel);
+    }
+
+    /**
+     * @param color Color to add to the referenced pixel.
+     */
+    void operator+=(const Color &color)
+    {
+        mRed[0] += color.GetR();
+        mRed[1] += color.GetG();
+        mRed[2] += color.GetB();
+    }
+
+private:
+
+    /** Red value of the pixel, followed by the green and blue ones. */
+    float *mRed;
+};
+
+/**
+ * View over a horizontal run of pixels of an Image. It doesn't own any memory.
+ */
+class ImageRow
+{
+
+public:
+
+    /**
+     * @param first Pointer to the red value of the first pixel of the row.
+     * @param width Number of pixels in the row.
+     */
+    ImageRow(float *first, const unsigned int width)
+    : mFirst(first), mWidth(width)
+    {}
+
+    /**
+     * @param j Index of the pixel in this row.
+     * @return Reference to the j'th pixel of this row.
+     */
+    PixelRef operator[](const unsigned int j) const
+    {
+        return PixelRef(mFirst + 3 * j);
+    }
+
+    /**
+     * @return Number of pixels in this row.
+     */
+    unsigned int GetWidth() const
+    {
+        return mWidth;
+    }
+
+private:
+
+    float *mFirst;
+    unsigned int mWidth;
+};
+
+/**
+ * Read only view over a horizontal run of pixels of an Image.
+ */
+class ConstImageRow
+{
+
+public:
+
+    /**
+     * @param first Pointer to the red value of the first pixel of the row.
+     * @param width Number of pixels in the row.
+     */
+    ConstImageRow(const float *first, const unsigned int width)
+    : mFirst(first), mWidth(width)
+    {}
+
+    /**
+     * @param j Index of the pixel in this row.
+     * @return Color of the j'th pixel of this row.
+     */
+    Color operator[](const unsigned int j) const
+    {
+        const float *red = mFirst + 3 * j;
+        return Color(red[0], red[1], red[2]);
+    }
+
+    /**
+     * @return Number of pixels in this row.
+     */
+    unsigned int GetWidth() const
+    {
+        return mWidth;
+    }
+
+private:
+
+    const float *mFirst;
+    unsigned int mWidth;
+};
+
+/**
+ * View over a rectangular region of an Image. Rows of the tile are accessed with the subscript operator
+ * and their pixels are indexed relative to the tile's left column.
+ */
+class ImageTile
+{
+
+public:
+
+    /**
+     * @param origin Pointer to the red value of the tile's upper-left pixel.
+     * @param x Column of the image where this tile begins.
+     * @param y Row of the image where this tile begins.
+     * @param width Width in pixels of this tile.
+     * @param height Height in pixels of this tile.
+     * @param rowPitch Distance in floats between two consecutive rows of the image.
+     */
+    ImageTile(float *origin, const unsigned int x, const unsigned int y,
+              const unsigned int width, const unsigned int height, const size_t rowPitch)
+    : mOrigin(origin), mColumn(x), mRow(y), mWidth(width), mHeight(height), mRowPitch(rowPitch)
+    {}
+
+    /**
+     * @param i Index of the row inside this tile.
+     * @return View of the i'th row of this tile.
+     */
+    ImageRow operator[](const unsigned int i) const
+    {
+        return ImageRow(mOrigin + i * mRowPitch, mWidth);
+    }
+
+    /**
+     * @return Column of the image where this tile begins.
+     */
+    unsigned int GetX() const
+    {
+        return mColumn;
+    }
+
+    /**
+     * @return Row of the image where this tile begins.
+     */
+    unsigned int GetY() const
+    {
+        return mRow;
+    }
+
+    /**
+     * @return Width in pixels of this tile.
+     */
+    unsigned int GetWidth() const
+    {
+        return mWidth;
+    }
+
+    /**
+     * @return Height in pixels of this tile.
+     */
+    unsigned int GetHeight() const
+    {
+        return mHeight;
+    }
+
+private:
+
+    float *mOrigin;
+    unsigned int mColumn, mRow, mWidth, mHeight;
+    size_t mRowPitch;
+};
+
 class Image
 {
 
 public:
 
+    /** Size in bytes of a cache line. The pixel buffer and all its rows are aligned to it. */
+    static constexpr size_t CACHE_LINE = 64;
+
+    /** Tiles which column and width are multiples of this amount of pixels never share a cache line, 16 pixels take
+     * three cache lines. */
+    static constexpr unsigned int TILE_ALIGNMENT = 16;
+
     /**
      * @param width Desired width for this image.
      * @param height Desired height for this image.
@@ -32,21 +256,75 @@ public:
     Image(const unsigned int width, const unsigned int height);
 
     /**
-     * Loads a ppm image file as an image.
+     * Loads a ppm image file (ASCII or binary) or a binary image saved with SaveBinary as an image.
      *
-     * @param filename Path to the file containing a ppm image.
+     * @param filename Path to the file containing the image.
      * @return New image containing the RGB values of the input file.
      */
     Image(const string & filename);
 
+    /**
+     * Loads a binary image saved with SaveBinary, only if it was saved from a source file with the given size and
+     * modification time. Throws otherwise.
+     *
+     * @param filename Path to the binary image file.
+     * @param sourceSize Size in bytes of the source file the image must have been saved from.
+     * @param sourceTime Modification time in nanoseconds of the source file the image must have been saved from.
+     * @return New image using the pixels of the binary file.
+     */
+    Image(const string &filename, const long long sourceSize, const long long sourceTime);
+
+    /**
+     * Copies all the pixels of image into a new buffer.
+     *
+     * @param image Image to copy.
+     */
+    Image(const Image &image);
+
+    /**
+     * @param image Image which buffer will be taken by the new one. It's left empty, 0x0 pixels.
+     */
+    Image(Image &&image);
+
+    /**
+     * Copies all the pixels of image into a new buffer.
+     *
+     * @param image Image to copy.
+     */
+    Image &operator=(const Image &image);
+
+    /**
+     * @param image Image which buffer will be taken by this one. It's left empty, 0x0 pixels.
+     */
+    Image &operator=(Image &&image);
+
     /**
      * Saves this image as a ppm file with the given filename.
      *
      * @param filename Name for the file that will be created. Use with caution
      * since this won't check for the file's existance and will destroy it without
      * consideration.
+     * @param comment Extra line written as a comment in the file's header, if not empty.
+     */
+    void Save(const string filename, SaveMode mode = DIM_TO_WHITE, const string &comment = "") const;
+
+    /**
+     * Saves the raw pixels of this image in a binary file that can be memory mapped when loaded back.
+     *
+     * @param filename Name for the file that will be created, overwriting any file with that name.
+     * @param sourceSize Size in bytes of the file this image was loaded from, stored to tell later if it's outdated.
+     * @param sourceTime Modification time in nanoseconds of the file this image was loaded from.
+     * @return true if the file was written successfully.
      */
-    void Save(const string filename, SaveMode mode = DIM_TO_WHITE) const;
+    bool SaveBinary(const string &filename, const long long sourceSize = -1, const long long sourceTime = -1) const;
+
+    /**
+     * Saves this image as a color pfm file, which keeps the float values of the pixels unchanged.
+     *
+     * @param filename Name for the file that will be created, overwriting any file with that name.
+     * @return true if the file was written successfully.
+     */
+    bool SavePFM(const string &filename) const;
 
     /**
      * @return This image's width.
@@ -62,14 +340,73 @@ public:
      * Overloads the subscript operator to read and write colors easily.
      *
      * @param i Index of the line that will be returned.
-     * @return i'th Line from the image matrix.
+     * @return View of the i'th line from the image.
+     */
+    ImageRow operator[](const unsigned int i);
+
+    /**
+     * @param i Index of the line that will be returned.
+     * @return Read only view of the i'th line from the image.
+     */
+    ConstImageRow operator[](const unsigned int i) const;
+
+    /**
+     * @param x Column of the upper-left pixel of the tile.
+     * @param y Row of the upper-left pixel of the tile.
+     * @param width Width of the tile. It's clipped to the image's width.
+     * @param height Height of the tile. It's clipped to the image's height.
+     * @return View of the given region of this image.
      */
-    vector<Color>& operator[](const unsigned int i);
+    ImageTile GetTile(const unsigned int x, const unsigned int y,
+                      const unsigned int width, const unsigned int height);
 
 private:
 
-    /** Pixel matrix. */
-    vector<vector<Color>> mImage;
+    /** Dimensions of the image in pixels. */
+    unsigned int mWidth, mHeight;
+
+    /** Pixels between the beginning of two consecutive rows (width plus padding). */
+    unsigned int mStride;
+
+    /** Floats between the beginning of two consecutive rows. */
+    size_t mRowPitch;
+
+    /** Owner of the aligned pixel buffer, either allocated or a mapped file. */
+    shared_ptr<float> mBuffer;
+
+    /** Pointer to the beginning of the pixel buffer, null if the image has been moved. */
+    float *mData;
+
+    /**
+     * Sets the dimensions of this image and allocates a zeroed buffer for its pixels.
+     */
+    void Allocate(const unsigned int width, const unsigned int height);
+
+    /**
+     * Sets the dimensions of this image and the row pitch derived from them.
+     */
+    void SetDimensions(const unsigned int width, const unsigned int height);
+
+    /**
+     * Decodes the pixels of a ppm file into a new buffer.
+     *
+     * @param file Contents of the ppm file.
+     * @param filename Path of the file, used in error messages.
+     */
+    void LoadPPM(const MappedFile &file, const string &filename);
+
+    /**
+     * Uses the pixels of a binary image file directly from its mapping.
+     *
+     * @param file Contents of the binary image file. The image keeps it mapped while in use.
+     * @param filename Path of the file, used in error messages.
+     */
+    void LoadBinary(const shared_ptr<MappedFile> file, const string &filename);
+
+    /**
+     * @return Total amount of floats in the pixel buffer, padding included.
+     */
+    size_t BufferSize() const;
 };
 
-#endif // RAY_TRACER_IMAGE_HPP
\ No newline at end of file
+#endif // RAY_TRACER_IMAGE_HPP
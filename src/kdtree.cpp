@@ -8,10 +8,14 @@
 
 #include "kdtree.hpp"
 #include <fstream>
+#include <limits>
+#include "renderStats.hpp"
+#include "trace.hpp"
+#include <type_traits>
 
 void KDTree::Clear() {
     mNodes.clear();
-    mBalanced.clear();
+    SetBalanced(nullptr, nullptr, 0);
 }
 
 void KDTree::Store(const Point &point, const Photon &photon) {
@@ -38,7 +42,7 @@ void KDTree::Find(const Point &p, const unsigned int nb_elements, vector<const N
     nodes.clear();
     max_distance = numeric_limits<float>::infinity();
 
-    if (mBalanced.empty())
+    if (mBalancedSize == 0)
         return;
 
     nodes.reserve(nb_elements);
@@ -53,16 +57,16 @@ const Node &KDTree::Find(const Point &p) const {
 }
 
 unsigned int KDTree::Size() const {
-    return static_cast<unsigned int>(mBalanced.size());
+    return mBalancedSize;
 }
 
 bool KDTree::IsEmpty() const {
-    return mBalanced.empty();
+    return mBalancedSize == 0;
 }
 
 const Node &KDTree::operator[](const unsigned int idx) const {
 #ifdef _SAFE_CHECK_
-    if ( idx > mBalanced.size()-1) throw("Out-of-range");
+    if ( idx > mBalancedSize-1) throw("Out-of-range");
 #endif
     return mBalanced[idx];
 }
@@ -70,10 +74,11 @@ const Node &KDTree::operator[](const unsigned int idx) const {
 //--------------------------------------------------------------------------------------------------
 //Private Find(radius)
 void KDTree::Find(const Point &p, const unsigned int index, const float radius, list<const Node *> &nodes) const {
+    RenderStats::Count(KNN_NODES_VISITED);
     //We check if our node enters
     if (mBalanced[index].mPoint.Distance(p) < radius) { nodes.push_back(&mBalanced[index]); }
     //Now we check that this is not a leaf node
-    if (index < ((mBalanced.size() - 1) / 2)) {
+    if (index < ((mBalancedSize - 1) / 2)) {
         float distaxis = p[mBalanced[index].mAxis] - mBalanced[index].mPoint[mBalanced[index].mAxis];
         if (distaxis < 0.0) // left node first
         {
@@ -136,6 +141,7 @@ void KDTree::UpdateHeapNodes(const Node &node, const float distance, const unsig
 
 void KDTree::Find(const Point &p, unsigned int index, const unsigned int nb_elements, float &dist_worst,
                   vector<const Node *> &nodes, vector<pair<unsigned int, float>> &dist) const {
+    RenderStats::Count(KNN_NODES_VISITED);
     float aux;
     //We check if our node is better
     if ((aux = mBalanced[index].mPoint.Distance(p)) < dist_worst) {
@@ -144,7 +150,7 @@ void KDTree::Find(const Point &p, unsigned int index, const unsigned int nb_elem
     }
 
     //Now we check that this is not a leaf node
-    if (index < ((mBalanced.size() - 1) / 2)) {
+    if (index < ((mBalancedSize - 1) / 2)) {
         float distaxis = p[mBalanced[index].mAxis] - mBalanced[index].mPoint[mBalanced[index].mAxis];
         //if( dist_worst < fabs(distaxis) )
         //	return;
@@ -176,7 +182,7 @@ unsigned int KDTree::Closest(const Point &p, const unsigned int index, const uns
         distbest = aux;
     }
     //Now we check that this is not a leaf node
-    if (index < ((mBalanced.size() - 1) / 2)) {
+    if (index < ((mBalancedSize - 1) / 2)) {
         float distaxis = p[mBalanced[index].mAxis] - mBalanced[index].mPoint[mBalanced[index].mAxis];
         if (distaxis < 0.0) // left node first
         {
@@ -287,8 +293,9 @@ void KDTree::BalanceSegment(vector<Node> &pbal, vector<Node> &porg, const int in
 
 void KDTree::Balance() {
     if (mNodes.size() == 0) return;
+    const TraceScope scope("KDTree::Balance", to_string(mNodes.size()) + " photons");
     vector<Node> aux(mNodes.size() + 1);
-    mBalanced.resize(mNodes.size() + 1);
+    shared_ptr<vector<Node>> balanced = make_shared<vector<Node>>(mNodes.size() + 1);
     int i;
     Point bbmax = mNodes.front().mPoint;
     Point bbmin = mNodes.front().mPoint;
@@ -307,14 +314,16 @@ void KDTree::Balance() {
     }
     mNodes.clear();
 
-    BalanceSegment(mBalanced, aux, 1, 1, static_cast<unsigned int>(mBalanced.size()) - 1, bbmin, bbmax);
+    BalanceSegment(*balanced, aux, 1, 1, static_cast<int>(balanced->size()) - 1, bbmin, bbmax);
+    SetBalanced(balanced, balanced->data(), static_cast<unsigned int>(balanced->size()));
 }
 
 void KDTree::DumpToFile(const string& filename)
 {
     ofstream out(filename);
-    for (const Node &p : mBalanced)
+    for (unsigned int i = 0; i < mBalancedSize; ++i)
     {
+        const Node &p = mBalanced[i];
         float x = p.GetPoint().GetX();
         float y = p.GetPoint().GetY();
         float z = p.GetPoint().GetZ();
@@ -322,3 +331,19 @@ void KDTree::DumpToFile(const string& filename)
     }
     out.close();
 }
+
+
+// Nodes are written and mapped as raw memory.
+static_assert(is_trivially_copyable<Node>::value, "Nodes must be trivially copyable");
+
+void KDTree::WriteBinary(ostream &out) const
+{
+    out.write(reinterpret_cast<const char *>(mBalanced), mBalancedSize * sizeof(Node));
+}
+
+void KDTree::SetBalanced(shared_ptr<const void> owner, const Node *nodes, const unsigned int size)
+{
+    mBalancedOwner = owner;
+    mBalanced = nodes;
+    mBalancedSize = size;
+}
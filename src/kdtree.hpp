@@ -20,6 +20,8 @@ de Zaragoza (Spain).
 #include "dimensions.hpp"
 #include <list>
 #include <math.h>
+#include <memory>
+#include <ostream>
 #include "photon.hpp"
 #include "point.hpp"
 #include <vector>
@@ -79,10 +81,34 @@ public:
      */
     void DumpToFile(const string& filename);
 
+    /**
+     * Writes the raw balanced nodes, which can be used later with SetBalanced.
+     *
+     * @param out Binary stream to write to.
+     */
+    void WriteBinary(ostream &out) const;
+
+    /**
+     * Uses already balanced nodes, for example from a file written with WriteBinary, without copying them.
+     *
+     * @param owner Keeps the nodes alive while this tree (or any of its copies) uses them.
+     * @param nodes Balanced nodes, the first one unused.
+     * @param size Number of nodes, including the first one.
+     */
+    void SetBalanced(shared_ptr<const void> owner, const Node *nodes, const unsigned int size);
+
 private:
 
     list<Node> mNodes;
-    vector<Node> mBalanced;
+
+    /** Owner of the balanced nodes, a vector or a mapped file. Balanced trees are never modified so copies share it. */
+    shared_ptr<const void> mBalancedOwner;
+
+    /** Nodes of the balanced tree, the children of the i'th node being 2i and 2i + 1. The first one is unused. */
+    const Node *mBalanced = nullptr;
+
+    /** Number of balanced nodes, including the first one. */
+    unsigned int mBalancedSize = 0;
 
     static void MedianSplit(vector<Node> &p, const int start, const int end, const int median, const Dimension &axis);
 
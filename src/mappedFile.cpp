@@ -0,0 +1,77 @@
+/** ---------------------------------------------------------------------------
+ ** mappedFile.cpp
+ ** Implementation for MappedFile class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <fcntl.h>
+#include <iostream>
+#include "mappedFile.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const string &filename)
+: mData(nullptr), mSize(0)
+{
+    const int descriptor = open(filename.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        cout << "Can't read the file " << filename << '\n';
+        throw 1;
+    }
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0)
+    {
+        close(descriptor);
+        cout << "Can't read the size of the file " << filename << '\n';
+        throw 1;
+    }
+    mSize = static_cast<size_t>(status.st_size);
+
+    if (mSize > 0)
+    {
+        void *data = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+        if (data == MAP_FAILED)
+        {
+            close(descriptor);
+            cout << "Can't map the file " << filename << " into memory\n";
+            throw 1;
+        }
+        mData = static_cast<char *>(data);
+    }
+    // The mapping stays valid after closing the descriptor.
+    close(descriptor);
+}
+
+MappedFile::~MappedFile()
+{
+    if (mData != nullptr) munmap(mData, mSize);
+}
+
+char *MappedFile::GetData() const
+{
+    return mData;
+}
+
+size_t MappedFile::GetSize() const
+{
+    return mSize;
+}
+
+long long MappedFile::GetModificationTime(const string &filename)
+{
+    struct stat status;
+    if (stat(filename.c_str(), &status) != 0) return -1;
+    return static_cast<long long>(status.st_mtim.tv_sec) * 1000000000LL + status.st_mtim.tv_nsec;
+}
+
+long long MappedFile::GetFileSize(const string &filename)
+{
+    struct stat status;
+    if (stat(filename.c_str(), &status) != 0) return -1;
+    return static_cast<long long>(status.st_size);
+}
@@ -0,0 +1,70 @@
+/** ---------------------------------------------------------------------------
+ ** mappedFile.hpp
+ ** Read only view of a whole file mapped into memory. The mapping is private so
+ ** writing to it never touches the file on disk, it just copies the written pages.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_MAPPEDFILE_HPP
+#define RAY_TRACER_MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+class MappedFile
+{
+
+public:
+
+    /**
+     * Maps the whole file into memory.
+     *
+     * @param filename Path to the file that will be mapped.
+     * @return New mapping of the file. Throws if the file can't be opened or mapped.
+     */
+    MappedFile(const string &filename);
+
+    /**
+     * Unmaps the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @return Pointer to the first byte of the file. It's aligned to the system's page size.
+     */
+    char *GetData() const;
+
+    /**
+     * @return Size in bytes of the file.
+     */
+    size_t GetSize() const;
+
+    /**
+     * @param filename Path to a file.
+     * @return Last modification time of the file in nanoseconds or -1 if it doesn't exist.
+     */
+    static long long GetModificationTime(const string &filename);
+
+    /**
+     * @param filename Path to a file.
+     * @return Size in bytes of the file or -1 if it doesn't exist.
+     */
+    static long long GetFileSize(const string &filename);
+
+private:
+
+    /** Beginning of the mapped region. */
+    char *mData;
+
+    /** Size in bytes of the file. */
+    size_t mSize;
+};
+
+#endif // RAY_TRACER_MAPPEDFILE_HPP
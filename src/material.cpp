@@ -6,16 +6,30 @@
  **         Santiago Gil Begué, NIA: 683482
  ** -------------------------------------------------------------------------*/
 
+#include "checkerBoard.hpp"
 #include "material.hpp"
 #include <math.h>
 #include  "mathUtils.hpp"
 #include  "shape.hpp"
+#include "simpleTexture.hpp"
+
+/** Greatest shininess evaluated with IntegerPower, greater ones need too many multiplications. */
+static constexpr float MAX_INTEGER_SHININESS = 4096;
 
 Material::Material(const Color diffuse, const Color specular,
                    const float shininess, const Color reflectance,
                    const Color transmittance)
-: mKd(diffuse), mKs(specular), mKr(reflectance),
-  mKt(transmittance), mShininess(shininess)
+: Material(CONSTANT_DIFFUSE, diffuse, specular, shininess, reflectance, transmittance)
+{}
+
+Material::Material(const DiffuseKind diffuseKind, const Color diffuse, const Color specular,
+                   const float shininess, const Color reflectance, const Color transmittance)
+: mDiffuseKind(diffuseKind), mKd(diffuse), mKs(specular), mKr(reflectance),
+  mKt(transmittance), mShininess(shininess), mHasSpecular(specular != BLACK),
+  mIntegerShininess(shininess == floor(shininess) && shininess > 0 && shininess <= MAX_INTEGER_SHININESS ?
+                    static_cast<unsigned int>(shininess) : 0),
+  mSpecularNormalisation((shininess + 2) / (2 * PI)),
+  mLobeExponent(1 / (shininess + 1)), mLobeWeight((shininess + 2) / (shininess + 1))
 {
     if (diffuse.GetR() + specular.GetR() + reflectance.GetR() + transmittance.GetR() > 0.95f or
         diffuse.GetG() + specular.GetG() + reflectance.GetG() + transmittance.GetG() > 0.95f or
@@ -26,16 +40,61 @@ Material::Material(const Color diffuse, const Color specular,
 Color Material::PhongBRDF(const Vect &seenFrom, const Vect &light,
                           const Vect &normal, const Point &point) const
 {
+    return PhongBRDF(seenFrom, light, normal, this->GetDiffuse(point));
+}
+
+Color Material::PhongBRDF(const Vect &seenFrom, const Vect &light,
+                          const Vect &normal, const Color &diffuse) const
+{
+    // Lambertian materials skip the specular lobe altogether.
+    if (!mHasSpecular) return diffuse / PI;
+
     Vect reflectedLight = Shape::Reflect(light * -1, normal);
     float cosine = seenFrom.DotProduct(reflectedLight);
     if (cosine < 0) cosine = 0;
 
-    return (this->GetDiffuse(point) / PI) + mKs * ((mShininess + 2) / (2 * PI) * pow(cosine, mShininess));
+    const float lobe = mIntegerShininess > 0 ? IntegerPower(cosine, mIntegerShininess) : pow(cosine, mShininess);
+    return (diffuse / PI) + mKs * (mSpecularNormalisation * lobe);
+}
+
+Color Material::GetPatternDiffuse(const Point &point) const
+{
+    switch (mDiffuseKind)
+    {
+    case CHECKER_BOARD_DIFFUSE:
+        return static_cast<const CheckerBoard *>(this)->GetDiffuse(point);
+    case TEXTURE_DIFFUSE:
+        return static_cast<const SimpleTexture *>(this)->GetDiffuse(point);
+    default:
+        return mKd;
+    }
 }
 
-Color Material::GetDiffuse(const Point &point) const
+Color Material::GetFilteredPatternDiffuse(const Point &point, const Vect &normal,
+                                          const Vect &direction, const float footprint) const
 {
-    return mKd;
+    switch (mDiffuseKind)
+    {
+    case CHECKER_BOARD_DIFFUSE:
+        return static_cast<const CheckerBoard *>(this)->GetFilteredDiffuse(point, normal, direction, footprint);
+    case TEXTURE_DIFFUSE:
+        return static_cast<const SimpleTexture *>(this)->GetFilteredDiffuse(point, normal, direction, footprint);
+    default:
+        return mKd;
+    }
+}
+
+float Material::GetFootprintWidth(const Vect &normal, const Vect &direction,
+                                  const float footprint, const Dimension axis)
+{
+    const Vect unitAxis(axis == X, axis == Y, axis == Z);
+    // Avoid infinite widths when the ray grazes the surface.
+    float cosine = direction.DotProduct(normal);
+    if (abs(cosine) < 1e-3f) cosine = cosine < 0 ? -1e-3f : 1e-3f;
+    /* Project the disk covered by the ray along its direction onto the surface. The extent of the resulting ellipse in
+     * the axis is the extent of this vector in the disk's plane. */
+    const Vect projected = unitAxis - normal * (direction.DotProduct(unitAxis) / cosine);
+    return footprint * (projected - direction * projected.DotProduct(direction)).Abs();
 }
 
 Color Material::GetSpecular() const
@@ -56,4 +115,14 @@ Color Material::GetReflectance() const
 Color Material::GetTransmittance() const
 {
     return mKt;
+}
+
+float Material::GetLobeExponent() const
+{
+    return mLobeExponent;
+}
+
+float Material::GetLobeWeight() const
+{
+    return mLobeWeight;
 }
\ No newline at end of file
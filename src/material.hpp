@@ -18,6 +18,20 @@
 
 using namespace std;
 
+/**
+ * Every way a material can compute its diffuse value. The set is closed: GetDiffuse switches over it instead of
+ * calling a virtual method, so the common constant case is a plain load.
+ */
+enum DiffuseKind
+{
+    /** The same kD everywhere. */
+    CONSTANT_DIFFUSE,
+    /** Generated pattern of a CheckerBoard. */
+    CHECKER_BOARD_DIFFUSE,
+    /** Image of a SimpleTexture. */
+    TEXTURE_DIFFUSE
+};
+
 class Material
 {
 
@@ -49,11 +63,45 @@ public:
     Color PhongBRDF(const Vect &seenFrom, const Vect &light,
                     const Vect &normal, const Point &point) const;
 
+    /**
+     * Same as the previous one, but with the diffuse value of the point already calculated. Useful when the BRDF is
+     * evaluated many times at the same point.
+     *
+     * @param seenFrom Direction from which the color is calculated.
+     * @param light Direction of the incoming light.
+     * @param normal Normal to the surface.
+     * @param diffuse kD value at the point in which the light incedes.
+     * @return Color resulting of Phong's corrected BRDF for the given values.
+     */
+    Color PhongBRDF(const Vect &seenFrom, const Vect &light,
+                    const Vect &normal, const Color &diffuse) const;
+
     /**
      * @param point Point for which the diffuse value is returned.
      * @return kD value for this material at the given point.
      */
-    virtual Color GetDiffuse(const Point &point) const;
+    Color GetDiffuse(const Point &point) const
+    {
+        if (mDiffuseKind == CONSTANT_DIFFUSE) return mKd;
+        return GetPatternDiffuse(point);
+    }
+
+    /**
+     * Diffuse value averaged over the area of the surface seen by a pixel. Textured materials filter it to avoid
+     * aliasing, for constant materials it's the same as GetDiffuse.
+     *
+     * @param point Point for which the diffuse value is returned.
+     * @param normal Normal to the surface in point.
+     * @param direction Direction of the ray that reached point.
+     * @param footprint Width of the ray when it reaches point, measured perpendicularly to its direction.
+     * @return kD value for this material around the given point.
+     */
+    Color GetFilteredDiffuse(const Point &point, const Vect &normal,
+                             const Vect &direction, const float footprint) const
+    {
+        if (mDiffuseKind == CONSTANT_DIFFUSE) return mKd;
+        return GetFilteredPatternDiffuse(point, normal, direction, footprint);
+    }
 
     /**
      * @return ks value for this material.
@@ -75,13 +123,83 @@ public:
      */
     Color GetTransmittance() const;
 
+    /**
+     * @return 1 / (shininess + 1), the exponent used to sample the specular lobe of this material.
+     */
+    float GetLobeExponent() const;
+
+    /**
+     * @return (shininess + 2) / (shininess + 1), the weight of photons sampled from the specular lobe of this
+     * material, the PDF of the lobe without its cosine.
+     */
+    float GetLobeWeight() const;
+
+protected:
+
+    /**
+     * Creates a material whose diffuse value is computed by the subclass matching diffuseKind.
+     *
+     * @param diffuseKind Kind of the subclass creating the material.
+     * @param diffuse kD for the new Material, used to check the material conserves energy.
+     * @param specular kS for the new Material.
+     * @param shininess shininess for the new Material.
+     * @param reflectance kR for the new Material.
+     * @param transmittance kT for the new Material.
+     * @return New material with the given values.
+     */
+    Material(const DiffuseKind diffuseKind, const Color diffuse, const Color specular,
+             const float shininess, const Color reflectance, const Color transmittance);
+
+    /**
+     * @param normal Normal to the surface.
+     * @param direction Direction of the ray that reached the surface.
+     * @param footprint Width of the ray, measured perpendicularly to its direction.
+     * @param axis World axis in which the width is measured.
+     * @return Width along the axis of the region of the surface covered by the ray.
+     */
+    static float GetFootprintWidth(const Vect &normal, const Vect &direction,
+                                   const float footprint, const Dimension axis);
+
 private:
 
+    /**
+     * @param point Point for which the diffuse value is returned.
+     * @return Diffuse value of the subclass given by mDiffuseKind at the given point.
+     */
+    Color GetPatternDiffuse(const Point &point) const;
+
+    /**
+     * @param point Point for which the diffuse value is returned.
+     * @param normal Normal to the surface in point.
+     * @param direction Direction of the ray that reached point.
+     * @param footprint Width of the ray when it reaches point, measured perpendicularly to its direction.
+     * @return Filtered diffuse value of the subclass given by mDiffuseKind around the given point.
+     */
+    Color GetFilteredPatternDiffuse(const Point &point, const Vect &normal,
+                                    const Vect &direction, const float footprint) const;
+
+    /** Which subclass, if any, computes the diffuse value. */
+    DiffuseKind mDiffuseKind;
+
     /** Color and physical properties for this material. */
     Color mKd, mKs, mKr, mKt;
 
     /** How shiny this material is. */
     float mShininess;
+
+    /** Values derived from the ones above, computed once when the material is created. */
+
+    /** The material has a specular lobe, otherwise its BRDF is just the Lambertian diffuse term. */
+    bool mHasSpecular;
+
+    /** Shininess as an integer when it has no decimals, 0 if it doesn't fit IntegerPower. */
+    unsigned int mIntegerShininess;
+
+    /** Normalisation of the specular lobe, (shininess + 2) / (2 * PI). */
+    float mSpecularNormalisation;
+
+    /** Cached results of GetLobeExponent and GetLobeWeight. */
+    float mLobeExponent, mLobeWeight;
 };
 
 /** Common material definitions to make materials easier to use down the line. */
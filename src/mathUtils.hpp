@@ -9,6 +9,8 @@
 #ifndef RAY_TRACER_MATH_CONSTANTS_H
 #define RAY_TRACER_MATH_CONSTANTS_H
 
+#include <cmath>
+#include <cstdint>
 #include <random>
 #include <tuple>
 
@@ -27,16 +29,112 @@ static constexpr refractiveIndex QUARTZ_RI  = 1.544f;
 static constexpr refractiveIndex GLASS_RI   = 1.52f;
 static constexpr refractiveIndex DIAMOND_RI = 2.42f;
 
+/**
+ * Power by squaring, much faster than pow for the small integer exponents of most shininess values.
+ *
+ * @param base Value to raise.
+ * @param exponent Power to raise base to.
+ * @return base raised to exponent.
+ */
+inline static float IntegerPower(float base, unsigned int exponent)
+{
+    float result = 1.0f;
+    while (exponent > 0)
+    {
+        if (exponent & 1u) result *= base;
+        base *= base;
+        exponent >>= 1u;
+    }
+    return result;
+}
+
+/**
+ * @return Seed given to SetRandomSeed, or a random one if it hasn't been called. It's shared by every thread. It's not
+ * static so every translation unit shares the same one.
+ */
+inline uint32_t &GetRandomSeed()
+{
+    static uint32_t seed = random_device()();
+    return seed;
+}
+
+/**
+ * @return Random generator of the calling thread, seeded by a random device. Every thread has its own one, so they
+ * never race for it. It's not static so every translation unit shares the same one.
+ */
+inline mt19937 &GetRandomGenerator()
+{
+    static thread_local mt19937 mt(random_device{}());
+    return mt;
+}
+
+/**
+ * Seeds the random generator of the calling thread and keeps the seed for SeedRandomStream, making the photons
+ * emitted and the values drawn by every stream the same in every run.
+ *
+ * @param seed New seed of the random generator.
+ */
+inline void SetRandomSeed(const uint32_t seed)
+{
+    GetRandomSeed() = seed;
+    GetRandomGenerator().seed(seed);
+}
+
 /**
  * @return Random value between 0 and 1.
  */
 inline static float GetRandomValue()
 {
-    // Random generator.
-    static random_device randDev;
-    static mt19937 mt(randDev());
     static uniform_real_distribution<float> distribution(0, 1);
-    return distribution(mt);
+    return distribution(GetRandomGenerator());
+}
+
+/**
+ * Integer hash with good avalanche (every input bit flips about half of the output bits).
+ *
+ * @param value Value to hash.
+ * @return Hashed value.
+ */
+inline static uint32_t HashInteger(uint32_t value)
+{
+    value ^= value >> 16;
+    value *= 0x7feb352dU;
+    value ^= value >> 15;
+    value *= 0x846ca68bU;
+    value ^= value >> 16;
+    return value;
+}
+
+/**
+ * Seeds the random generator of the calling thread from the seed given to SetRandomSeed and a stream, so the values
+ * drawn after it depend only on them and not on the thread drawing them.
+ *
+ * @param stream Value identifying the work that will draw the values, like a pixel.
+ */
+inline void SeedRandomStream(const uint32_t stream)
+{
+    GetRandomGenerator().seed(HashInteger(GetRandomSeed() ^ HashInteger(stream)));
+}
+
+/**
+ * Position of a sample inside a pixel. Samples follow the R2 low discrepancy sequence, which stays well stratified for
+ * any number of samples, randomly shifted for every pixel so neighbour pixels don't share the same pattern. Being
+ * deterministic per pixel and sample it can be used from any thread.
+ *
+ * @param x Column of the pixel.
+ * @param y Row of the pixel.
+ * @param sample Index of the sample in the pixel.
+ * @return Tuple with the horizontal and vertical offsets of the sample from the pixel's center, in [-0.5, 0.5).
+ */
+inline static tuple<float, float> PixelSampleOffset(const unsigned int x, const unsigned int y,
+                                                    const unsigned int sample)
+{
+    // Inverses of the plastic number and its square, generators of the R2 sequence.
+    static constexpr double R2_X = 0.7548776662466927, R2_Y = 0.5698402909980532;
+    const uint32_t hash = HashInteger(x ^ HashInteger(y));
+    const double shiftX = (hash & 0xffffU) / 65536.0, shiftY = (hash >> 16) / 65536.0;
+    const double u = shiftX + sample * R2_X, v = shiftY + sample * R2_Y;
+    return make_tuple(static_cast<float>(u - floor(u)) - 0.5f, static_cast<float>(v - floor(v)) - 0.5f);
 }
 
 /**
@@ -63,12 +161,13 @@ inline static tuple<float, float> UniformSphereSampling()
 }
 
 /**
+ * @param lobeExponent 1 / (alpha + 1), alpha being the shininess of the lobe.
  * @return Tuple with a randomly selected inclination and azimuth. Meant to sample a Phong specular lobe.
  */
-inline static tuple<float, float> PhongSpecularLobeSampling(const float alpha)
+inline static tuple<float, float> PhongSpecularLobeSampling(const float lobeExponent)
 {
     // Inclination and azimuth angles.
-    float inclination = acos(pow(GetRandomValue(), 1 / (alpha + 1)));
+    float inclination = acos(pow(GetRandomValue(), lobeExponent));
     float azimuth = 2 * PI * GetRandomValue();
     return make_tuple(inclination, azimuth);
 }
@@ -36,6 +36,68 @@ Vect Matrix::operator*(const Vect &v) const
     return Vect(x, y, z);
 }
 
+#ifdef RAY_TRACER_SIMD
+
+void Matrix::TransformPoints(std::vector<Point> &points) const
+{
+    // Columns of the matrix, every point is their sum weighted by its coordinates.
+    const __m128 x = _mm_setr_ps(mA, mE, mI, mM), y = _mm_setr_ps(mB, mF, mJ, mN);
+    const __m128 z = _mm_setr_ps(mC, mG, mK, mO), h = _mm_setr_ps(mD, mH, mL, mP);
+    for (Point &p : points)
+    {
+        const __m128 v = Load(p.GetValues());
+        const __m128 product = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))),
+                                                     _mm_mul_ps(y, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)))),
+                                          _mm_add_ps(_mm_mul_ps(z, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))), h));
+        p = Point(Store(_mm_div_ps(product, _mm_shuffle_ps(product, product, _MM_SHUFFLE(3, 3, 3, 3)))));
+    }
+}
+
+void Matrix::TransformVects(std::vector<Vect> &vects) const
+{
+    // Vectors aren't translated, so the last column isn't needed.
+    const __m128 x = _mm_setr_ps(mA, mE, mI, 0.0f), y = _mm_setr_ps(mB, mF, mJ, 0.0f);
+    const __m128 z = _mm_setr_ps(mC, mG, mK, 0.0f);
+    for (Vect &v : vects)
+    {
+        const __m128 values = Load(v.GetValues());
+        v = Vect(Store(_mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(x, _mm_shuffle_ps(values, values, _MM_SHUFFLE(0, 0, 0, 0))),
+                           _mm_mul_ps(y, _mm_shuffle_ps(values, values, _MM_SHUFFLE(1, 1, 1, 1)))),
+                _mm_mul_ps(z, _mm_shuffle_ps(values, values, _MM_SHUFFLE(2, 2, 2, 2))))));
+    }
+}
+
+#else
+
+void Matrix::TransformPoints(std::vector<Point> &points) const
+{
+    // Copies of the values, so the compiler knows writing the points doesn't change them.
+    const float a = mA, b = mB, c = mC, d = mD, e = mE, f = mF, g = mG, h = mH;
+    const float i = mI, j = mJ, k = mK, l = mL, m = mM, n = mN, o = mO, p = mP;
+    for (Point &point : points)
+    {
+        const float x = point.GetX(), y = point.GetY(), z = point.GetZ();
+        const float w = m * x + n * y + o * z + p * Point::H;
+        point = Point((a * x + b * y + c * z + d * Point::H) / w,
+                      (e * x + f * y + g * z + h * Point::H) / w,
+                      (i * x + j * y + k * z + l * Point::H) / w);
+    }
+}
+
+void Matrix::TransformVects(std::vector<Vect> &vects) const
+{
+    // Copies of the values, so the compiler knows writing the vectors doesn't change them.
+    const float a = mA, b = mB, c = mC, e = mE, f = mF, g = mG, i = mI, j = mJ, k = mK;
+    for (Vect &v : vects)
+    {
+        const float x = v.GetX(), y = v.GetY(), z = v.GetZ();
+        v = Vect(a * x + b * y + c * z, e * x + f * y + g * z, i * x + j * y + k * z);
+    }
+}
+
+#endif // RAY_TRACER_SIMD
+
 Matrix Matrix::operator*(const Matrix &mat) const
 {
     float a = mA * mat.mA + mB * mat.mE + mC * mat.mI + mD * mat.mM;
@@ -77,4 +139,12 @@ std::ostream& operator<<(std::ostream &out, const Matrix &m)
         << "       " << m.mI << ", " << m.mJ << ", " << m.mK << ", " << m.mL << '\n'
         << "       " << m.mM << ", " << m.mN << ", " << m.mO << ", " << m.mP << ")";
     return out;
+}
+
+std::array<float, 16> Matrix::GetValues() const
+{
+    return {{mA, mB, mC, mD,
+             mE, mF, mG, mH,
+             mI, mJ, mK, mL,
+             mM, mN, mO, mP}};
 }
\ No newline at end of file
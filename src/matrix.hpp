@@ -10,7 +10,9 @@
 #ifndef RAY_TRACER_MATRIX_HPP
 #define RAY_TRACER_MATRIX_HPP
 
+#include <array>
 #include "point.hpp"
+#include <vector>
 
 class Matrix
 {
@@ -53,6 +55,20 @@ public:
      */
     Vect operator*(const Vect &v) const;
 
+    /**
+     * Multiplies all the given points by this matrix, which is faster than multiplying them one by one.
+     *
+     * @param points Points to replace by their product with this matrix.
+     */
+    void TransformPoints(std::vector<Point> &points) const;
+
+    /**
+     * Multiplies all the given vectors by this matrix, which is faster than multiplying them one by one.
+     *
+     * @param vects Vectors to replace by their product with this matrix.
+     */
+    void TransformVects(std::vector<Vect> &vects) const;
+
     /**
      * @param m matrix to multiply by this matrix.
      * @return New matrix product and this and the given matrices.
@@ -81,6 +97,11 @@ public:
      */
     friend std::ostream& operator<<(std::ostream &out, const Matrix &mat);
 
+    /**
+     * @return The 16 values of this matrix, row by row.
+     */
+    std::array<float, 16> GetValues() const;
+
 protected:
 
     /** This matrix's values. */
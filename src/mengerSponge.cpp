@@ -6,96 +6,140 @@
  **         Santiago Gil Begué, NIA: 683482
  ** -------------------------------------------------------------------------*/
 
+#include "intersections.hpp"
 #include "mengerSponge.hpp"
 #include <cfloat>
 
+constexpr int MengerSponge::MAX_RECURSION;
+
 MengerSponge::MengerSponge(float distanceToEdgeFromOrigin, int recursion, shared_ptr<Material> material, Vect originShift)
-        :mBox(Rectangle(
-                Vect(0, 1, 0),
-                Point(-distanceToEdgeFromOrigin, -distanceToEdgeFromOrigin, -distanceToEdgeFromOrigin) + originShift,
-                Point(distanceToEdgeFromOrigin, -distanceToEdgeFromOrigin, distanceToEdgeFromOrigin) + originShift),
-              2 * distanceToEdgeFromOrigin)
+: mMinCorner(Point(-distanceToEdgeFromOrigin, -distanceToEdgeFromOrigin, -distanceToEdgeFromOrigin) + originShift),
+  mCells(1)
+{
+    recursion = min(max(recursion, 0), MAX_RECURSION);
+    for (int i = 0; i < recursion; ++i) mCells *= 3;
+    mCellSize = 2 * distanceToEdgeFromOrigin / mCells;
+    SetMaterial(material);
+}
+
+float MengerSponge::Intersect(const LightRay& lightRay) const
 {
-    // With recursion 5 this takes up to 6-7GB of memory. With 6 it could crash most computers.
-    if (recursion > 5) recursion = 5;
-    if (recursion == 0)
+    Dimension faceAxis;
+    return Traverse(lightRay, faceAxis);
+}
+
+void MengerSponge::Intersect(const LightRay &lightRay, HitRecord &hit) const
+{
+    Dimension faceAxis;
+    const float t = Traverse(lightRay, faceAxis);
+    if (t < hit.t)
     {
-        mIsACube = true;
-        mBox.SetMaterial(material);
-        // Set all sub-sponge pointers to null.
-        for (unsigned int i = 0; i < mSubSponges.size(); ++i)
-        {
-            mSubSponges[i] = nullptr;
-        }
+        hit.t = t;
+        hit.shape = this;
+        // The face hit is the one looking at the ray.
+        hit.u = faceAxis;
+        hit.v = lightRay.GetDirection().GetValues()[faceAxis] > 0 ? -1.0f : 1.0f;
     }
-    else
-    {
-        recursion--;
-        // Initialize the sub-sponges
-        float newCubeShift = distanceToEdgeFromOrigin * 2.0f / 3.0f;
-        unsigned char cubeIdCounter = 0;
-        Vect newCubeOriginShift;
-        for (int x = -1; x < 2; ++x)
-        {
-            for (int y = -1; y < 2; ++y)
-            {
-                for (int z = -1; z < 2; ++z)
-                {
-                    if (((x == 0) & (y == 0)) || ((x == 0) & (z == 0)) || ((y == 0) & (z == 0))) continue;
-                    float shiftX = newCubeShift * x, shiftY = newCubeShift * -y, shiftZ = newCubeShift * z;
+}
 
-                    newCubeOriginShift = Vect(originShift.GetX() + shiftX, originShift.GetY() + shiftY, originShift.GetZ() + shiftZ);
-                    mSubSponges[cubeIdCounter++] = make_shared<MengerSponge>(newCubeShift/2, recursion, material, newCubeOriginShift);
-                }
-            }
-        }
+Vect MengerSponge::GetHitNormal(const HitRecord &hit) const
+{
+    const Dimension axis = static_cast<Dimension>(static_cast<int>(hit.u));
+    return Vect((axis == X) * hit.v, (axis == Y) * hit.v, (axis == Z) * hit.v);
+}
+
+int MengerSponge::HoleSize(const int cell[3]) const
+{
+    // A cell is in a hole of a level if at least two of its coordinates are in the middle third of that level.
+    for (int size = mCells / 3; size >= 1; size /= 3)
+    {
+        const int middleThirds = ((cell[X] / size) % 3 == 1) + ((cell[Y] / size) % 3 == 1) +
+                                 ((cell[Z] / size) % 3 == 1);
+        if (middleThirds >= 2) return size;
     }
+    return 0;
 }
 
-float MengerSponge::Intersect(const LightRay& lightRay) const
+float MengerSponge::Traverse(const LightRay &lightRay, Dimension &faceAxis) const
 {
-    if (mIsACube) return mBox.Intersect(lightRay);
+    // The ray expressed in the grid of the deepest level, where cells measure 1 and the sponge begins at 0.
+    float origin[3], direction[3];
+    for (int d = X; d <= Z; ++d)
+    {
+        origin[d] = (lightRay.GetSource()[static_cast<Dimension>(d)] - mMinCorner[static_cast<Dimension>(d)]) /
+                    mCellSize;
+        direction[d] = lightRay.GetDirection().GetValues()[d] / mCellSize;
+    }
 
-    if (mBox.Intersect(lightRay) != FLT_MAX)
+    // Portion of the ray inside the bounding cube.
+    float tEnter = threshold, tExit = FLT_MAX;
+    Dimension enterAxis = NO_DIM;
+    for (int d = X; d <= Z; ++d)
     {
-        for (const shared_ptr<MengerSponge> &subSponge : mSubSponges)
+        if (direction[d] == 0)
+        {
+            if (origin[d] < 0 || origin[d] > mCells) return FLT_MAX;
+            continue;
+        }
+        float tNear = -origin[d] / direction[d], tFar = (mCells - origin[d]) / direction[d];
+        if (tNear > tFar) swap(tNear, tFar);
+        if (tNear > tEnter)
         {
-            float tmp = subSponge->Intersect(lightRay);
-            if (tmp != FLT_MAX) return tmp;
+            tEnter = tNear;
+            enterAxis = static_cast<Dimension>(d);
         }
+        tExit = min(tExit, tFar);
     }
+    if (tEnter >= tExit) return FLT_MAX;
 
-    return FLT_MAX;
-}
+    // Cell where the ray enters the cube, or where it begins if it's inside.
+    int cell[3];
+    for (int d = X; d <= Z; ++d)
+    {
+        cell[d] = min(max(static_cast<int>(floor(origin[d] + direction[d] * tEnter)), 0), mCells - 1);
+    }
+    if (enterAxis != NO_DIM) cell[enterAxis] = direction[enterAxis] > 0 ? 0 : mCells - 1;
 
-void MengerSponge::Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                             shared_ptr<Shape> thisShape) const
-{
-    if (mIsACube) mBox.Intersect(lightRay, minT, nearestShape, thisShape);
-    else
+    float t = tEnter;
+    while (true)
     {
-        if (mBox.Intersect(lightRay) != FLT_MAX)
+        const int hole = HoleSize(cell);
+        if (hole == 0)
         {
-            array<tuple<float, unsigned int>, 20> boundIntersections;
+            if (enterAxis == NO_DIM) return FLT_MAX;
+            faceAxis = enterAxis;
+            return t;
+        }
 
-            for (unsigned int i = 0; i < mSubSponges.size(); ++i)
-            {
-                boundIntersections[i] = make_tuple(mSubSponges[i]->mBox.Intersect(lightRay), i);
-            }
-            sort(boundIntersections.begin(), boundIntersections.end(),
-                    [](tuple<float, unsigned int> const& t1, tuple<float, unsigned int> const& t2)
-                    {
-                        return get<0>(t1)<get<0>(t2);
-                    });
-            float tmpT;
-            // A lightRay can never intersect a menger sponge in more than four sub-cubes
-            for (unsigned int i = 0; i < 4; ++i)
+        // Leave the whole hole through its nearest side.
+        int holeStart[3];
+        float tNext = FLT_MAX;
+        Dimension nextAxis = NO_DIM;
+        for (int d = X; d <= Z; ++d)
+        {
+            holeStart[d] = cell[d] / hole * hole;
+            if (direction[d] == 0) continue;
+            const float side = direction[d] > 0 ? holeStart[d] + hole : holeStart[d];
+            const float tSide = (side - origin[d]) / direction[d];
+            if (tSide < tNext)
             {
-                tmpT = minT;
-                int index = get<1>(boundIntersections[i]);
-                mSubSponges[index]->Intersect(lightRay, minT, nearestShape, mSubSponges[index]);
-                if (minT != tmpT) break; // No intersection can be at a smaller t than this one
+                tNext = tSide;
+                nextAxis = static_cast<Dimension>(d);
             }
         }
+
+        /* The ray stays inside the hole along the other axes, which keeps rounding errors from sending it back to a
+         * cell already visited. */
+        for (int d = X; d <= Z; ++d)
+        {
+            if (d == nextAxis) continue;
+            cell[d] = min(max(static_cast<int>(floor(origin[d] + direction[d] * tNext)), holeStart[d]),
+                          holeStart[d] + hole - 1);
+        }
+        cell[nextAxis] = direction[nextAxis] > 0 ? holeStart[nextAxis] + hole : holeStart[nextAxis] - 1;
+        if (cell[nextAxis] < 0 || cell[nextAxis] >= mCells) return FLT_MAX;
+
+        t = max(t, tNext);
+        enterAxis = nextAxis;
     }
-}
\ No newline at end of file
+}
@@ -1,6 +1,8 @@
 /** ---------------------------------------------------------------------------
  ** mergerSponge.hpp
- ** A recursively generated shape made out of cubes.
+ ** A recursively generated shape made out of cubes. The cubes aren't stored:
+ ** rays walk the grid of the deepest level, skipping at once every hole of
+ ** the fractal they go through.
  **
  ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
  **         Santiago Gil Begué, NIA: 683482
@@ -9,19 +11,20 @@
 #ifndef RAY_TRACER_MERGERSPONGE_HPP
 #define RAY_TRACER_MERGERSPONGE_HPP
 
-#include  "box.hpp"
 #include  "shape.hpp"
-#include <vector>
 
 class MengerSponge : public Shape
 {
 
 public:
 
+    /** Greatest recursion supported, the cells of deeper levels would be smaller than the precision of a float. */
+    static constexpr int MAX_RECURSION = 12;
+
     /**
      * Constructs a new MergerSponge with the given recursion (amount of detail).
      * @param distanceToEdgeFromOrigin Distance from the origin to any of the edges of the biggest cube.
-     * @param recursion Steps left. If 0 this MergerSponge will be just a Box.
+     * @param recursion Steps left. If 0 this MergerSponge will be just a Box. Clamped to MAX_RECURSION.
      */
     MengerSponge(float distanceToEdgeFromOrigin, int recursion,
                  shared_ptr<Material> material = LAMBERTIAN, Vect originShift = Vect(0,0,0));
@@ -35,14 +38,10 @@ public:
 
     /**
      * @param lightRay Contains the point from which an intersection with this shape will measured.
-     * @param minT Minimum distance from the lightRay's origin to any shape so far. If this shape is closer to the origin
-     *  than this value then it will be updated to that distance.
-     * @param nearestShape Shape that is reportedly the closest to the lightRay's origin so far. If any of the rectangles
-     * in this box is closer then it will be updated to that rectangle's pointer.
-     * @param thisShape Unused.
+     * @param hit Nearest intersection found so far. Updated to the intersection with the nearest face of this sponge's
+     *  cubes if it's closer to the lightRay's origin than hit.t.
      */
-    void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                   shared_ptr<Shape> thisShape) const;
+    void Intersect(const LightRay &lightRay, HitRecord &hit) const;
 
     /**
      * This method is not usable for this shape. Calling it will result in an exception. This is because a MengerSponge
@@ -51,18 +50,41 @@ public:
     bool IsInside(const Point &point) const { throw 1; }
 
     /**
-     * This method is not usable for this shape since it makes no sense for it to have a normal.
+     * This method is not usable for this shape since the normal depends on the face hit, use GetHitNormal instead.
      */
     Vect GetNormal(const Point &point) const { throw 1; }
 
+    /**
+     * @param hit Intersection with this shape.
+     * @return Outwards normal of the face of the cube hit, recorded in hit.u (axis) and hit.v (sign).
+     */
+    Vect GetHitNormal(const HitRecord &hit) const;
+
 private:
 
-    /** True if this sponge is just a cube*/
-    bool mIsACube = false;
+    /**
+     * @param lightRay Ray to intersect with this sponge.
+     * @param faceAxis Updated to the axis perpendicular to the face hit, if any.
+     * @return Distance from the lightRay's origin to the nearest face of this sponge's cubes, FLT_MAX if there is none.
+     *  Rays leaving from inside a cube don't hit it.
+     */
+    float Traverse(const LightRay &lightRay, Dimension &faceAxis) const;
+
+    /**
+     * @param cell Coordinates of a cell of the deepest level.
+     * @return Side, in cells of the deepest level, of the biggest hole of the fractal containing the cell, 0 if the
+     *  cell is a cube.
+     */
+    int HoleSize(const int cell[3]) const;
+
+    /** Corner of the sponge with the smallest coordinates. */
+    Point mMinCorner;
+
+    /** Cells of the deepest level along every axis, 3 ^ recursion. */
+    int mCells;
 
-    /** Container for the sub sponges in this sponge*/
-    array<shared_ptr<MengerSponge>, 20> mSubSponges;
-    Box mBox;
+    /** Side of a cell of the deepest level. */
+    float mCellSize;
 };
 
-#endif // RAY_TRACER_MERGERSPONGE_HPP
\ No newline at end of file
+#endif // RAY_TRACER_MERGERSPONGE_HPP
@@ -6,14 +6,18 @@
 **         Santiago Gil Begué, NIA: 683482
 ** -------------------------------------------------------------------------*/
 
-#include "box.hpp"
+#include <algorithm>
 #include <cfloat>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include "hash.hpp"
 #include <iostream>
+#include "mappedFile.hpp"
 #include "mesh.hpp"
-#include <sstream>
-
-typedef std::tuple<unsigned int, unsigned int, unsigned int> Face;
+#include "objParser.hpp"
+#include "renderStats.hpp"
+#include "trace.hpp"
 
 void ClampPoints(vector<Point> &points, Point &maxValues, Point &minValues, float desiredMax, const Vect desiredCenter)
 {
@@ -71,353 +75,538 @@ void ClampPoints(vector<Point> &points, Point &maxValues, Point &minValues, floa
 
 }
 
-Mesh Mesh::LoadObjFile(const string &filename, float maxDistFromOrigin, const Vect &shift, TransformationMatrix tm)
+/** Triangles of a Mesh stored contiguously, instead of allocating each one on its own. */
+struct MeshTriangles
+{
+    /** Triangles without vertex normals. */
+    vector<Triangle> flat;
+    /** Triangles with interpolated vertex normals. */
+    vector<MeshTriangle> smooth;
+    /** Triangles given to the Mesh constructor, kept alive while the Mesh uses them. */
+    vector<shared_ptr<Triangle>> shared;
+};
+
+/** Header of the binary mesh files. It's followed by the nodes, the vertices, the normals and the triangles. */
+struct BinaryMeshHeader
+{
+    char magic[4];
+    uint32_t version;
+    /** Hash of the obj file's size and modification time and the parameters used to load it. */
+    uint64_t key;
+    uint32_t vertexCount;
+    uint32_t normalCount;
+    uint32_t triangleCount;
+    uint32_t nodeCount;
+    /** Keeps the nodes that follow the header aligned to a cache line. */
+    char padding[32];
+};
+
+static_assert(sizeof(BinaryMeshHeader) == 64, "The binary mesh header must fill a cache line");
+static_assert(sizeof(MeshNode) == 32, "Mesh nodes must be 32 bytes long");
+
+/** First bytes of every binary mesh file. */
+static const char BINARY_MAGIC[4] = {'R', 'M', 'S', 'H'};
+
+/** Version of the binary mesh format, increase it when the format or the way meshes are built changes. */
+static const uint32_t BINARY_VERSION = 1;
+
+/**
+ * Recursively builds the hierarchy of nodes for the triangles in order[begin, end).
+ *
+ * @param boxes Bounding box of every triangle, as its minimum and maximum points.
+ * @param centers Middle point of every triangle.
+ * @param order Indices of the triangles. They are reordered so each leaf has its triangles contiguous.
+ * @param begin First triangle of the node in order.
+ * @param end One past the last triangle of the node in order.
+ * @param leafSize Maximum number of triangles in a leaf.
+ * @param nodes Vector in which the nodes are added, parents before their children.
+ */
+static void BuildNode(const vector<float> &boxes, const vector<float> &centers, vector<unsigned int> &order,
+                      const unsigned int begin, const unsigned int end, const unsigned int leafSize,
+                      vector<MeshNode> &nodes)
 {
-    vector<shared_ptr<Triangle>> triangles;
-
-    vector<Point> positions;
-    vector<Vect> normals;
-    vector<Face> faces;
-    ifstream objFile(filename);
-    string lineBuf;
-    string lineType;
-    istringstream lineStream;
-
-    float x, y, z;
-    unsigned int a, b, c;
-    float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
-    float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
-
-    if (!objFile.good())
+    MeshNode node = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}, begin, end - begin};
+    for (unsigned int i = begin; i < end; ++i)
     {
-        cout << "The file doesn't exist or can't be read for some reason.\n";
-        throw 1;
-    }
-
-    while (objFile.good()) {
-        getline(objFile, lineBuf);
-        if (lineBuf.size() == 0) continue;
-        lineStream = istringstream(lineBuf);
-        lineStream >> lineType;
-        if (lineType == "v")    // New vertex
+        const float *box = &boxes[6 * order[i]];
+        for (int k = 0; k < 3; ++k)
         {
-            lineStream >> x >> y >> z;
-            if (x < minX) minX = x;
-            if (x > maxX) maxX = x;
-            if (y < minY) minY = y;
-            if (y > maxY) maxY = y;
-            if (z < minZ) minZ = z;
-            if (z > maxZ) maxZ = z;
-            positions.push_back(tm * Point(x, y, z));
-        } else if (lineType == "vn") {   // New vertex normal
-            lineStream >> x >> y >> z;
-            normals.push_back(tm * Vect(x, y, z));
-        } else if (lineType == "f") {   // New face
-            lineStream >> a >> b >> c;
-            faces.push_back(Face(a - 1, b - 1, c - 1));
-        } else continue;
+            node.min[k] = min(node.min[k], box[k]);
+            node.max[k] = max(node.max[k], box[3 + k]);
+        }
     }
 
-    Point maxValues(maxX, maxY, maxZ);
-    Point minValues(minX, minY, minZ);
+    const size_t index = nodes.size();
+    nodes.push_back(node);
+    // If there are 16 triangles or less make this node a leaf.
+    if (end - begin <= leafSize) return;
 
-    if (maxDistFromOrigin != 0.0f)
+    // Find the axis with the greatest 'size' and split the triangles by their median middle point in it.
+    int axis = 0;
+    for (int k = 1; k < 3; ++k)
     {
-        ClampPoints(positions, maxValues, minValues, maxDistFromOrigin, shift);
+        if (node.max[k] - node.min[k] > node.max[axis] - node.min[axis]) axis = k;
     }
+    const unsigned int middle = begin + (end - begin) / 2;
+    nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                [&centers, axis](const unsigned int t1, const unsigned int t2)
+                {
+                    return centers[3 * t1 + axis] < centers[3 * t2 + axis];
+                });
+
+    BuildNode(boxes, centers, order, begin, middle, leafSize, nodes);
+    nodes[index].offset = static_cast<uint32_t>(nodes.size());
+    nodes[index].count = 0;
+    BuildNode(boxes, centers, order, middle, end, leafSize, nodes);
+}
 
-    if (normals.size() == 0)
+/**
+ * @param triangles Vertices of the triangles, nine floats per triangle.
+ * @param leafSize Maximum number of triangles in a leaf.
+ * @param nodes Nodes of the hierarchy, the root being the first one.
+ * @return Order in which the triangles must be stored for the leaves of the hierarchy.
+ */
+static vector<unsigned int> BuildHierarchy(const vector<float> &triangles, const unsigned int leafSize,
+                                           vector<MeshNode> &nodes)
+{
+    const size_t count = triangles.size() / 9;
+    vector<float> boxes(6 * count), centers(3 * count);
+    vector<unsigned int> order(count);
+    for (size_t i = 0; i < count; ++i)
     {
-        for (unsigned int i = 0; i < faces.size(); ++i)
+        const float *vertices = &triangles[9 * i];
+        for (int k = 0; k < 3; ++k)
         {
-            Triangle tmp(positions.at(get<0>(faces[i])),
-                    positions.at(get<1>(faces[i])),
-                    positions.at(get<2>(faces[i])));
-
-            triangles.push_back(make_shared<Triangle>(tmp));
+            boxes[6 * i + k] = min({vertices[k], vertices[3 + k], vertices[6 + k]});
+            boxes[6 * i + 3 + k] = max({vertices[k], vertices[3 + k], vertices[6 + k]});
+            centers[3 * i + k] = (vertices[k] + vertices[3 + k] + vertices[6 + k]) / 3;
         }
+        order[i] = static_cast<unsigned int>(i);
+    }
+
+    nodes.clear();
+    nodes.reserve(count > 0 ? 2 * (count / leafSize + 1) : 1);
+    if (count == 0)
+    {
+        // Empty node that no ray can intersect.
+        nodes.push_back({{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}, 0, 0});
     }
     else
     {
+        BuildNode(boxes, centers, order, 0, static_cast<unsigned int>(count), leafSize, nodes);
+    }
+    return order;
+}
+
+/**
+ * @param header Header of a binary mesh file.
+ * @return Size in bytes that a file with that header must have.
+ */
+static uint64_t GetBinaryMeshSize(const BinaryMeshHeader &header)
+{
+    return sizeof(BinaryMeshHeader) + static_cast<uint64_t>(header.nodeCount) * sizeof(MeshNode) +
+           static_cast<uint64_t>(header.vertexCount) * 3 * sizeof(float) +
+           static_cast<uint64_t>(header.normalCount) * 3 * sizeof(float) +
+           static_cast<uint64_t>(header.triangleCount) * sizeof(ObjTriangle);
+}
 
-        if (positions.size() != normals.size())
+/**
+ * Checks that every node of a hierarchy read from a file points inside the nodes and the triangles, and that it's
+ * shallow enough for the stack used when traversing it.
+ *
+ * @param nodes Nodes of the hierarchy, the root being the first one.
+ * @param nodeCount Number of nodes.
+ * @param triangleCount Number of triangles.
+ * @return true if the hierarchy can be traversed safely.
+ */
+static bool IsValidHierarchy(const MeshNode *nodes, const uint32_t nodeCount, const uint32_t triangleCount)
+{
+    // Children always come after their parents, so the depth of every node is known before visiting it.
+    vector<unsigned char> depths(nodeCount, 0);
+    for (uint32_t i = 0; i < nodeCount; ++i)
+    {
+        const MeshNode &node = nodes[i];
+        if (node.count > 0)
         {
-            cerr << "Error: the obj file doesn't define the same amount of vertices and normals\n";
-            throw 1; // Stop execution
+            if (node.offset > triangleCount || node.count > triangleCount - node.offset) return false;
         }
-
-        for (unsigned int i = 0; i < faces.size(); ++i)
+        else
         {
-            triangles.push_back(
-                    make_shared<MeshTriangle>(MeshTriangle(positions.at(get<0>(faces[i])),
-                            positions.at(get<1>(faces[i])),
-                            positions.at(get<2>(faces[i])),
-                            normals.at(get<0>(faces[i])),
-                            normals.at(get<1>(faces[i])),
-                            normals.at(get<2>(faces[i])))));
+            if (node.offset <= i + 1 || node.offset >= nodeCount || depths[i] >= 48) return false;
+            depths[i + 1] = depths[node.offset] = static_cast<unsigned char>(depths[i] + 1);
         }
     }
-    return Mesh(triangles);
+    return true;
 }
 
-Mesh::Mesh(vector<shared_ptr<Triangle>> triangles)
+/**
+ * @param faces Triangles as indices to vertices and normals.
+ * @param count Number of triangles.
+ * @param vertexCount Number of vertices.
+ * @param normalCount Number of normals.
+ * @return true if all the indices are within the vertices and normals.
+ */
+static bool AreValidFaces(const ObjTriangle *faces, const uint32_t count, const uint32_t vertexCount,
+                          const uint32_t normalCount)
 {
-    float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
-    float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
-
-    // Find the maximum and minimum values for the three coordinates.
-    // This will let us create the bounding box and divide the triangles into two.
-    for (const shared_ptr<Triangle> &t : triangles)
+    for (uint32_t i = 0; i < count; ++i)
     {
-        // Check Point A
-        if (t->GetA().GetX() < minX) minX = t->GetA().GetX();
-        if (t->GetA().GetX() > maxX) maxX = t->GetA().GetX();
-        if (t->GetA().GetY() < minY) minY = t->GetA().GetY();
-        if (t->GetA().GetY() > maxY) maxY = t->GetA().GetY();
-        if (t->GetA().GetZ() < minZ) minZ = t->GetA().GetZ();
-        if (t->GetA().GetZ() > maxZ) maxZ = t->GetA().GetZ();
-
-        // Check Point B
-        if (t->GetB().GetX() < minX) minX = t->GetB().GetX();
-        if (t->GetB().GetX() > maxX) maxX = t->GetB().GetX();
-        if (t->GetB().GetY() < minY) minY = t->GetB().GetY();
-        if (t->GetB().GetY() > maxY) maxY = t->GetB().GetY();
-        if (t->GetB().GetZ() < minZ) minZ = t->GetB().GetZ();
-        if (t->GetB().GetZ() > maxZ) maxZ = t->GetB().GetZ();
-
-        // Check Point C
-        if (t->GetC().GetX() < minX) minX = t->GetC().GetX();
-        if (t->GetC().GetX() > maxX) maxX = t->GetC().GetX();
-        if (t->GetC().GetY() < minY) minY = t->GetC().GetY();
-        if (t->GetC().GetY() > maxY) maxY = t->GetC().GetY();
-        if (t->GetC().GetZ() < minZ) minZ = t->GetC().GetZ();
-        if (t->GetC().GetZ() > maxZ) maxZ = t->GetC().GetZ();
+        for (int k = 0; k < 3; ++k)
+        {
+            if (faces[i].vertices[k] >= vertexCount) return false;
+            // Either the three normals are missing or none is.
+            const unsigned int normal = faces[i].normals[k];
+            if (normal == ObjParser::NO_NORMAL ? faces[i].normals[0] != normal : normal >= normalCount) return false;
+        }
     }
+    return true;
+}
 
-    // Get the bounding shape
-    mBoundingShape = shared_ptr<Shape>(
-            new Box(Rectangle(Vect(0, 1, 0), Point(minX, minY, minZ), Point(maxX, minY, maxZ)), maxY - minY));
-    // If there are less than 16 triangles make this Mesh a leaf
-    if (triangles.size() <= 16)
+/**
+ * @param vertices Coordinates of the vertices, three floats each.
+ * @param normals Coordinates of the vertex normals, three floats each.
+ * @param faces Triangles as indices to vertices and normals.
+ * @param count Number of triangles.
+ * @param storage Where the new triangles are stored, with interpolated normals for those faces that define them.
+ * @return Pointers to the new triangles, in the same order as faces.
+ */
+static vector<Triangle *> CreateTriangles(const float *vertices, const float *normals, const ObjTriangle *faces,
+                                          const size_t count, MeshTriangles &storage)
+{
+    // Reserve all the triangles first, so the pointers to them stay valid.
+    size_t flatCount = 0;
+    for (size_t i = 0; i < count; ++i)
     {
-        mIsLeaf = true;
-        mTriangles = triangles;
+        if (faces[i].normals[0] == ObjParser::NO_NORMAL) ++flatCount;
     }
-    else
+    storage.flat.reserve(flatCount);
+    storage.smooth.reserve(count - flatCount);
+
+    vector<Triangle *> triangles;
+    triangles.reserve(count);
+    for (size_t i = 0; i < count; ++i)
     {
-        // Find the axis with the greatest 'size'
-        float xSize = maxX - minX;
-        float ySize = maxY - minY;
-        float zSize = maxZ - minZ;
-        float maxSize = max({xSize, ySize, zSize});
-
-        // Sort the triangle vector by the greatest axis
-        if (maxSize == xSize)
-        {
-            sort(triangles.begin(), triangles.end(), [](shared_ptr<Triangle> &t1, shared_ptr<Triangle> &t2)
-            {
-                return t1->GetCenter().GetX() > t2->GetCenter().GetX();
-            });
-        }
-        else if (maxSize == ySize)
+        const unsigned int *v = faces[i].vertices;
+        const unsigned int *n = faces[i].normals;
+        const Point a(vertices[3 * v[0]], vertices[3 * v[0] + 1], vertices[3 * v[0] + 2]);
+        const Point b(vertices[3 * v[1]], vertices[3 * v[1] + 1], vertices[3 * v[1] + 2]);
+        const Point c(vertices[3 * v[2]], vertices[3 * v[2] + 1], vertices[3 * v[2] + 2]);
+        if (n[0] == ObjParser::NO_NORMAL)
         {
-            sort(triangles.begin(), triangles.end(), [](shared_ptr<Triangle> &t1, shared_ptr<Triangle> &t2)
-            {
-                return t1->GetCenter().GetY() > t2->GetCenter().GetY();
-            });
-
+            storage.flat.emplace_back(a, b, c);
+            triangles.push_back(&storage.flat.back());
         }
         else
         {
-            sort(triangles.begin(), triangles.end(), [](shared_ptr<Triangle> &t1, shared_ptr<Triangle> &t2)
-            {
-                return t1->GetCenter().GetZ() > t2->GetCenter().GetZ();
-            });
+            storage.smooth.emplace_back(a, b, c,
+                                        Vect(normals[3 * n[0]], normals[3 * n[0] + 1], normals[3 * n[0] + 2]),
+                                        Vect(normals[3 * n[1]], normals[3 * n[1] + 1], normals[3 * n[1] + 2]),
+                                        Vect(normals[3 * n[2]], normals[3 * n[2] + 1], normals[3 * n[2] + 2]));
+            triangles.push_back(&storage.smooth.back());
         }
+    }
+    return triangles;
+}
 
-        // Split the triangle vector into two halves
-        vector<shared_ptr<Triangle>> firstHalf(triangles.begin(), triangles.begin() + triangles.size()/2);
-        vector<shared_ptr<Triangle>> secondHalf(triangles.begin() + triangles.size()/2, triangles.end());
+/**
+ * @param filename Path to the obj file.
+ * @param maxDistFromOrigin Value used to clamp the vertices.
+ * @param shift Value used to move the vertices.
+ * @param tm Transformation applied to the vertices and normals.
+ * @return Hash of the size and modification time of the obj file and all the parameters used to load it. The contents
+ *  aren't hashed so a cached mesh can be found without reading the whole obj file.
+ */
+static uint64_t GetMeshKey(const string &filename, const float maxDistFromOrigin, const Vect &shift,
+                           const TransformationMatrix &tm)
+{
+    uint64_t key = HashValue(MappedFile::GetFileSize(filename));
+    key = HashValue(MappedFile::GetModificationTime(filename), key);
+    key = HashValue(BINARY_VERSION, key);
+    key = HashValue(maxDistFromOrigin, key);
+    key = HashValue(shift.GetX(), key);
+    key = HashValue(shift.GetY(), key);
+    key = HashValue(shift.GetZ(), key);
+    return HashValue(tm.GetValues(), key);
+}
 
-        mLeft = make_shared<Mesh>(Mesh(firstHalf));
-        mRight = make_shared<Mesh>(Mesh(secondHalf));
-    }
+/**
+ * @param filename Path to the obj file.
+ * @return Path of the binary mesh file for the given obj file.
+ */
+static string GetBinaryMeshPath(const string &filename)
+{
+    return filename + ".rmesh";
 }
 
 Mesh::Mesh(const string &filename, float maxDistFromOrigin, const Vect &shift)
 {
-    mIsLeaf = true;
-    vector<Point> positions;
-    vector<Vect> normals;
-    vector<Face> faces;
-    ifstream objFile(filename);
-    string lineBuf;
-    string lineType;
-    istringstream lineStream;
-
-    float x, y, z;
-    unsigned int a, b, c;
-    float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
-    float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
-    while (objFile.good()) {
-        getline(objFile, lineBuf);
-        if (lineBuf.size() == 0) continue;
-        lineStream = istringstream(lineBuf);
-        lineStream >> lineType;
-        if (lineType == "v")    // New vertex
+    *this = LoadObjFile(filename, maxDistFromOrigin, shift);
+}
+
+Mesh Mesh::LoadObjFile(const string &filename, float maxDistFromOrigin, const Vect &shift, TransformationMatrix tm)
+{
+    const TraceScope scope("Mesh::LoadObjFile", filename);
+    const uint64_t key = GetMeshKey(filename, maxDistFromOrigin, shift, tm);
+    const string binaryPath = GetBinaryMeshPath(filename);
+    Mesh mesh;
+
+    if (MappedFile::GetModificationTime(binaryPath) >= 0)
+    {
+        // Use the hierarchy straight from the mapped file, the mesh keeps the mapping alive.
+        shared_ptr<MappedFile> file = make_shared<MappedFile>(binaryPath);
+        const char *data = file->GetData();
+        const BinaryMeshHeader *header = reinterpret_cast<const BinaryMeshHeader *>(data);
+        // Don't read the header of files shorter than it, empty ones aren't even mapped.
+        const bool known = file->GetSize() >= sizeof(BinaryMeshHeader) &&
+                           memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0 &&
+                           header->version == BINARY_VERSION;
+        if (known && header->key == key && header->nodeCount > 0 && file->GetSize() == GetBinaryMeshSize(*header))
         {
-            lineStream >> x >> y >> z;
-            if (x < minX) minX = x;
-            if (x > maxX) maxX = x;
-            if (y < minY) minY = y;
-            if (y > maxY) maxY = y;
-            if (z < minZ) minZ = z;
-            if (z > maxZ) maxZ = z;
-            positions.push_back(Point(x, y, z));
-        } else if (lineType == "vn") {   // New vertex normal
-            lineStream >> x >> y >> z;
-            normals.push_back(Vect(x, y, z));
-        } else if (lineType == "f") {   // New face
-            lineStream >> a >> b >> c;
-            faces.push_back(Face(a - 1, b - 1, c - 1));
-        } else continue;
+            const size_t nodesSize = header->nodeCount * sizeof(MeshNode);
+            const size_t verticesSize = header->vertexCount * 3 * sizeof(float);
+            const size_t normalsSize = header->normalCount * 3 * sizeof(float);
+            const MeshNode *nodes = reinterpret_cast<const MeshNode *>(data + sizeof(BinaryMeshHeader));
+            const float *vertices = reinterpret_cast<const float *>(data + sizeof(BinaryMeshHeader) + nodesSize);
+            const float *normals = reinterpret_cast<const float *>(data + sizeof(BinaryMeshHeader) + nodesSize +
+                                                                   verticesSize);
+            const ObjTriangle *faces = reinterpret_cast<const ObjTriangle *>(data + sizeof(BinaryMeshHeader) +
+                                                                             nodesSize + verticesSize + normalsSize);
+            if (IsValidHierarchy(nodes, header->nodeCount, header->triangleCount) &&
+                AreValidFaces(faces, header->triangleCount, header->vertexCount, header->normalCount))
+            {
+                mesh.mNodes = shared_ptr<const MeshNode>(file, nodes);
+                mesh.mNodeCount = header->nodeCount;
+                mesh.mStorage = make_shared<MeshTriangles>();
+                mesh.mTriangles = CreateTriangles(vertices, normals, faces, header->triangleCount, *mesh.mStorage);
+                return mesh;
+            }
+        }
+        if (known && header->key != key)
+        {
+            cerr << "Rebuilding the binary mesh " << binaryPath
+                 << ", it was built from another version of the obj file or with other parameters\n";
+        }
+        else
+        {
+            cerr << "Ignoring invalid binary mesh " << binaryPath << ", it will be rebuilt\n";
+        }
     }
 
-    Point maxValues(maxX, maxY, maxZ);
-    Point minValues(minX, minY, minZ);
+    ObjParser obj(filename);
+    vector<Point> &positions = obj.GetVertices();
+    vector<Vect> &normals = obj.GetNormals();
+    const vector<ObjTriangle> &faces = obj.GetTriangles();
+
+    tm.TransformPoints(positions);
+    tm.TransformVects(normals);
+
+    Point maxValues = obj.GetMaxValues();
+    Point minValues = obj.GetMinValues();
 
     if (maxDistFromOrigin != 0.0f)
     {
         ClampPoints(positions, maxValues, minValues, maxDistFromOrigin, shift);
     }
 
-    if (normals.size() == 0)
+    // Without normal indices in the faces, normals must match the vertices one to one.
+    const bool faceNormals = obj.HasFaceNormals();
+    if (normals.size() > 0 && !faceNormals && positions.size() != normals.size())
     {
-        for (unsigned int i = 0; i < faces.size(); ++i)
-        {
-            Triangle tmp(positions.at(get<0>(faces[i])),
-                         positions.at(get<1>(faces[i])),
-                         positions.at(get<2>(faces[i])));
+        cerr << "Error: the obj file doesn't define the same amount of vertices and normals\n";
+        throw 1; // Stop execution
+    }
 
-            mTriangles.push_back(make_shared<Triangle>(tmp));
-        }
+    vector<float> vertexValues(3 * positions.size()), normalValues(3 * normals.size()), triangleValues;
+    for (size_t i = 0; i < positions.size(); ++i)
+    {
+        vertexValues[3 * i] = positions[i].GetX();
+        vertexValues[3 * i + 1] = positions[i].GetY();
+        vertexValues[3 * i + 2] = positions[i].GetZ();
     }
-    else
+    for (size_t i = 0; i < normals.size(); ++i)
     {
-
-        if (positions.size() != normals.size())
-        {
-            cerr << "Error: the obj file doesn't define the same amount of vertices and normals\n";
-            throw 1; // Stop execution
-        }
-
-        for (unsigned int i = 0; i < faces.size(); ++i)
+        normalValues[3 * i] = normals[i].GetX();
+        normalValues[3 * i + 1] = normals[i].GetY();
+        normalValues[3 * i + 2] = normals[i].GetZ();
+    }
+    triangleValues.reserve(9 * faces.size());
+    for (const ObjTriangle &face : faces)
+    {
+        for (unsigned int v : face.vertices)
         {
-            mTriangles.push_back(
-                    make_shared<MeshTriangle>(MeshTriangle(positions.at(get<0>(faces[i])),
-                                                           positions.at(get<1>(faces[i])),
-                                                           positions.at(get<2>(faces[i])),
-                                                           normals.at(get<0>(faces[i])),
-                                                           normals.at(get<1>(faces[i])),
-                                                           normals.at(get<2>(faces[i])))));
+            triangleValues.insert(triangleValues.end(), &vertexValues[3 * v], &vertexValues[3 * v] + 3);
         }
     }
-    mBoundingShape = shared_ptr<Shape>(new Box(Rectangle(Vect(0,1,0),
-                                                         minValues,
-                                                         Point(maxValues.GetX(), minValues.GetY(), maxValues.GetZ())),
-                                               maxValues.GetY() - minValues.GetY()));
-}
 
-void Mesh::Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                     shared_ptr<Shape> thisShape) const
-{
-    if (mIsLeaf)
+    shared_ptr<vector<MeshNode>> nodes = make_shared<vector<MeshNode>>();
+    const vector<unsigned int> order = BuildHierarchy(triangleValues, LEAF_SIZE, *nodes);
+
+    // Faces in the order of the leaves, with their normals resolved.
+    vector<ObjTriangle> sortedFaces(faces.size());
+    for (size_t i = 0; i < order.size(); ++i)
     {
-        if (mBoundingShape->Intersect(lightRay) != FLT_MAX)
+        sortedFaces[i] = faces[order[i]];
+        if (normals.size() == 0)
         {
-            for (unsigned int i = 0; i < mTriangles.size(); ++i)
-            {
-                mTriangles[i]->Intersect(lightRay, minT, nearestShape, mTriangles[i]);
-            }
+            fill(sortedFaces[i].normals, sortedFaces[i].normals + 3, ObjParser::NO_NORMAL);
         }
-    }
-    else
-    {
-        float boundT = IntersectBound(lightRay);
-        if (boundT != FLT_MAX)
+        else if (!faceNormals)
         {
-            MeshIntersect(lightRay, minT, boundT, nearestShape);
+            copy(sortedFaces[i].vertices, sortedFaces[i].vertices + 3, sortedFaces[i].normals);
         }
     }
+
+    // Save the binary mesh. Write to a temporary file first so no one can map a half written one.
+    BinaryMeshHeader header = {};
+    memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.key = key;
+    header.vertexCount = static_cast<uint32_t>(positions.size());
+    header.normalCount = static_cast<uint32_t>(normals.size());
+    header.triangleCount = static_cast<uint32_t>(sortedFaces.size());
+    header.nodeCount = static_cast<uint32_t>(nodes->size());
+    const string temporaryPath = binaryPath + ".tmp";
+    {
+        ofstream binaryFile(temporaryPath, ios::binary);
+        binaryFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        binaryFile.write(reinterpret_cast<const char *>(nodes->data()), nodes->size() * sizeof(MeshNode));
+        binaryFile.write(reinterpret_cast<const char *>(vertexValues.data()), vertexValues.size() * sizeof(float));
+        binaryFile.write(reinterpret_cast<const char *>(normalValues.data()), normalValues.size() * sizeof(float));
+        binaryFile.write(reinterpret_cast<const char *>(sortedFaces.data()), sortedFaces.size() * sizeof(ObjTriangle));
+        binaryFile.close();
+        if (binaryFile.good()) rename(temporaryPath.c_str(), binaryPath.c_str());
+        else remove(temporaryPath.c_str());
+    }
+
+    mesh.mNodes = shared_ptr<const MeshNode>(nodes, nodes->data());
+    mesh.mNodeCount = static_cast<unsigned int>(nodes->size());
+    mesh.mStorage = make_shared<MeshTriangles>();
+    mesh.mTriangles = CreateTriangles(vertexValues.data(), normalValues.data(), sortedFaces.data(), sortedFaces.size(),
+                                      *mesh.mStorage);
+    return mesh;
 }
 
-float Mesh::Intersect(const LightRay &lightRay) const
+Mesh::Mesh(vector<shared_ptr<Triangle>> triangles)
 {
-    if (mIsLeaf)
+    vector<float> triangleValues;
+    triangleValues.reserve(9 * triangles.size());
+    for (const shared_ptr<Triangle> &t : triangles)
     {
-        if (mBoundingShape->Intersect(lightRay) != FLT_MAX)
+        for (const Point &p : {t->GetA(), t->GetB(), t->GetC()})
         {
-            for (unsigned int i = 0; i < mTriangles.size(); ++i)
-            {
-                float tmp = mTriangles[i]->Intersect(lightRay);
-                if (tmp != FLT_MAX) return tmp;
-            }
+            triangleValues.push_back(p.GetX());
+            triangleValues.push_back(p.GetY());
+            triangleValues.push_back(p.GetZ());
         }
-        return FLT_MAX;
-    }
-    else if (IntersectBound(lightRay) != FLT_MAX)
-    {
-        float t = FLT_MAX;
-        shared_ptr<Shape> stubPtr;
-        MeshIntersect(lightRay, t, FLT_MAX, stubPtr);
-        return t;
-    }
-    else
-    {
-        return FLT_MAX;
     }
+
+    shared_ptr<vector<MeshNode>> nodes = make_shared<vector<MeshNode>>();
+    const vector<unsigned int> order = BuildHierarchy(triangleValues, LEAF_SIZE, *nodes);
+    mNodes = shared_ptr<const MeshNode>(nodes, nodes->data());
+    mNodeCount = static_cast<unsigned int>(nodes->size());
+    mTriangles.reserve(triangles.size());
+    for (unsigned int i : order) mTriangles.push_back(triangles[i].get());
+    mStorage = make_shared<MeshTriangles>();
+    mStorage->shared = move(triangles);
 }
 
-void Mesh::MeshIntersect(const LightRay &lightRay, float &minT, const float maxT,
-                         shared_ptr<Shape> &nearestShape) const
+/**
+ * Slab test between a ray and the bounding box of a node.
+ *
+ * @param node Node of a Mesh's hierarchy.
+ * @param origin Origin of the ray.
+ * @param inverse Inverse of every coordinate of the ray's direction.
+ * @return Distance at which the ray enters the box (negative if it starts inside) or FLT_MAX if it misses it.
+ */
+static inline float IntersectNode(const MeshNode &node, const float origin[3], const float inverse[3])
 {
-    if (mIsLeaf)
+    float tNear = -FLT_MAX, tFar = FLT_MAX;
+    for (int k = 0; k < 3; ++k)
     {
-        Intersect(lightRay, minT, nearestShape, nullptr);
-        return;
+        float t1 = (node.min[k] - origin[k]) * inverse[k];
+        float t2 = (node.max[k] - origin[k]) * inverse[k];
+        if (t1 > t2) swap(t1, t2);
+        tNear = t1 > tNear ? t1 : tNear;
+        tFar = t2 < tFar ? t2 : tFar;
     }
-    // else
-    float leftT = mLeft->IntersectBound(lightRay);
-    float rightT = mRight->IntersectBound(lightRay);
+    // Widen the far distance a bit so rounding errors can't discard triangles lying on the box's faces.
+    tFar *= 1.0f + 4 * FLT_EPSILON;
+    return (tNear <= tFar) & (tFar >= 0) ? tNear : FLT_MAX;
+}
 
-    if ((rightT >= FLT_MAX) & (leftT >= FLT_MAX))
+template <class F>
+void Mesh::Traverse(const LightRay &lightRay, float &minT, F intersectLeaf) const
+{
+    const MeshNode *nodes = mNodes.get();
+    const Vect direction = lightRay.GetDirection();
+    const Point source = lightRay.GetSource();
+    const float origin[3] = {source.GetX(), source.GetY(), source.GetZ()};
+    const float inverse[3] = {direction.GetX() != 0 ? 1 / direction.GetX() : FLT_MAX,
+                              direction.GetY() != 0 ? 1 / direction.GetY() : FLT_MAX,
+                              direction.GetZ() != 0 ? 1 / direction.GetZ() : FLT_MAX};
+
+    // Nodes pending to visit, with the distance at which the ray enters them.
+    pair<unsigned int, float> stack[64];
+    unsigned int stackSize = 0;
+    const float rootT = IntersectNode(nodes[0], origin, inverse);
+    if (rootT < minT) stack[stackSize++] = make_pair(0u, rootT);
+
+    // Counted locally and reported once, the loop is too hot for a thread local update per node.
+    unsigned int visited = 0, tested = 0;
+    while (stackSize > 0)
     {
-        return;
-    }
+        const pair<unsigned int, float> entry = stack[--stackSize];
+        // A nearer intersection has been found since this node was pushed.
+        if (entry.second >= minT) continue;
 
-    if (leftT < rightT)
-    {
-        mLeft->MeshIntersect(lightRay, minT, FLT_MAX, nearestShape);
+        ++visited;
+        const MeshNode &node = nodes[entry.first];
+        if (node.count > 0)
+        {
+            intersectLeaf(node.offset, node.count);
+            tested += node.count;
+            continue;
+        }
 
-        if (rightT < minT)
+        unsigned int near = entry.first + 1, far = node.offset;
+        float nearT = IntersectNode(nodes[near], origin, inverse);
+        float farT = IntersectNode(nodes[far], origin, inverse);
+        if (farT < nearT)
         {
-            mRight->MeshIntersect(lightRay, minT, minT, nearestShape);
+            swap(near, far);
+            swap(nearT, farT);
         }
+        // Push the farthest child first so the nearest one is visited first.
+        if (farT < minT) stack[stackSize++] = make_pair(far, farT);
+        if (nearT < minT) stack[stackSize++] = make_pair(near, nearT);
     }
-    else
-    {
-        mRight->MeshIntersect(lightRay, minT, FLT_MAX, nearestShape);
+    RenderStats::Count(BVH_NODES_VISITED, visited);
+    RenderStats::Count(INTERSECTION_TESTS, tested);
+}
 
-        if (leftT < minT)
+void Mesh::Intersect(const LightRay &lightRay, HitRecord &hit) const
+{
+    Traverse(lightRay, hit.t, [&](const unsigned int first, const unsigned int count)
+    {
+        for (unsigned int i = first; i < first + count; ++i)
         {
-            mLeft->MeshIntersect(lightRay, minT, minT, nearestShape);
+            mTriangles[i]->Intersect(lightRay, hit);
         }
-    }
+    });
 }
 
-float Mesh::IntersectBound(const LightRay &lightRay) const
+float Mesh::Intersect(const LightRay &lightRay) const
 {
-    return mBoundingShape->Intersect(lightRay);
+    float minT = FLT_MAX;
+    Traverse(lightRay, minT, [&](const unsigned int first, const unsigned int count)
+    {
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            const float t = mTriangles[i]->Intersect(lightRay);
+            if (t < minT) minT = t;
+        }
+    });
+    return minT;
 }
 
 bool Mesh::IsInside(const Point &point) const
@@ -432,32 +621,16 @@ Vect Mesh::GetNormal(const Point &point) const
 
 void Mesh::SetMaterial(shared_ptr<Material> material)
 {
-    if (mIsLeaf)
+    for (unsigned int i = 0; i < mTriangles.size(); ++i)
     {
-        for (unsigned int i = 0; i < mTriangles.size(); ++i)
-        {
-            mTriangles[i]->SetMaterial(material);
-        }
-    }
-    else
-    {
-        mLeft->SetMaterial(material);
-        mRight->SetMaterial(material);
+        mTriangles[i]->SetMaterial(material);
     }
 }
 
 void Mesh::SetRefractiveIndex(const float refractiveIndex)
 {
-    if (mIsLeaf)
-    {
-        for (unsigned int i = 0; i < mTriangles.size(); ++i)
-        {
-            mTriangles[i]->SetRefractiveIndex(refractiveIndex);
-        }
-    }
-    else
+    for (unsigned int i = 0; i < mTriangles.size(); ++i)
     {
-        mLeft->SetRefractiveIndex(refractiveIndex);
-        mRight->SetRefractiveIndex(refractiveIndex);
+        mTriangles[i]->SetRefractiveIndex(refractiveIndex);
     }
 }
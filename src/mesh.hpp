@@ -2,8 +2,8 @@
  ** mesh.hpp
  ** Defines shape made out of many triangles. Contains a method for loading
  ** triangles and vertex normals from obj files. It's not a complete load though,
- ** it can't load texture coordinates and only works when there is a 1 to 1 match
- ** for vertices and vertex normals or there are no vertex normals.
+ ** it ignores texture coordinates and, for faces without normal indices, only
+ ** uses vertex normals when there is a 1 to 1 match with the vertices.
  **
  ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
  **         Santiago Gil Begué, NIA: 683482
@@ -12,6 +12,7 @@
 #ifndef RAY_TRACER_MESH_HPP
 #define RAY_TRACER_MESH_HPP
 
+#include <cstdint>
 #include <memory>
 #include "meshTriangle.hpp"
 #include  "transformationMatrix.hpp"
@@ -19,34 +20,43 @@
 
 using namespace std;
 
-class Mesh : public Shape
+/** Node of the flattened bounding volume hierarchy of a Mesh. The left child of an inner node is the next node. */
+struct MeshNode
 {
+    /** Bounding box of all the triangles under this node. */
+    float min[3], max[3];
+    /** Index of the first triangle if this node is a leaf, index of the right child otherwise. */
+    uint32_t offset;
+    /** Number of triangles in this node if it's a leaf, 0 otherwise. */
+    uint32_t count;
+};
+
+/** Storage of the triangles of a Mesh, shared by all its copies. */
+struct MeshTriangles;
 
-friend class Triangle;
+class Mesh : public Shape
+{
 
 public:
 
     /**
      * Constructs a new Mesh from an obj file.
      *   Keep in mind that this constructor only reads a subset of everything an obj file
-     *   describes. It ignores materials and, some ways of defining faces. Texture mapping may
-     *   be implemented in a later date, probably not though.
+     *   describes. It ignores materials and texture coordinates. Polygons are split into triangles.
      *
      * @param filename Path to the obj file containing a mesh.
      * @param maxDistFromOrigin Maximum distance allowed for any point in the obj file from the
      * relative origin of coordinates.
      * @param shift Vector by which the relative origin of coordinates for this mesh will be moved.
-     * @return New Mesh object loaded from obj file. A Mesh constructed like this will have
-     *  a single bounding volume.
+     * @return New Mesh object loaded from obj file.
      */
     Mesh(const string &filename, float maxDistFromOrigin, const Vect &shift);
 
     /**
-     * Recursively builds a tree of mesh objects dividing the triangles into two vectors
-     * and calling this constructor for each of this one's children. The triangles are divided
-     * by axis with the longest difference and sorted by the triangles middle point.
+     * Builds a bounding volume hierarchy over the given triangles, stored as a flat array of nodes. The triangles are
+     * divided recursively by the axis with the longest difference at their median middle point.
      *
-     * If triangles contains less than 32 triangles this Mesh will be a leaf, stopping the recursion.
+     * If a node contains 16 triangles or less it will be a leaf, stopping the recursion.
      *
      * @param triangles vector containing the triangles to build this Mesh out of.
      */
@@ -55,11 +65,17 @@ public:
     /**
      * Creates a new Mesh with bounding box hierarchy in a binary tree.
      *
+     * The resulting triangles and hierarchy are saved in a binary file next to the obj file, along with a hash of the
+     * obj file's size, its modification time and the parameters. Later loads with the same hash memory map that file
+     * instead of parsing the obj file and building the hierarchy again. Files with another hash or that fail
+     * validation are overwritten, so loading the same obj file with different parameters rebuilds it every time.
+     *
      * @param filename Path to the obj file containing a mesh.
      * @param maxDistFromOrigin Maximum distance allowed for any point in the obj file from the
      * relative origin of coordinates.
      * @param shift Vector by which the relative origin of coordinates for this mesh will be moved.
-     * @return
+     * @param tm Transformation applied to all the vertices and normals in the file.
+     * @return New Mesh loaded from the obj file.
      */
     static Mesh LoadObjFile(const string &filename, float maxDistFromOrigin, const Vect &shift,
                             TransformationMatrix tm = TransformationMatrix());
@@ -73,35 +89,13 @@ public:
     float Intersect(const LightRay &lightRay) const;
 
     /**
-     * If the triangle that is closest to the lightRay origin (if any triangle is intersected) is
-     * at a distance smaller than minT then:
-     *  minT is updated to that distance
-     *  nearestShape is updated to the triangle closest to the lightray's origin.
+     * If the triangle that is closest to the lightRay origin (if any triangle is intersected) is at a distance smaller
+     * than hit.t, hit is updated to the intersection with that triangle.
      *
-     * @param minT Distance from the lightray's origin to nearestShape.
-     * @param nearestShape Shape that is at distance t from the lightray's origin.
      * @param lightRay The LightRay we are checking for intersections.
+     * @param hit Nearest intersection found so far.
      */
-    void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                   shared_ptr<Shape> thisShape) const;
-
-    /**
-     * Special intersect function for searching the Mesh 'tree'.
-     * @param lightRay Origin and direction to check for intersections with this Mesh.
-     * @param minT Minimum distance so far to the lightray. Will be updated if this Mesh gets a intersection at a smaller distance.
-     * @param maxT Maximum distance to consider checking a bounding volume (allows us to stop checking branches).
-     * @param nearestShape Nearest shape intersected by the lightray so far. Updated together with minT.
-     */
-    void MeshIntersect(const LightRay &lightRay, float &minT, const float maxT,
-                       shared_ptr<Shape> &nearestShape) const;
-
-    /**
-     * Returns the distance from the lightray's origin to the this mesh's bounding shape.
-     * If the bounding shape is not intersected by the lightray it returns FLT_MAX.
-     * @param lightRay
-     * @return Distance from the lightray's origin to the this mesh's bounding shape.
-     */
-    float IntersectBound(const LightRay &lightRay) const;
+    void Intersect(const LightRay &lightRay, HitRecord &hit) const;
 
     /**
      * This method is not usable for this shape. Calling it will result in an exception. This is because a Mesh
@@ -129,17 +123,35 @@ public:
     void SetRefractiveIndex(const float refractiveIndex);
 private:
 
-    /** True if this Mesh has no children Meshes. */
-    bool mIsLeaf = false;
-
-    /** Left child Mesh. */
-    shared_ptr<Mesh> mLeft;
-    /** Right child Mesh. */
-    shared_ptr<Mesh> mRight;
-    /** Shape enclosing all the triangles in this mesh. */
-    shared_ptr<Shape> mBoundingShape;
-    /** All the triangles in this Mesh IF it's a leaf. If it's not a leaf it just remains empty. */
-    vector<shared_ptr<Triangle>> mTriangles;
+    /** Maximum number of triangles in a leaf of the hierarchy. */
+    static constexpr unsigned int LEAF_SIZE = 16;
+
+    /** Nodes of the hierarchy, the first one being the root. They may live in a memory mapped file. */
+    shared_ptr<const MeshNode> mNodes;
+
+    /** Number of nodes in the hierarchy. */
+    unsigned int mNodeCount = 0;
+
+    /** Owner of the triangles of this Mesh. */
+    shared_ptr<MeshTriangles> mStorage;
+
+    /** All the triangles in this Mesh, sorted so the triangles of every leaf are contiguous. */
+    vector<Triangle *> mTriangles;
+
+    /** Private constructor for meshes whose hierarchy is already built. */
+    Mesh() = default;
+
+    /**
+     * Visits, nearest first, all the leaves of the hierarchy whose bounding box the lightRay intersects closer than
+     * minT.
+     *
+     * @param lightRay The LightRay we are checking for intersections.
+     * @param minT Distance to the nearest intersection found so far. Leaves farther than it are skipped.
+     * @param intersectLeaf Called with the index of the first triangle and the number of triangles of each leaf. It
+     *  must update minT.
+     */
+    template <class F>
+    void Traverse(const LightRay &lightRay, float &minT, F intersectLeaf) const;
 };
 
-#endif // RAY_TRACER_MESH_HPP
\ No newline at end of file
+#endif // RAY_TRACER_MESH_HPP
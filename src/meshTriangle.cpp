@@ -25,4 +25,9 @@ Vect MeshTriangle::GetNormal(const Point &point) const
     float gamma = 1.0f - alpha - beta;
     // Normal interpolation.
     return mNormalA * gamma + mNormalB * alpha + mNormalC * beta;
-}
\ No newline at end of file
+}
+
+Vect MeshTriangle::GetHitNormal(const HitRecord &hit) const
+{
+    return mNormalA * (1.0f - hit.u - hit.v) + mNormalB * hit.u + mNormalC * hit.v;
+}
@@ -35,6 +35,12 @@ public:
      */
     Vect GetNormal(const Point &point) const;
 
+    /**
+     * @param hit Intersection with this triangle.
+     * @return Normal interpolated with the barycentric coordinates of the intersection, without solving them again.
+     */
+    Vect GetHitNormal(const HitRecord &hit) const;
+
 private:
 
     /** Normals. */
@@ -0,0 +1,87 @@
+/** ---------------------------------------------------------------------------
+ ** mipMap.cpp
+ ** Implementation for MipMap class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <cmath>
+#include "mipMap.hpp"
+
+/**
+ * @param value Any integer.
+ * @param size Size of the range.
+ * @return value wrapped to the range [0, size).
+ */
+static inline unsigned int Wrap(const int value, const unsigned int size)
+{
+    const int wrapped = value % static_cast<int>(size);
+    return static_cast<unsigned int>(wrapped < 0 ? wrapped + static_cast<int>(size) : wrapped);
+}
+
+MipMap::MipMap(const shared_ptr<const Image> image)
+{
+    mLevels.push_back(image);
+
+    while (mLevels.back()->GetWidth() > 1 || mLevels.back()->GetHeight() > 1)
+    {
+        const Image &previous = *mLevels.back();
+        const unsigned int width = max(previous.GetWidth() / 2, 1u);
+        const unsigned int height = max(previous.GetHeight() / 2, 1u);
+        shared_ptr<Image> level = make_shared<Image>(width, height);
+
+        for (unsigned int i = 0; i < height; ++i)
+        {
+            // Odd sizes repeat the last row or column of the previous level.
+            const ConstImageRow top = previous[min(2 * i, previous.GetHeight() - 1)];
+            const ConstImageRow bottom = previous[min(2 * i + 1, previous.GetHeight() - 1)];
+            const ImageRow row = (*level)[i];
+            for (unsigned int j = 0; j < width; ++j)
+            {
+                const unsigned int left = min(2 * j, previous.GetWidth() - 1);
+                const unsigned int right = min(2 * j + 1, previous.GetWidth() - 1);
+                row[j] = (top[left] + top[right] + bottom[left] + bottom[right]) / 4;
+            }
+        }
+        mLevels.push_back(level);
+    }
+}
+
+const Image &MipMap::GetLevel(const unsigned int level) const
+{
+    return *mLevels[level];
+}
+
+Color MipMap::Sample(const float u, const float v, const float lod) const
+{
+    const float maxLevel = static_cast<float>(mLevels.size() - 1);
+    const float clampedLod = lod < 0.0f ? 0.0f : (lod > maxLevel ? maxLevel : lod);
+    const unsigned int level = static_cast<unsigned int>(clampedLod);
+    const float weight = clampedLod - level;
+
+    const float scale = 1.0f / (1 << level);
+    Color retVal = SampleLevel(level, u * scale, v * scale);
+    if (weight > 0.0f && level + 1 < mLevels.size())
+    {
+        retVal = retVal * (1 - weight) + SampleLevel(level + 1, u * scale / 2, v * scale / 2) * weight;
+    }
+    return retVal;
+}
+
+Color MipMap::SampleLevel(const unsigned int level, const float u, const float v) const
+{
+    const Image &image = *mLevels[level];
+    // Pixel centers are at half coordinates.
+    const float x = u - 0.5f, y = v - 0.5f;
+    const float floorX = floor(x), floorY = floor(y);
+    const float fx = x - floorX, fy = y - floorY;
+
+    const unsigned int j0 = Wrap(static_cast<int>(floorX), image.GetWidth());
+    const unsigned int j1 = Wrap(static_cast<int>(floorX) + 1, image.GetWidth());
+    const ConstImageRow row0 = image[Wrap(static_cast<int>(floorY), image.GetHeight())];
+    const ConstImageRow row1 = image[Wrap(static_cast<int>(floorY) + 1, image.GetHeight())];
+
+    return (row0[j0] * (1 - fx) + row0[j1] * fx) * (1 - fy) +
+           (row1[j0] * (1 - fx) + row1[j1] * fx) * fy;
+}
@@ -0,0 +1,66 @@
+/** ---------------------------------------------------------------------------
+ ** mipMap.hpp
+ ** Pyramid of downsampled versions of an image. Each level halves the size of
+ ** the previous one averaging blocks of 2x2 pixels, down to a single pixel.
+ ** Lookups interpolate between pixels and levels (trilinear filtering) so
+ ** textures seen from far away don't alias.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_MIPMAP_HPP
+#define RAY_TRACER_MIPMAP_HPP
+
+#include "image.hpp"
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+class MipMap
+{
+
+public:
+
+    /**
+     * Builds all the levels of the pyramid for image.
+     *
+     * @param image Full resolution image, used as the first level of the pyramid.
+     * @return New MipMap of image.
+     */
+    MipMap(const shared_ptr<const Image> image);
+
+    /**
+     * @param level Level of the pyramid, 0 being the full resolution image.
+     * @return Image at the given level.
+     */
+    const Image &GetLevel(const unsigned int level) const;
+
+    /**
+     * Trilinear lookup. The image repeats in both directions.
+     *
+     * @param u Horizontal coordinate in pixels of the full resolution image.
+     * @param v Vertical coordinate in pixels of the full resolution image.
+     * @param lod Level of detail, log2 of the footprint of the lookup measured in pixels of the full resolution image.
+     * @return Filtered color of the image around (u, v).
+     */
+    Color Sample(const float u, const float v, const float lod) const;
+
+private:
+
+    /** Levels of the pyramid, from the full resolution image to the 1x1 one. */
+    vector<shared_ptr<const Image>> mLevels;
+
+    /**
+     * Bilinear lookup in a single level. The image repeats in both directions.
+     *
+     * @param level Level of the pyramid.
+     * @param u Horizontal coordinate in pixels of the given level.
+     * @param v Vertical coordinate in pixels of the given level.
+     * @return Color interpolated from the four pixels nearest to (u, v).
+     */
+    Color SampleLevel(const unsigned int level, const float u, const float v) const;
+};
+
+#endif // RAY_TRACER_MIPMAP_HPP
@@ -0,0 +1,427 @@
+/** ---------------------------------------------------------------------------
+ ** objParser.cpp
+ ** Implementation for ObjParser class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include "mappedFile.hpp"
+#include "objParser.hpp"
+#include <thread>
+
+/** Files smaller than this amount of bytes per thread are parsed by less threads. */
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+/** Part of an obj file parsed by a single thread. */
+struct ObjChunk
+{
+    /** Characters of the file in this chunk. It always begins at the start of a line. */
+    const char *begin, *end;
+
+    /** Coordinates of the vertices and normals, three floats each. */
+    vector<float> vertices, normals;
+
+    vector<ObjTriangle> triangles;
+
+    /** Positions in the triangles' index arrays (3 * triangle + vertex) holding negative indices. Those are relative
+     * to the first vertex or normal of this chunk, which is only known once all chunks have been parsed. */
+    vector<size_t> relativeVertices, relativeNormals;
+
+    /** Bounds of the vertices in this chunk. */
+    float minValues[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float maxValues[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    /** True if all faces in this chunk define their vertex normals. */
+    bool hasFaceNormals = true;
+
+    /** Description of the first error found, empty if there were none. */
+    string error;
+};
+
+static inline bool IsDigit(const char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool IsBlank(const char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+/**
+ * @param current First character of the number, possibly a sign.
+ * @param end End of the buffer.
+ * @param value Value read, in plain or scientific notation.
+ * @return First character after the number.
+ */
+static const char *ParseFloat(const char *current, const char *end, float &value)
+{
+    static const double POWERS_OF_TEN[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                           1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    bool negative = false;
+    if (current < end && (*current == '-' || *current == '+')) negative = *current++ == '-';
+
+    // Up to 19 significant digits fit in the mantissa, the rest only change the exponent.
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; current < end && IsDigit(*current); ++current)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*current - '0');
+            if (mantissa > 0) ++digits;
+        }
+        else ++exponent;
+    }
+    if (current < end && *current == '.')
+    {
+        for (++current; current < end && IsDigit(*current); ++current)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*current - '0');
+                if (mantissa > 0) ++digits;
+                --exponent;
+            }
+        }
+    }
+    if (current < end && (*current == 'e' || *current == 'E'))
+    {
+        ++current;
+        bool negativeExponent = false;
+        if (current < end && (*current == '-' || *current == '+')) negativeExponent = *current++ == '-';
+        int explicitExponent = 0;
+        for (; current < end && IsDigit(*current); ++current)
+        {
+            if (explicitExponent < 10000) explicitExponent = explicitExponent * 10 + (*current - '0');
+        }
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    }
+
+    double result = static_cast<double>(mantissa);
+    const int absExponent = exponent < 0 ? -exponent : exponent;
+    const double scale = absExponent <= 22 ? POWERS_OF_TEN[absExponent] : pow(10.0, absExponent);
+    result = exponent < 0 ? result / scale : result * scale;
+    value = static_cast<float>(negative ? -result : result);
+    return current;
+}
+
+/**
+ * @param current First character of the number, possibly a minus sign.
+ * @param end End of the buffer.
+ * @param value Value read. Left at 0 if there are no digits.
+ * @return First character after the number.
+ */
+static const char *ParseInt(const char *current, const char *end, long long &value)
+{
+    bool negative = false;
+    if (current < end && (*current == '-' || *current == '+')) negative = *current++ == '-';
+    value = 0;
+    for (; current < end && IsDigit(*current); ++current)
+    {
+        value = value * 10 + (*current - '0');
+    }
+    if (negative) value = -value;
+    return current;
+}
+
+/**
+ * @param current Any character of a line.
+ * @param end End of the buffer.
+ * @return First character of the next line.
+ */
+static inline const char *NextLine(const char *current, const char *end)
+{
+    const char *newLine = static_cast<const char *>(memchr(current, '\n', static_cast<size_t>(end - current)));
+    return newLine == nullptr ? end : newLine + 1;
+}
+
+/**
+ * Parses three blank separated floats.
+ *
+ * @param current First character after the line type.
+ * @param end End of the buffer.
+ * @param values Vector in which the three floats will be stored.
+ * @return First character after the third float.
+ */
+static inline const char *ParseTriple(const char *current, const char *end, vector<float> &values)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        while (current < end && IsBlank(*current)) ++current;
+        float value;
+        current = ParseFloat(current, end, value);
+        values.push_back(value);
+    }
+    return current;
+}
+
+/**
+ * Converts an index as written in the obj file to an index starting at 0.
+ *
+ * @param index Index read from the file. Positive indices are absolute and start at 1, negative ones are relative to
+ *  the last element defined.
+ * @param count Number of elements defined so far in the current chunk.
+ * @param relative Set to true if the returned index is relative to the first element of the chunk.
+ * @return Index starting at 0. If relative it may be "negative" (wrapped around) referencing previous chunks.
+ */
+static inline unsigned int ResolveIndex(const long long index, const size_t count, bool &relative)
+{
+    relative = index < 0;
+    return static_cast<unsigned int>(relative ? static_cast<long long>(count) + index : index - 1);
+}
+
+/**
+ * Parses all the lines in a chunk.
+ *
+ * @param chunk Chunk with its begin and end set. The rest of its values are filled by this function.
+ */
+static void ParseChunk(ObjChunk &chunk)
+{
+    const char *current = chunk.begin;
+    const char *end = chunk.end;
+    // Indices of the vertices and normals of the face being parsed, and whether they are relative.
+    vector<unsigned int> faceVertices, faceNormals;
+    vector<bool> relativeFaceVertices, relativeFaceNormals;
+
+    while (current < end)
+    {
+        while (current < end && IsBlank(*current)) ++current;
+        if (end - current < 2)
+        {
+            current = end;
+            break;
+        }
+
+        if (current[0] == 'v' && IsBlank(current[1]))   // New vertex
+        {
+            current = ParseTriple(current + 2, end, chunk.vertices);
+            const float *vertex = &chunk.vertices[chunk.vertices.size() - 3];
+            for (int i = 0; i < 3; ++i)
+            {
+                if (vertex[i] < chunk.minValues[i]) chunk.minValues[i] = vertex[i];
+                if (vertex[i] > chunk.maxValues[i]) chunk.maxValues[i] = vertex[i];
+            }
+        }
+        else if (current[0] == 'v' && current[1] == 'n' && end - current > 2 && IsBlank(current[2]))   // New normal
+        {
+            current = ParseTriple(current + 3, end, chunk.normals);
+        }
+        else if (current[0] == 'f' && IsBlank(current[1]))   // New face
+        {
+            faceVertices.clear();
+            faceNormals.clear();
+            relativeFaceVertices.clear();
+            relativeFaceNormals.clear();
+            bool hasNormals = true;
+            current += 2;
+            while (true)
+            {
+                while (current < end && IsBlank(*current)) ++current;
+                if (current == end || !(IsDigit(*current) || *current == '-' || *current == '+')) break;
+
+                long long vertex, texture, normal = 0;
+                bool relative;
+                current = ParseInt(current, end, vertex);
+                if (current < end && *current == '/')
+                {
+                    ++current;
+                    // Texture coordinates are ignored.
+                    if (current < end && *current != '/') current = ParseInt(current, end, texture);
+                    if (current < end && *current == '/') current = ParseInt(current + 1, end, normal);
+                }
+                if (vertex == 0)
+                {
+                    chunk.error = "invalid vertex index in a face";
+                    return;
+                }
+                faceVertices.push_back(ResolveIndex(vertex, chunk.vertices.size() / 3, relative));
+                relativeFaceVertices.push_back(relative);
+                if (normal == 0) hasNormals = false;
+                else
+                {
+                    faceNormals.push_back(ResolveIndex(normal, chunk.normals.size() / 3, relative));
+                    relativeFaceNormals.push_back(relative);
+                }
+            }
+
+            if (faceVertices.size() < 3)
+            {
+                chunk.error = "face with less than three vertices";
+                return;
+            }
+            chunk.hasFaceNormals &= hasNormals;
+
+            // Split the polygon as a fan of triangles around its first vertex.
+            for (unsigned int i = 1; i + 1 < faceVertices.size(); ++i)
+            {
+                const unsigned int corners[3] = {0, i, i + 1};
+                ObjTriangle triangle;
+                for (int k = 0; k < 3; ++k)
+                {
+                    const size_t position = 3 * chunk.triangles.size() + k;
+                    triangle.vertices[k] = faceVertices[corners[k]];
+                    if (relativeFaceVertices[corners[k]]) chunk.relativeVertices.push_back(position);
+                    if (hasNormals)
+                    {
+                        triangle.normals[k] = faceNormals[corners[k]];
+                        if (relativeFaceNormals[corners[k]]) chunk.relativeNormals.push_back(position);
+                    }
+                    else triangle.normals[k] = ObjParser::NO_NORMAL;
+                }
+                chunk.triangles.push_back(triangle);
+            }
+        }
+        // Anything else is ignored.
+        current = NextLine(current, end);
+    }
+}
+
+ObjParser::ObjParser(const string &filename, unsigned int threads)
+: mHasFaceNormals(true)
+{
+    const MappedFile file(filename);
+    const char *begin = file.GetData();
+    const char *end = begin + file.GetSize();
+
+    if (threads == 0) threads = max(thread::hardware_concurrency(), 1u);
+    const size_t chunkCount = max<size_t>(1, min<size_t>(threads, file.GetSize() / MIN_CHUNK_SIZE));
+
+    // Split the file in chunks of similar size that begin at the start of a line.
+    vector<ObjChunk> chunks(chunkCount);
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].begin = i == 0 ? begin : chunks[i - 1].end;
+        chunks[i].end = i + 1 == chunkCount ? end : NextLine(begin + file.GetSize() * (i + 1) / chunkCount, end);
+        if (chunks[i].end < chunks[i].begin) chunks[i].end = chunks[i].begin;
+        // Guess the amount of elements in the chunk to avoid most reallocations.
+        const size_t expectedLines = static_cast<size_t>(chunks[i].end - chunks[i].begin) / 32;
+        chunks[i].vertices.reserve(expectedLines * 3 / 2);
+        chunks[i].triangles.reserve(expectedLines);
+    }
+
+    vector<thread> workers;
+    for (size_t i = 1; i < chunkCount; ++i) workers.push_back(thread(ParseChunk, ref(chunks[i])));
+    ParseChunk(chunks[0]);
+    for (thread &worker : workers) worker.join();
+
+    // Offsets of each chunk in the final vectors.
+    vector<size_t> vertexBase(chunkCount), normalBase(chunkCount), triangleBase(chunkCount);
+    size_t vertexCount = 0, normalCount = 0, triangleCount = 0;
+    float minValues[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float maxValues[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        if (!chunks[i].error.empty())
+        {
+            cout << "Error parsing " << filename << ": " << chunks[i].error << '\n';
+            throw 1;
+        }
+        vertexBase[i] = vertexCount;
+        normalBase[i] = normalCount;
+        triangleBase[i] = triangleCount;
+        vertexCount += chunks[i].vertices.size() / 3;
+        normalCount += chunks[i].normals.size() / 3;
+        triangleCount += chunks[i].triangles.size();
+        mHasFaceNormals &= chunks[i].hasFaceNormals;
+        for (int k = 0; k < 3; ++k)
+        {
+            minValues[k] = min(minValues[k], chunks[i].minValues[k]);
+            maxValues[k] = max(maxValues[k], chunks[i].maxValues[k]);
+        }
+    }
+    mMinValues = Point(minValues[0], minValues[1], minValues[2]);
+    mMaxValues = Point(maxValues[0], maxValues[1], maxValues[2]);
+
+    mVertices.resize(vertexCount);
+    mNormals.resize(normalCount);
+    mTriangles.resize(triangleCount);
+
+    // Copy every chunk to its place in the final vectors, making relative indices absolute.
+    vector<char> validIndices(chunkCount, true);
+    auto merge = [&](const size_t i)
+    {
+        ObjChunk &chunk = chunks[i];
+        for (size_t j = 0; j < chunk.vertices.size() / 3; ++j)
+        {
+            mVertices[vertexBase[i] + j] = Point(chunk.vertices[3 * j], chunk.vertices[3 * j + 1],
+                                                 chunk.vertices[3 * j + 2]);
+        }
+        for (size_t j = 0; j < chunk.normals.size() / 3; ++j)
+        {
+            mNormals[normalBase[i] + j] = Vect(chunk.normals[3 * j], chunk.normals[3 * j + 1],
+                                               chunk.normals[3 * j + 2]);
+        }
+        for (size_t position : chunk.relativeVertices)
+        {
+            chunk.triangles[position / 3].vertices[position % 3] += static_cast<unsigned int>(vertexBase[i]);
+        }
+        for (size_t position : chunk.relativeNormals)
+        {
+            chunk.triangles[position / 3].normals[position % 3] += static_cast<unsigned int>(normalBase[i]);
+        }
+        bool valid = true;
+        for (size_t j = 0; j < chunk.triangles.size(); ++j)
+        {
+            const ObjTriangle &triangle = chunk.triangles[j];
+            for (int k = 0; k < 3; ++k)
+            {
+                valid &= triangle.vertices[k] < vertexCount;
+                valid &= triangle.normals[k] == NO_NORMAL || triangle.normals[k] < normalCount;
+            }
+            mTriangles[triangleBase[i] + j] = triangle;
+        }
+        validIndices[i] = valid;
+    };
+
+    workers.clear();
+    for (size_t i = 1; i < chunkCount; ++i) workers.push_back(thread(merge, i));
+    merge(0);
+    for (thread &worker : workers) worker.join();
+
+    for (size_t i = 0; i < chunkCount; ++i)
+    {
+        if (!validIndices[i])
+        {
+            cout << "Error parsing " << filename << ": face index out of range\n";
+            throw 1;
+        }
+    }
+}
+
+vector<Point> &ObjParser::GetVertices()
+{
+    return mVertices;
+}
+
+vector<Vect> &ObjParser::GetNormals()
+{
+    return mNormals;
+}
+
+const vector<ObjTriangle> &ObjParser::GetTriangles() const
+{
+    return mTriangles;
+}
+
+Point ObjParser::GetMinValues() const
+{
+    return mMinValues;
+}
+
+Point ObjParser::GetMaxValues() const
+{
+    return mMaxValues;
+}
+
+bool ObjParser::HasFaceNormals() const
+{
+    return mHasFaceNormals;
+}
@@ -0,0 +1,94 @@
+/** ---------------------------------------------------------------------------
+ ** objParser.hpp
+ ** Parser for the geometry in obj files. Reads vertices, vertex normals and faces,
+ ** the latter in any of the forms v, v/vt, v//vn or v/vt/vn, with positive or
+ ** negative (relative) indices. Polygons are triangulated as fans. Everything
+ ** else in the file (texture coordinates, groups, materials...) is ignored.
+ **
+ ** The file is memory mapped and big files are split into chunks, at line
+ ** boundaries, that are parsed in parallel and then merged.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_OBJPARSER_HPP
+#define RAY_TRACER_OBJPARSER_HPP
+
+#include "point.hpp"
+#include <string>
+#include "vect.hpp"
+#include <vector>
+
+using namespace std;
+
+/** Triangle of an obj file, as indices to its vertices and vertex normals. */
+struct ObjTriangle
+{
+    /** Indices of the vertices, starting at 0. */
+    unsigned int vertices[3];
+    /** Indices of the vertex normals, starting at 0, or NO_NORMAL if the face didn't define them. */
+    unsigned int normals[3];
+};
+
+class ObjParser
+{
+
+public:
+
+    /** Normal index of the vertices of faces without vertex normals. */
+    static constexpr unsigned int NO_NORMAL = ~0u;
+
+    /**
+     * Parses the whole obj file.
+     *
+     * @param filename Path to the obj file.
+     * @param threads Maximum number of threads used to parse the file. 0 to use as many as the hardware supports.
+     * @return New parser holding the geometry in the file. Throws if the file can't be read or has invalid indices.
+     */
+    ObjParser(const string &filename, unsigned int threads = 0);
+
+    /**
+     * @return Vertices in the file. They can be modified in place.
+     */
+    vector<Point> &GetVertices();
+
+    /**
+     * @return Vertex normals in the file. They can be modified in place.
+     */
+    vector<Vect> &GetNormals();
+
+    /**
+     * @return Triangles in the file, after splitting all the polygons.
+     */
+    const vector<ObjTriangle> &GetTriangles() const;
+
+    /**
+     * @return Point with the minimum value of all the vertices in each axis.
+     */
+    Point GetMinValues() const;
+
+    /**
+     * @return Point with the maximum value of all the vertices in each axis.
+     */
+    Point GetMaxValues() const;
+
+    /**
+     * @return true if every triangle defines its vertex normals.
+     */
+    bool HasFaceNormals() const;
+
+private:
+
+    vector<Point> mVertices;
+    vector<Vect> mNormals;
+    vector<ObjTriangle> mTriangles;
+
+    /** Bounds of the vertices. */
+    Point mMinValues, mMaxValues;
+
+    /** True if every triangle defines its vertex normals. */
+    bool mHasFaceNormals;
+};
+
+#endif // RAY_TRACER_OBJPARSER_HPP
@@ -17,8 +17,10 @@ ParticipatingMedia::ParticipatingMedia(const shared_ptr<Shape> &shape,
 
 void ParticipatingMedia::Intersect(const LightRay &lightRay, float &minT) const
 {
-    shared_ptr<Shape> patch;
-    return mShape->Intersect(lightRay, minT, patch, nullptr);
+    HitRecord hit;
+    hit.t = minT;
+    mShape->Intersect(lightRay, hit);
+    minT = hit.t;
 }
 
 float ParticipatingMedia::GetTransmittance(const float distance) const
@@ -44,10 +46,8 @@ bool ParticipatingMedia::RussianRoulette(const ColoredLightRay &in,
     // The event is scattering;
     if (random < mAlbedo)
     {
-        /* Transformation matrix from the local coordinates with [point] as the
-         * reference point, and the incoming lightray as the z axis, to global coordinates. */
-        PoseTransformationMatrix fromLocalToGlobal =
-                PoseTransformationMatrix::GetPoseTransformation(point, in.GetDirection());
+        // Local coordinates with the incoming lightray as the z axis.
+        const Frame frame(in.GetDirection());
         // Generate random angles in the sphere.
         float inclination, azimuth;
         tie(inclination, azimuth) = UniformSphereSampling();
@@ -58,7 +58,7 @@ bool ParticipatingMedia::RussianRoulette(const ColoredLightRay &in,
         // Transform the ray of light to global coordinates.
         /* Color is not divide by albedo because it's also multiplied by scattering and divided
          * by extinction when doing an aleatory mean free path. */
-        out = ColoredLightRay(point, fromLocalToGlobal * localRay, in.GetColor());
+        out = ColoredLightRay(point, frame.ToWorld(localRay), in.GetColor());
         return true;
     }
     // The event is absorption;
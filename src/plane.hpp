@@ -32,14 +32,11 @@ public:
     float Intersect(const LightRay &lightRay) const;
 
     /**
-     * @param lightRay The LightRay we are checking for intersections.
-     * @param minT Distance from the lightRay's origin to nearestShape. Updated to this this Plane's distance from
-     *  the lightRay's origin if that is smaller than minT.
-     * @param nearestShape Shape that is at distance t from the lightRay's origin. Updated to thisShape if this Plane
-     *  is closer from the lightRay's origin than minT.
+     * @param lightRay Contains the point from which an intersection with this shape will measured.
+     * @param hit Nearest intersection found so far. Updated to the intersection with this Plane if it's closer to
+     *  the lightRay's origin than hit.t.
      */
-    void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                   shared_ptr<Shape> thisShape) const;
+    void Intersect(const LightRay &lightRay, HitRecord &hit) const;
 
     /**
      * This method is not usable for this shape. Calling it will result in an exception. This is because a Plane
@@ -11,10 +11,17 @@
 #ifndef RAY_TRACER_POINT_H
 #define RAY_TRACER_POINT_H
 
-#include <array>
+#include <cmath>
 #include "dimensions.hpp"
+#include <ostream>
+#include "simd.hpp"
 #include "vect.hpp"
 
+/** Values in a Point. */
+#define mX mContainer[X]
+#define mY mContainer[Y]
+#define mZ mContainer[Z]
+
 class Point
 {
 
@@ -28,9 +35,9 @@ public:
     static constexpr float TH = 0.000005;
 
     /**
-     * @return New point at [0, 0, 0].
+     * @return New point. It's at [0, 0, 0] if it's value initialized (Point()), undefined otherwise.
      */
-    Point();
+    Point() = default;
 
     /**
      * @param x Value for x.
@@ -38,55 +45,110 @@ public:
      * @param z Value for z.
      * @return New point at [x, y, z].
      */
-    Point(const float x, const float y, const float z);
+    constexpr Point(const float x, const float y, const float z)
+    : mContainer(MakeFloat3(x, y, z))
+    {}
+
+    /**
+     * @param values Values for x, y and z.
+     * @return New point at the given values.
+     */
+    constexpr explicit Point(const Float3 &values)
+    : mContainer(values)
+    {}
 
     /**
      * @param to Point which distance with respect to this one will be returned.
      * @return Absolute distance from this point to the point [to].
      */
-    float Distance(const Point &to) const;
+    float Distance(const Point &to) const
+    {
+        return (*this - to).Abs();
+    }
 
     /**
      * @param to Point to compare in wich dimension this point is further.
      * @return the dimension in which this point and [to] are furthest.
      */
-    Dimension LongestDimension(const Point &to) const;
+    Dimension LongestDimension(const Point &to) const
+    {
+        Dimension longestDimension = X;
+        float maxDistance = std::abs(mX - to.mX);
+        // Check if dimension Y is longer.
+        if (std::abs(mY - to.mY) > maxDistance)
+        {
+            longestDimension = Y;
+            maxDistance = std::abs(mY - to.mY);
+        }
+        // Check if dimension Z is longer.
+        if (std::abs(mZ - to.mZ) > maxDistance)
+        {
+            longestDimension = Z;
+        }
+        return longestDimension;
+    }
 
     /**
      * @return Value for x.
      */
-    float GetX() const;
+    constexpr float GetX() const
+    {
+        return mX;
+    }
 
     /**
      * @return Value for y.
      */
-    float GetY() const;
+    constexpr float GetY() const
+    {
+        return mY;
+    }
 
     /**
      * @return Value for z.
      */
-    float GetZ() const;
+    constexpr float GetZ() const
+    {
+        return mZ;
+    }
+
+    /**
+     * @return Values of this point.
+     */
+    constexpr const Float3 &GetValues() const
+    {
+        return mContainer;
+    }
 
     /**
      * Sets [x] as the new point's X.
      *
      * @param x Value of the new point's X.
      */
-    void SetX(const float x);
+    constexpr void SetX(const float x)
+    {
+        mX = x;
+    }
 
     /**
      * Sets [y] as the new point's Y.
      *
      * @param y Value of the new point's Y.
      */
-    void SetY(const float y);
+    constexpr void SetY(const float y)
+    {
+        mY = y;
+    }
 
     /**
      * Sets [z] as the new point's Z.
      *
      * @param z Value of the new point's Z.
      */
-    void SetZ(const float z);
+    constexpr void SetZ(const float z)
+    {
+        mZ = z;
+    }
 
     /**
      * Sets [value] as the new point's dimension [dimension].
@@ -94,77 +156,122 @@ public:
      * @param dimension Dimension to be set.
      * @param value New value for the dimension [dimension].
      */
-    void SetDimension(const Dimension &dimension, const float value);
+    constexpr void SetDimension(const Dimension &dimension, const float value)
+    {
+        mContainer[dimension] = value;
+    }
 
     /**
      * @param p Point which values will be added to this one's.
      * @return New point sum of this and p.
      */
-    Point operator+(const Point& p) const;
+    SIMD_CONSTEXPR Point operator+(const Point& p) const
+    {
+        return Point(Add(mContainer, p.mContainer));
+    }
 
     /**
      * @param p Point which values will be subtracted to this one's.
      * @return New point from this minus p.
      */
-    Vect operator-(const Point& p) const;
+    SIMD_CONSTEXPR Vect operator-(const Point& p) const
+    {
+        return Vect(Subtract(mContainer, p.mContainer));
+    }
 
     /**
      * @param p Point by which this Point will be multiplied.
      * @return Product of this point and p.
      */
-    float operator*(const Point& p) const;
+    SIMD_CONSTEXPR float operator*(const Point& p) const
+    {
+        return Dot(mContainer, p.mContainer);
+    }
 
     /**
      * @param v Vector by which this point will be moved.
      * @return New point result of moving this one in the direction and magnitude v.
      */
-    Point operator+(const Vect& v) const;
+    SIMD_CONSTEXPR Point operator+(const Vect& v) const
+    {
+        return Point(Add(mContainer, v.GetValues()));
+    }
 
     /**
      * @param v Vector by which this point will be moved.
      */
-    void operator+=(const Vect& v);
+    SIMD_CONSTEXPR void operator+=(const Vect& v)
+    {
+        mContainer = Add(mContainer, v.GetValues());
+    }
 
     /**
      * @param v Vector by which this point will be moved.
      * @return New point result of moving this one in the opposite direction of v and magnitude v.
      */
-    Point operator-(const Vect& v) const;
+    SIMD_CONSTEXPR Point operator-(const Vect& v) const
+    {
+        return Point(Subtract(mContainer, v.GetValues()));
+    }
 
     /**
      * @param v Vector opposite to that by which this point will be moved.
      */
-    void operator-=(const Vect& v);
+    SIMD_CONSTEXPR void operator-=(const Vect& v)
+    {
+        mContainer = Subtract(mContainer, v.GetValues());
+    }
 
     /**
      * @param p Point to compare with this one.
      * @return True if this Point is the same as p.
      */
-    bool operator==(const Point& p) const;
+    bool operator==(const Point& p) const
+    {
+        return (std::abs(mX - p.GetX()) <= TH) &
+               (std::abs(mY - p.GetY()) <= TH) &
+               (std::abs(mZ - p.GetZ()) <= TH);
+    }
 
     /**
      * @param p Point to compare with this one.
      * @return True if this POint is different from p.
      */
-    bool operator!=(const Point& p) const;
+    bool operator!=(const Point& p) const
+    {
+        return ! (*this == p);
+    }
 
     /**
      * @param p Point to compare with this one.
      * @return True if all the values in p are greater or equal to the values in this Point.
      */
-    bool operator<=(const Point& p) const;
+    constexpr bool operator<=(const Point& p) const
+    {
+        return (mX - p.GetX() <= TH) &
+               (mY - p.GetY() <= TH) &
+               (mZ - p.GetZ() <= TH);
+    }
 
     /**
      * @param p Point to compare with this one.
      * @return True if all the values in p are smaller or equal to the values in this Point.
      */
-    bool operator>=(const Point& p) const;
+    constexpr bool operator>=(const Point& p) const
+    {
+        return (p.GetX() - mX <= TH) &
+               (p.GetY() - mY <= TH) &
+               (p.GetZ() - mZ <= TH);
+    }
 
     /**
     * @param p Point to compare with this one.
     * @return True if all the values in p are smaller or equal to the values in this Point.
     */
-    float operator[](const Dimension d) const;
+    constexpr float operator[](const Dimension d) const
+    {
+        return mContainer[d];
+    }
 
     /**
      * Pretty print.
@@ -173,17 +280,16 @@ public:
      * @param p Point to send to the stream as a string.
      * @return Stream with a string version of p.
      */
-    friend std::ostream& operator<<(std::ostream &out, const Point &p);
+    friend std::ostream& operator<<(std::ostream &out, const Point &p)
+    {
+        out << "Point(" << p.GetX() << ", " << p.GetY() << ", " << p.GetZ() << ")";
+        return out;
+    }
 
 protected:
 
-    /** This array is the actual container for the floats in a Point. */
-    std::array<float, 3> mContainer;
-
-    /** Values in this Point. */
-    #define mX mContainer[X]
-    #define mY mContainer[Y]
-    #define mZ mContainer[Z]
+    /** This is the actual container for the floats in a Point. */
+    Float3 mContainer;
 };
 
 #endif // RAY_TRACER_POINT_H
\ No newline at end of file
@@ -0,0 +1,197 @@
+/** ---------------------------------------------------------------------------
+ ** renderStats.cpp
+ ** Implementation for RenderStats class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include "renderStats.hpp"
+
+thread_local uint64_t tStatsCounters[COUNTER_COUNT] = {};
+
+/** Protects everything below. */
+static mutex statsMutex;
+
+/** Seconds spent in every phase. */
+static double phaseSeconds[PHASE_COUNT] = {};
+
+/** Flushed counters of every thread, in the order they were first flushed. */
+static vector<ThreadStats> threadStats;
+
+/**
+ * @param counters Counters of a thread or the totals.
+ * @return Rays of every kind.
+ */
+static uint64_t TotalRays(const uint64_t counters[COUNTER_COUNT])
+{
+    return counters[CAMERA_RAYS] + counters[SHADOW_RAYS] + counters[SPECULAR_RAYS] + counters[PHOTON_RAYS];
+}
+
+/**
+ * @param totals Updated to the sum of the counters of all the threads. Must be called with statsMutex locked.
+ */
+static void AddUpThreads(uint64_t totals[COUNTER_COUNT])
+{
+    fill(totals, totals + COUNTER_COUNT, 0);
+    for (const ThreadStats &stats : threadStats)
+    {
+        for (int i = 0; i < COUNTER_COUNT; ++i) totals[i] += stats.counters[i];
+    }
+}
+
+void RenderStats::AddPhaseTime(const StatsPhase phase, const double seconds)
+{
+    lock_guard<mutex> lock(statsMutex);
+    phaseSeconds[phase] += seconds;
+}
+
+void RenderStats::FlushThread(const string &name, const double seconds)
+{
+    lock_guard<mutex> lock(statsMutex);
+    auto stats = find_if(threadStats.begin(), threadStats.end(), [&name](const ThreadStats &stats)
+    {
+        return stats.name == name;
+    });
+    if (stats == threadStats.end())
+    {
+        threadStats.push_back(ThreadStats());
+        stats = threadStats.end() - 1;
+        stats->name = name;
+    }
+    stats->seconds += seconds;
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        stats->counters[i] += tStatsCounters[i];
+        tStatsCounters[i] = 0;
+    }
+}
+
+void RenderStats::Reset()
+{
+    lock_guard<mutex> lock(statsMutex);
+    fill(phaseSeconds, phaseSeconds + PHASE_COUNT, 0.0);
+    threadStats.clear();
+    fill(tStatsCounters, tStatsCounters + COUNTER_COUNT, 0);
+}
+
+uint64_t RenderStats::GetTotal(const StatsCounter counter)
+{
+    lock_guard<mutex> lock(statsMutex);
+    uint64_t totals[COUNTER_COUNT];
+    AddUpThreads(totals);
+    return totals[counter];
+}
+
+void RenderStats::PrintReport(ostream &out)
+{
+    lock_guard<mutex> lock(statsMutex);
+    uint64_t totals[COUNTER_COUNT];
+    AddUpThreads(totals);
+    const ios::fmtflags flags = out.flags();
+
+    out << "Phases (s):\n" << fixed << setprecision(3);
+    double totalSeconds = 0.0;
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        out << "  " << left << setw(24) << GetPhaseName(static_cast<StatsPhase>(i)) << right << setw(12)
+            << phaseSeconds[i] << '\n';
+        totalSeconds += phaseSeconds[i];
+    }
+    out << "  " << left << setw(24) << "total" << right << setw(12) << totalSeconds << '\n';
+
+    out << "Counters:\n";
+    for (int i = 0; i < COUNTER_COUNT; ++i)
+    {
+        out << "  " << left << setw(24) << GetCounterName(static_cast<StatsCounter>(i)) << right << setw(16)
+            << totals[i] << '\n';
+    }
+    if (phaseSeconds[RENDER] > 0)
+    {
+        out << "  " << left << setw(24) << "rays_per_render_second" << right << setw(16) << setprecision(0)
+            << (totals[CAMERA_RAYS] + totals[SHADOW_RAYS] + totals[SPECULAR_RAYS]) / phaseSeconds[RENDER] << '\n';
+    }
+
+    out << "Threads:\n  " << left << setw(12) << "name" << right << setw(12) << "busy s" << setw(10) << "tiles"
+        << setw(16) << "rays" << setw(16) << "tests" << setw(16) << "knn nodes" << '\n';
+    for (const ThreadStats &stats : threadStats)
+    {
+        out << "  " << left << setw(12) << stats.name << right << setw(12) << setprecision(3) << stats.seconds
+            << setw(10) << stats.counters[TILES_RENDERED] << setw(16) << TotalRays(stats.counters)
+            << setw(16) << stats.counters[INTERSECTION_TESTS] << setw(16) << stats.counters[KNN_NODES_VISITED] << '\n';
+    }
+    out.flags(flags);
+}
+
+bool RenderStats::SaveJson(const string &filename)
+{
+    lock_guard<mutex> lock(statsMutex);
+    uint64_t totals[COUNTER_COUNT];
+    AddUpThreads(totals);
+    const auto writeCounters = [](ofstream &file, const uint64_t counters[COUNTER_COUNT])
+    {
+        file << '{';
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+        {
+            file << (i == 0 ? "" : ", ") << '"' << GetCounterName(static_cast<StatsCounter>(i)) << "\": "
+                 << counters[i];
+        }
+        file << '}';
+    };
+
+    ofstream file(filename);
+    file << setprecision(6) << "{\n  \"phases\": {";
+    for (int i = 0; i < PHASE_COUNT; ++i)
+    {
+        file << (i == 0 ? "" : ", ") << '"' << GetPhaseName(static_cast<StatsPhase>(i)) << "\": " << phaseSeconds[i];
+    }
+    file << "},\n  \"counters\": ";
+    writeCounters(file, totals);
+    file << ",\n  \"threads\": [";
+    for (unsigned int i = 0; i < threadStats.size(); ++i)
+    {
+        file << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << threadStats[i].name << "\", \"seconds\": "
+             << threadStats[i].seconds << ", \"counters\": ";
+        writeCounters(file, threadStats[i].counters);
+        file << '}';
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+const char *RenderStats::GetCounterName(const StatsCounter counter)
+{
+    switch (counter)
+    {
+        case CAMERA_RAYS: return "camera_rays";
+        case SHADOW_RAYS: return "shadow_rays";
+        case SPECULAR_RAYS: return "specular_rays";
+        case PHOTON_RAYS: return "photon_rays";
+        case INTERSECTION_TESTS: return "intersection_tests";
+        case BVH_NODES_VISITED: return "bvh_nodes_visited";
+        case KNN_NODES_VISITED: return "knn_nodes_visited";
+        case DIFFUSE_PHOTONS_STORED: return "diffuse_photons_stored";
+        case CAUSTIC_PHOTONS_STORED: return "caustic_photons_stored";
+        case MEDIA_PHOTONS_STORED: return "media_photons_stored";
+        case TILES_RENDERED: return "tiles_rendered";
+        default: return "unknown";
+    }
+}
+
+const char *RenderStats::GetPhaseName(const StatsPhase phase)
+{
+    switch (phase)
+    {
+        case SCENE_SETUP: return "scene_setup";
+        case PHOTON_TRACING: return "photon_tracing";
+        case PHOTON_BALANCE: return "photon_balance";
+        case PHOTON_MAP_IO: return "photon_map_io";
+        case RENDER: return "render";
+        case IMAGE_SAVE: return "image_save";
+        default: return "unknown";
+    }
+}
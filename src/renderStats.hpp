@@ -0,0 +1,171 @@
+/** ---------------------------------------------------------------------------
+ ** renderStats.hpp
+ ** Counters and phase timers of a render. Every thread counts in its own
+ ** thread local counters, which are added to the totals when the thread
+ ** ends its work, so counting never needs any synchronisation.
+ ** Without RAY_TRACER_STATS counting does nothing.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_RENDER_STATS_HPP
+#define RAY_TRACER_RENDER_STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "trace.hpp"
+#include <vector>
+
+using namespace std;
+
+/** Events counted during a render. */
+enum StatsCounter
+{
+    CAMERA_RAYS,
+    SHADOW_RAYS,
+    SPECULAR_RAYS,
+    PHOTON_RAYS,
+    INTERSECTION_TESTS,
+    BVH_NODES_VISITED,
+    KNN_NODES_VISITED,
+    DIFFUSE_PHOTONS_STORED,
+    CAUSTIC_PHOTONS_STORED,
+    MEDIA_PHOTONS_STORED,
+    TILES_RENDERED,
+    COUNTER_COUNT
+};
+
+/** Steps of a render whose time is measured. */
+enum StatsPhase
+{
+    SCENE_SETUP,
+    PHOTON_TRACING,
+    PHOTON_BALANCE,
+    PHOTON_MAP_IO,
+    RENDER,
+    IMAGE_SAVE,
+    PHASE_COUNT
+};
+
+/** Counters of the calling thread not yet added to the totals. */
+extern thread_local uint64_t tStatsCounters[COUNTER_COUNT];
+
+/** Counters and time of a thread, added up over all the times it was flushed with the same name. */
+struct ThreadStats
+{
+    string name;
+    double seconds = 0.0;
+    uint64_t counters[COUNTER_COUNT] = {};
+};
+
+class RenderStats
+{
+
+public:
+
+    /**
+     * Counts events in the calling thread.
+     *
+     * @param counter Counter increased.
+     * @param amount Number of events.
+     */
+    static void Count(const StatsCounter counter, const uint64_t amount = 1)
+    {
+#ifdef RAY_TRACER_STATS
+        tStatsCounters[counter] += amount;
+#endif
+    }
+
+    /**
+     * @param phase Phase whose time is increased.
+     * @param seconds Seconds spent in the phase.
+     */
+    static void AddPhaseTime(const StatsPhase phase, const double seconds);
+
+    /**
+     * Adds the counters of the calling thread to the totals and resets them. Threads that count must call it before
+     * ending, or their counts are lost.
+     *
+     * @param name Name of the thread in the report. The counts of threads with the same name are added up.
+     * @param seconds Seconds the thread spent working, 0 if unknown.
+     */
+    static void FlushThread(const string &name, const double seconds = 0.0);
+
+    /**
+     * Clears all the counters and times, except the ones of other threads not flushed yet.
+     */
+    static void Reset();
+
+    /**
+     * @param counter A counter.
+     * @return Sum of the counter over all the threads flushed since the last Reset.
+     */
+    static uint64_t GetTotal(const StatsCounter counter);
+
+    /**
+     * Prints the times of every phase, the totals of every counter and the counters of every thread.
+     *
+     * @param out Stream where the report is written.
+     */
+    static void PrintReport(ostream &out);
+
+    /**
+     * Writes the same data as PrintReport in a JSON file.
+     *
+     * @param filename Path of the file, overwritten if it exists.
+     * @return true if the file was written successfully.
+     */
+    static bool SaveJson(const string &filename);
+
+    /**
+     * @param counter A counter.
+     * @return Name of the counter in snake case, as used in the JSON file.
+     */
+    static const char *GetCounterName(const StatsCounter counter);
+
+    /**
+     * @param phase A phase.
+     * @return Name of the phase in snake case, as used in the JSON file.
+     */
+    static const char *GetPhaseName(const StatsPhase phase);
+};
+
+/**
+ * Measures the time from its construction to its destruction and adds it to a phase. It's also recorded as an event
+ * named after the phase if tracing is enabled.
+ */
+class PhaseTimer
+{
+
+public:
+
+    /**
+     * @param phase Phase whose time is measured.
+     */
+    explicit PhaseTimer(const StatsPhase phase)
+    : mPhase(phase), mStart(chrono::steady_clock::now()) {}
+
+    ~PhaseTimer()
+    {
+        const chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        RenderStats::AddPhaseTime(mPhase, chrono::duration<double>(end - mStart).count());
+        if (Trace::IsEnabled()) Trace::AddEvent(RenderStats::GetPhaseName(mPhase), "", mStart, end);
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+
+    /** Phase whose time is measured. */
+    StatsPhase mPhase;
+
+    /** Time at which the measure began. */
+    chrono::steady_clock::time_point mStart;
+};
+
+#endif // RAY_TRACER_RENDER_STATS_HPP
@@ -6,13 +6,57 @@
 **         Santiago Gil Begué, NIA: 683482
 ** -------------------------------------------------------------------------*/
 
+#include <atomic>
 #include <cfloat>
+#include <chrono>
+#include <cstring>
+#include "emissionPlanner.hpp"
+#include <fstream>
+#include "frame.hpp"
+#include "hash.hpp"
 #include  "image.hpp"
 #include <iostream>
-#include  "poseTransformationMatrix.hpp"
+#include "mappedFile.hpp"
+#include "renderStats.hpp"
 #include "scene.hpp"
 #include "sphere.hpp"
+#include "trace.hpp"
+#include <stdexcept>
 #include <thread>
+#include <unordered_set>
+
+/** Header of the photon map files. It's followed by the number of nodes of every map and then their nodes. */
+struct PhotonMapsHeader
+{
+    char magic[4];
+    uint32_t version;
+    /** Value identifying the scene that emitted the photons. */
+    uint64_t sceneHash;
+    /** Seed of the random generator when the photons were emitted. */
+    uint64_t seed;
+    uint32_t photonsEmitted;
+    uint32_t causticPhotonsEmitted;
+    /** Number of maps: diffuse, caustics and one for every media. */
+    uint32_t mapCount;
+    /** Size of a node, the maps can't be used by builds with different nodes. */
+    uint32_t nodeSize;
+    /** 1 if the photons were emitted with importance sampling, 0 otherwise. */
+    uint32_t importanceSampling;
+    /** Hash of the camera and the image size the importance was computed for, 0 without importance sampling. */
+    uint64_t cameraHash;
+    char padding[8];
+};
+
+static_assert(sizeof(PhotonMapsHeader) == 64, "The photon maps header must fill a cache line");
+
+/** First bytes of every photon maps file. */
+static const char PHOTON_MAPS_MAGIC[4] = {'R', 'P', 'H', 'M'};
+
+/** Version of the photon maps format. */
+static const uint32_t PHOTON_MAPS_VERSION = 3;
+
+// Constants passed by reference need a definition until C++17.
+constexpr unsigned int Scene::MIN_ADAPTIVE_SAMPLES;
 
 void printProgressBar(unsigned int pixel, unsigned int total)
 {
@@ -29,253 +73,875 @@ void printProgressBar(unsigned int pixel, unsigned int total)
     cout << "] " <<  percentCompleted << "% \r" << std::flush;
 }
 
-unique_ptr<Image> Scene::Render() const
+/**
+ * @param metric Cost measured.
+ * @return Total cost spent by the calling thread so far, nanoseconds since an arbitrary moment or a thread local
+ *  counter. The cost of some work is the difference between the values returned after and before doing it.
+ */
+static double MeasureCost(const HeatmapMetric metric)
 {
-    // The rendered image.
-    unique_ptr<Image> rendered = make_unique<Image>
-            (mCamera->GetWidth(), mCamera->GetHeight());
-    // The current pixel. We begin with the first one (0,0).
-    Point currentPixel = mCamera->GetFirstPixel();
-    // The first pixel of the current row.
-    Point currentRow = currentPixel;
-    // Pixels' distance in the camera intrinsics right and up.
-    Vect advanceX(mCamera->GetRight() * mCamera->GetPixelSize());
-    Vect advanceY(mCamera->GetUp() * mCamera->GetPixelSize());
-    // For all the pixels, trace a ray of light.
-    for (unsigned int i = 0; i < mCamera->GetHeight(); ++i)
+    switch (metric)
+    {
+        case HEATMAP_INTERSECTION_TESTS: return tStatsCounters[INTERSECTION_TESTS];
+        case HEATMAP_KNN_NODES: return tStatsCounters[KNN_NODES_VISITED];
+        default: return chrono::duration<double, nano>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+unique_ptr<Image> Scene::RenderMultiThread(const unsigned int threadCount, Image *heatmap,
+                                           const HeatmapMetric metric) const
+{
+    const PhaseTimer timer(RENDER);
+    // The threads write straight into the returned image, so no copy is needed when they finish.
+    unique_ptr<Image> image = make_unique<Image>(GetRegionWidth(), GetRegionHeight());
+
+    // Start printing the progress bar at 0% completion
+    printProgressBar(0, 1);
+    RenderInParallel(SplitInTiles(*image), threadCount, true, [this, heatmap, metric](const ImageTile &tile)
     {
-        printProgressBar(i, mCamera->GetHeight());
-        for (unsigned int j = 0; j < mCamera->GetWidth(); ++j)
+        if (heatmap == nullptr)
         {
-            // Next pixel.
-            currentPixel += advanceX;
-            // Get the color for the current pixel.
-            (*rendered)[i][j] = GetLightRayColor(
-                    LightRay(mCamera->GetFocalPoint(), currentPixel), mSpecularSteps);
+            RenderPixelRange(tile);
+            return;
         }
-        // Next row.
-        currentRow -= advanceY;
-        currentPixel = currentRow;
-    }
-    printProgressBar(1,1);
+        // Same pixels in the heatmap, which tiles don't share cache lines either.
+        const ImageTile heatmapTile = heatmap->GetTile(tile.GetX(), tile.GetY(), tile.GetWidth(), tile.GetHeight());
+        RenderPixelRange(tile, &heatmapTile, metric);
+    });
+    printProgressBar(1, 1);
 
-    return rendered;
+    return image;
 }
 
-unique_ptr<Image> Scene::RenderMultiThread(const unsigned int threadCount) const
+unique_ptr<Image> Scene::RenderProgressive(const unsigned int threadCount, const ProgressiveSettings &settings,
+                                           const function<void(const Image &, unsigned int)> &snapshot) const
 {
-    shared_ptr<Image> image(new Image(mCamera->GetWidth(), mCamera->GetHeight()));
+    const PhaseTimer timer(RENDER);
+    using Clock = chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    Clock::time_point lastSnapshot = start;
+    const unsigned int width = GetRegionWidth(), height = GetRegionHeight();
+
+    // Sum of the colors of all the passes.
+    Image accumulated(width, height);
+    const vector<ImageTile> tiles = SplitInTiles(accumulated);
+    // Running mean and sum of squared differences of the luminance of every pixel, to estimate its noise.
+    vector<float> means(width * height, 0.0f), squaredDifferences(width * height, 0.0f);
+
+    // Mean of all the passes rendered so far.
+    const auto average = [&accumulated, width, height](const unsigned int passes)
+    {
+        unique_ptr<Image> image = make_unique<Image>(width, height);
+        for (unsigned int i = 0; i < height; ++i)
+        {
+            const ConstImageRow source = static_cast<const Image &>(accumulated)[i];
+            const ImageRow destination = (*image)[i];
+            for (unsigned int j = 0; j < width; ++j) destination[j] = source[j] / passes;
+        }
+        return image;
+    };
+
+    unsigned int passes = 0;
+    float lastPassSeconds = 0.0f;
+    while (settings.maxPasses == 0 || passes < settings.maxPasses)
+    {
+        const Clock::time_point passStart = Clock::now();
+        RenderInParallel(tiles, threadCount, false, [&](const ImageTile &tile)
+        {
+            RenderPass(tile, passes, means, squaredDifferences);
+        });
+        ++passes;
+        const Clock::time_point now = Clock::now();
+        const float elapsed = chrono::duration<float>(now - start).count();
+        lastPassSeconds = chrono::duration<float>(now - passStart).count();
+
+        // Mean relative standard error of the pixels, needs at least two samples.
+        float noise = FLT_MAX;
+        if (passes > 1)
+        {
+            double noiseSum = 0.0;
+            for (unsigned int p = 0; p < width * height; ++p)
+            {
+                const float variance = squaredDifferences[p] / (passes - 1);
+                noiseSum += sqrt(variance / passes) / max(means[p], 1e-3f);
+            }
+            noise = static_cast<float>(noiseSum / (width * height));
+        }
+        cout << "Pass " << passes << " (" << elapsed << " s)";
+        if (passes > 1) cout << ", noise " << noise;
+        cout << "        \r" << flush;
+
+        if (settings.targetNoise > 0 && noise <= settings.targetNoise) break;
+        // Don't start a pass that would end after the budget.
+        if (settings.timeBudget > 0 && elapsed + lastPassSeconds > settings.timeBudget) break;
+
+        if (snapshot && settings.snapshotInterval > 0 &&
+            chrono::duration<float>(now - lastSnapshot).count() >= settings.snapshotInterval)
+        {
+            snapshot(*average(passes), passes);
+            lastSnapshot = now;
+        }
+    }
+    cout << '\n';
 
-    vector<shared_ptr<vector<unsigned int>>> linesPerThread(threadCount);
+    return average(passes);
+}
 
-    // Initialize all line vectors.
-    for (unsigned int i = 0; i < threadCount; ++i){
-        linesPerThread[i] = make_shared<vector<unsigned int>>(0);
+void Scene::SetRenderRegion(const unsigned int x, const unsigned int y,
+                            const unsigned int width, const unsigned int height)
+{
+    if (width == 0 || height == 0 || x + width > mCamera->GetWidth() || y + height > mCamera->GetHeight())
+    {
+        throw invalid_argument("The region to render must be inside the image");
     }
+    mRegionX = x;
+    mRegionY = y;
+    mRegionWidth = width;
+    mRegionHeight = height;
+}
+
+unsigned int Scene::GetRegionWidth() const
+{
+    return mRegionWidth > 0 ? mRegionWidth : mCamera->GetWidth();
+}
 
-    // Fill all line vectors.
-    for (unsigned int i = 0; i < mCamera->GetHeight(); ++i)
+unsigned int Scene::GetRegionHeight() const
+{
+    return mRegionHeight > 0 ? mRegionHeight : mCamera->GetHeight();
+}
+
+vector<ImageTile> Scene::SplitInTiles(Image &image)
+{
+    // Square tiles. Their size is a multiple of Image::TILE_ALIGNMENT so two threads never write into the same cache
+    // line.
+    vector<ImageTile> tiles;
+    for (unsigned int y = 0; y < image.GetHeight(); y += TILE_SIZE)
     {
-        linesPerThread[i % threadCount]->push_back(i);
+        for (unsigned int x = 0; x < image.GetWidth(); x += TILE_SIZE)
+        {
+            tiles.push_back(image.GetTile(x, y, TILE_SIZE, TILE_SIZE));
+        }
     }
+    return tiles;
+}
+
+void Scene::RenderInParallel(const vector<ImageTile> &tiles, const unsigned int threadCount, const bool printProgress,
+                             const function<void(const ImageTile &)> &renderTile) const
+{
+    // Index of the next tile that hasn't been taken by any thread yet.
+    atomic<unsigned int> nextTile(0);
 
-    // Start printing the progress bar at 0% completion
-    printProgressBar(0, 1);
     vector<thread> threads(threadCount);
-    // Initialize and start threads. Each thread will render the lines in their corresponding vector.
+    // Initialize and start threads. Each thread will take tiles from the list until there are no more left.
     for (unsigned int i = 0; i < threadCount; ++i)
     {
-        // j == 0 because only the first thread will print the progress bar.
-        threads[i] = thread(&Scene::RenderPixelRange, this, linesPerThread[i], image, i == 0);
+        // i == 0 because only the first thread will print the progress bar.
+        threads[i] = thread(&Scene::RenderTiles, this, cref(tiles), ref(nextTile), i, printProgress && i == 0,
+                            cref(renderTile));
     }
 
-    // Wait for all threads to end rendering their lines.
+    // Wait for all threads to end rendering their tiles.
     for (unsigned int i = 0; i < threadCount; ++i)
     {
         threads[i].join();
     }
+}
 
-    printProgressBar(1, 1);
+void Scene::RenderTiles(const vector<ImageTile> &tiles, atomic<unsigned int> &nextTile, const unsigned int threadIndex,
+                        const bool printProgress, const function<void(const ImageTile &)> &renderTile) const
+{
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if (Trace::IsEnabled()) Trace::SetThreadName("render " + to_string(threadIndex));
+    for (unsigned int tile = nextTile++; tile < tiles.size(); tile = nextTile++)
+    {
+        {
+            const TraceScope scope("tile", Trace::IsEnabled() ? to_string(tiles[tile].GetX()) + ',' +
+                                                                 to_string(tiles[tile].GetY()) : "");
+            renderTile(tiles[tile]);
+        }
+        RenderStats::Count(TILES_RENDERED);
+        if (printProgress) printProgressBar(tile, static_cast<unsigned int>(tiles.size()));
+    }
+    RenderStats::FlushThread("render " + to_string(threadIndex),
+                             chrono::duration<double>(chrono::steady_clock::now() - start).count());
+}
 
-    return make_unique<Image>(*image);
+/**
+ * Seeds the random generator of the calling thread for a tile, so the random values drawn while rendering it don't
+ * depend on the thread that renders it.
+ *
+ * @param x Column of the tile's upper-left pixel in the image.
+ * @param y Row of the tile's upper-left pixel in the image.
+ * @param pass Pass of a progressive render, 0 for any other render.
+ */
+static void SeedTile(const unsigned int x, const unsigned int y, const unsigned int pass)
+{
+    SeedRandomStream(HashInteger(x ^ HashInteger(y ^ HashInteger(pass))));
 }
 
-void Scene::RenderPixelRange(const shared_ptr<vector<unsigned int>> horizontalLines,
-                             const shared_ptr<Image> image, const bool printProgress) const
+void Scene::RenderPass(const ImageTile &tile, const unsigned int pass,
+                       vector<float> &means, vector<float> &squaredDifferences) const
 {
-    // The current pixel. We begin with the first one (0,0).
+    SeedTile(mRegionX + tile.GetX(), mRegionY + tile.GetY(), pass);
+    const Point firstPixel = mCamera->GetFirstPixel();
+    Vect advanceX(mCamera->GetRight() * mCamera->GetPixelSize());
+    Vect advanceY(mCamera->GetUp() * mCamera->GetPixelSize());
+    for (unsigned int i = 0; i < tile.GetHeight(); ++i)
+    {
+        const ImageRow row = tile[i];
+        const unsigned int y = mRegionY + tile.GetY() + i;
+        // Same pixel centers as RenderPixelRange.
+        Point currentPixel = firstPixel - advanceY * y + advanceX * (mRegionX + tile.GetX());
+        for (unsigned int j = 0; j < tile.GetWidth(); ++j)
+        {
+            currentPixel += advanceX;
+            const unsigned int x = mRegionX + tile.GetX() + j;
+            float offsetX, offsetY;
+            tie(offsetX, offsetY) = PixelSampleOffset(x, y, pass);
+            const Point sample = currentPixel + advanceX * offsetX - advanceY * offsetY;
+            const Color color = GetLightRayColor(LightRay(mCamera->GetFocalPoint(), sample), mSpecularSteps);
+            row[j] += color;
+
+            // Welford's update of the luminance statistics of the pixel.
+            const unsigned int pixel = (tile.GetY() + i) * GetRegionWidth() + tile.GetX() + j;
+            const float luminance = 0.2126f * color.GetR() + 0.7152f * color.GetG() + 0.0722f * color.GetB();
+            const float delta = luminance - means[pixel];
+            means[pixel] += delta / (pass + 1);
+            squaredDifferences[pixel] += delta * (luminance - means[pixel]);
+        }
+    }
+}
+
+void Scene::RenderPixelRange(const ImageTile &tile, const ImageTile *heatmap, const HeatmapMetric metric) const
+{
+    SeedTile(mRegionX + tile.GetX(), mRegionY + tile.GetY(), 0);
+    // The upper-left pixel of the image.
     const Point firstPixel = mCamera->GetFirstPixel();
     // Pixels' distance in the camera intrinsics right and up.
     Vect advanceX(mCamera->GetRight() * mCamera->GetPixelSize());
     Vect advanceY(mCamera->GetUp() * mCamera->GetPixelSize());
-    // The first pixel of the current row.
+    // The current pixel.
     Point currentPixel;
-    // For all the pixels, trace a ray of light.
-    for (unsigned int i = 0; i < horizontalLines->size(); ++i)
+    // For all the pixels in the tile, trace a ray of light.
+    for (unsigned int i = 0; i < tile.GetHeight(); ++i)
     {
-        currentPixel = firstPixel - advanceY * (*horizontalLines)[i];
-        for (unsigned int j = 0; j < mCamera->GetWidth(); ++j)
+        const ImageRow row = tile[i];
+        // Tiles are relative to the rendered region, which may not begin at the image's first pixel.
+        const unsigned int y = mRegionY + tile.GetY() + i;
+        currentPixel = firstPixel - advanceY * y + advanceX * (mRegionX + tile.GetX());
+        for (unsigned int j = 0; j < tile.GetWidth(); ++j)
         {
             // Next pixel.
             currentPixel += advanceX;
+            const double costBefore = heatmap != nullptr ? MeasureCost(metric) : 0.0;
             // Get the color for the current pixel.
-            (*image)[(*horizontalLines)[i]][j] = GetLightRayColor(
-                    LightRay(mCamera->GetFocalPoint(), currentPixel), mSpecularSteps);
+            if (mSamplesPerPixel == 1 && mAdaptiveThreshold <= 0)
+            {
+                row[j] = GetLightRayColor(LightRay(mCamera->GetFocalPoint(), currentPixel), mSpecularSteps);
+            }
+            else
+            {
+                row[j] = SamplePixel(currentPixel, advanceX, advanceY, mRegionX + tile.GetX() + j, y);
+            }
+            if (heatmap != nullptr)
+            {
+                const float cost = static_cast<float>(MeasureCost(metric) - costBefore);
+                (*heatmap)[i][j] = Color(cost, cost, cost);
+            }
+        }
+    }
+}
+
+Color Scene::SamplePixel(const Point &center, const Vect &advanceX, const Vect &advanceY,
+                         const unsigned int x, const unsigned int y) const
+{
+    const bool adaptive = mAdaptiveThreshold > 0;
+    // Samples taken in every round, the variance is checked after each one.
+    const unsigned int roundSamples = adaptive ? max(mSamplesPerPixel, MIN_ADAPTIVE_SAMPLES) : mSamplesPerPixel;
+    const unsigned int maxSamples = adaptive ? max(mMaxSamplesPerPixel, roundSamples) : roundSamples;
+
+    Color sum = BLACK;
+    // Running mean and sum of squared differences of the samples' luminance (Welford's algorithm).
+    float mean = 0.0f, squaredDifferences = 0.0f;
+    unsigned int samples = 0;
+    while (samples < maxSamples)
+    {
+        const unsigned int roundEnd = min(samples + roundSamples, maxSamples);
+        for (; samples < roundEnd; ++samples)
+        {
+            float offsetX, offsetY;
+            tie(offsetX, offsetY) = PixelSampleOffset(x, y, samples);
+            const Point sample = center + advanceX * offsetX - advanceY * offsetY;
+            const Color color = GetLightRayColor(LightRay(mCamera->GetFocalPoint(), sample), mSpecularSteps);
+            sum += color;
+
+            const float luminance = 0.2126f * color.GetR() + 0.7152f * color.GetG() + 0.0722f * color.GetB();
+            const float delta = luminance - mean;
+            mean += delta / (samples + 1);
+            squaredDifferences += delta * (luminance - mean);
         }
-        if (printProgress) printProgressBar(i, static_cast<unsigned int>(horizontalLines->size()));
+        if (!adaptive) break;
+
+        // Stop when the standard error of the mean is small relative to the mean itself.
+        const float variance = squaredDifferences / (samples - 1);
+        const float threshold = mAdaptiveThreshold * max(mean, 1e-3f);
+        if (variance / samples <= threshold * threshold) break;
     }
+    return sum / samples;
 }
 
 void Scene::EmitPhotons()
 {
+    const TraceScope scope("EmitPhotons");
+    TracePhotons();
+    BalancePhotonMaps();
+}
+
+void Scene::TracePhotons()
+{
+    const PhaseTimer timer(PHOTON_TRACING);
+    // Cells of a grid over the space that contain points seen by the camera.
+    unordered_set<uint64_t> visibleCells;
+    float cellSize = 1.0f;
+    const auto cellKey = [&cellSize](const Point &point)
+    {
+        const auto coordinate = [&cellSize](const float value)
+        {
+            return static_cast<uint64_t>(static_cast<int64_t>(floor(value / cellSize))) & 0x1FFFFF;
+        };
+        return coordinate(point.GetX()) << 42 | coordinate(point.GetY()) << 21 | coordinate(point.GetZ());
+    };
+    const function<bool(const Point &)> isVisible = [&visibleCells, &cellKey](const Point &point)
+    {
+        return visibleCells.count(cellKey(point)) > 0;
+    };
+
+    if (mImportanceSampling)
+    {
+        // Trace a coarse grid of camera rays.
+        const unsigned int stride = max(1u, max(mCamera->GetWidth(), mCamera->GetHeight()) / IMPORTANCE_RAYS);
+        const Vect advanceX(mCamera->GetRight() * (mCamera->GetPixelSize() * stride));
+        const Vect advanceY(mCamera->GetUp() * (mCamera->GetPixelSize() * stride));
+        vector<pair<Point, float>> visible;
+        for (unsigned int i = 0; i < mCamera->GetHeight(); i += stride)
+        {
+            Point currentPixel = mCamera->GetFirstPixel() - advanceY * (i / stride);
+            for (unsigned int j = 0; j < mCamera->GetWidth(); j += stride, currentPixel += advanceX)
+            {
+                TraceVisiblePoints(LightRay(mCamera->GetFocalPoint(), currentPixel), mSpecularSteps, 0.0f, visible);
+            }
+        }
+
+        // Cells twice as big as the usual distance between neighbour visible points, so they leave no gaps.
+        if (!visible.empty())
+        {
+            vector<float> widths;
+            for (const pair<Point, float> &point : visible) widths.push_back(point.second);
+            nth_element(widths.begin(), widths.begin() + widths.size() / 2, widths.end());
+            cellSize = max(2 * stride * widths[widths.size() / 2], 1e-6f);
+        }
+        for (const pair<Point, float> &point : visible) visibleCells.insert(cellKey(point.first));
+    }
+
     // Emit photons from each light source.
-    for (shared_ptr<LightSource> light : mLightSources)
+    const EmissionPlanner planner(mLightSources, mPhotonsEmitted);
+    for (unsigned int lightIndex = 0; lightIndex < mLightSources.size(); ++lightIndex)
     {
-        for (Point pointLight : light->GetLights())
+        const shared_ptr<LightSource> &light = mLightSources[lightIndex];
+        const vector<Point> lightPoints = light->GetLights();
+        // Without importance sampling the map is uniform.
+        const EmissionMap emissionMap = mImportanceSampling ? BuildEmissionMap(*light, isVisible) : EmissionMap();
+        for (unsigned int pointIndex = 0; pointIndex < lightPoints.size(); ++pointIndex)
         {
-            /* Transformation matrix from the local coordinates with [point] as the
-             * reference point, and [0,0,1] as the z axis, to global coordinates. */
-            PoseTransformationMatrix fromLocalToGlobal =
-                    PoseTransformationMatrix::GetPoseTransformation(pointLight, Vect(0,0,1));
-            // [mPhotonsEmitted] photons uniformly emitted.
-            for (unsigned int i = 0; i < mPhotonsEmitted / light->GetLights().size() / mLightSources.size(); i++)
+            const Point &pointLight = lightPoints[pointIndex];
+            const Color flux = planner.GetFlux(lightIndex, pointIndex);
+            // The share of the [mPhotonsEmitted] photons planned for this point.
+            for (unsigned int i = 0; i < planner.GetPhotons(lightIndex, pointIndex); i++)
             {
-                // Generate random angles.
-                float inclination, azimuth;
-                tie(inclination, azimuth) = UniformSphereSampling();
-                // Direction of the ray of light expressed in local coordinates.
-                Vect localRay(sin(inclination) * cos(azimuth),
-                              sin(inclination) * sin(azimuth),
-                              cos(inclination));
-                // Transform the ray of light to global coordinates.
-                ColoredLightRay lightRay(pointLight, fromLocalToGlobal * localRay,
-                                         light->GetBaseColor() / mPhotonsEmitted / light->GetLights().size() * 4 * PI);
+                Vect direction;
+                // Weight of the photon, the ratio between the uniform and the actual probability of its direction.
+                float weight = 1.0f;
+                if (mImportanceSampling)
+                {
+                    const float cellValue = GetRandomValue(), u = GetRandomValue();
+                    tie(direction, weight) = emissionMap.Sample(cellValue, u, GetRandomValue());
+                }
+                else
+                {
+                    // Generate random angles. A uniform direction in the sphere needs no local coordinates.
+                    float inclination, azimuth;
+                    tie(inclination, azimuth) = UniformSphereSampling();
+                    direction = Vect(sin(inclination) * cos(azimuth),
+                                     sin(inclination) * sin(azimuth),
+                                     cos(inclination));
+                }
+                ColoredLightRay lightRay(pointLight, direction, flux * weight);
                 /* The photons directly emitted from the light sources (direct light)
                  * are not saved in the photon map. */
-                PhotonInteraction(lightRay, false, false);
+                PhotonInteraction(PhotonPath{lightRay, 0, false, false, true});
             }
         }
     }
+
+    // Photons for the sharp caustics, only towards the directions of every light that hit caustic casting shapes.
+    mEmittingCaustics = true;
+    if (mCausticPhotonsEmitted > 0)
+    {
+        // The caustic photons are only planned for the lights that cast caustics.
+        vector<shared_ptr<LightSource>> causticLights;
+        vector<EmissionMap> projectionMaps;
+        for (const shared_ptr<LightSource> &light : mLightSources)
+        {
+            unsigned int markedCells;
+            EmissionMap projectionMap = BuildProjectionMap(*light, markedCells);
+            if (markedCells == 0) continue;
+            causticLights.push_back(light);
+            projectionMaps.push_back(move(projectionMap));
+        }
+        const EmissionPlanner causticPlanner(causticLights, mCausticPhotonsEmitted);
+        for (unsigned int lightIndex = 0; lightIndex < causticLights.size(); ++lightIndex)
+        {
+            const vector<Point> lightPoints = causticLights[lightIndex]->GetLights();
+            for (unsigned int pointIndex = 0; pointIndex < lightPoints.size(); ++pointIndex)
+            {
+                const Color flux = causticPlanner.GetFlux(lightIndex, pointIndex);
+                for (unsigned int i = 0; i < causticPlanner.GetPhotons(lightIndex, pointIndex); i++)
+                {
+                    Vect direction;
+                    // The weight is the fraction of the sphere covered by the marked cells.
+                    float weight;
+                    const float cellValue = GetRandomValue(), u = GetRandomValue();
+                    tie(direction, weight) = projectionMaps[lightIndex].Sample(cellValue, u, GetRandomValue());
+                    ColoredLightRay lightRay(lightPoints[pointIndex], direction, flux * weight);
+                    PhotonInteraction(PhotonPath{lightRay, 0, false, false, true});
+                }
+            }
+        }
+    }
+    mEmittingCaustics = false;
+}
+
+void Scene::BalancePhotonMaps()
+{
+    const PhaseTimer timer(PHOTON_BALANCE);
     mDiffusePhotonMap.Balance();
     mCausticsPhotonMap.Balance();
     for (tuple<shared_ptr<ParticipatingMedia>, KDTree> &mediaKDTree : mMediaPhotonMaps)
         get<1>(mediaKDTree).Balance();
 }
 
-void Scene::PhotonInteraction(const ColoredLightRay &lightRay, const bool save, bool fromCausticShape)
+HitRecord Scene::NearestHit(const LightRay &lightRay) const
 {
-    // Distance to the nearest shape and the nearest media.
-    float minT_Shape = FLT_MAX, minT_Media = FLT_MAX;
-    // Nearest shape and media intersected with the ray of light.
-    shared_ptr<Shape> nearestShape = nullptr;
-    shared_ptr<ParticipatingMedia> nearestMedia = nullptr;
+    RenderStats::Count(INTERSECTION_TESTS, mShapes.size());
+    HitRecord hit;
+    for (const shared_ptr<Shape> &shape : mShapes)
+        shape->Intersect(lightRay, hit);
+    return hit;
+}
 
-    /* Intersect with all the shapes in the
-     * scene to know which one is the nearest. */
-    for (unsigned int i = 0; i < mShapes.size(); ++i)
-        mShapes.at(i)->Intersect(lightRay, minT_Shape, nearestShape, mShapes.at(i));
+void Scene::TraceVisiblePoints(const LightRay &lightRay, const int specularSteps, const float distance,
+                               vector<pair<Point, float>> &visible) const
+{
+    if (specularSteps == 0) return;
+    HitRecord hit = NearestHit(lightRay);
+    if (hit.shape == nullptr) return;
+    hit.shape->FillHitRecord(lightRay, hit);
 
-    /* Intersect with all the medias in the
-     * scene to know which one is the nearest. */
-    for (unsigned int i = 0; i < mMedia.size(); ++i)
+    const float travelled = distance + hit.t;
+    if (hit.diffuse != BLACK)
     {
-        float previousMinT = minT_Media;
-        mMedia.at(i)->Intersect(lightRay, minT_Media);
-        if (minT_Media < previousMinT) nearestMedia = mMedia.at(i);
+        visible.push_back(make_pair(hit.point, mCamera->GetFootprint(travelled)));
     }
 
-    // No shape and no media have been found.
-    if ((minT_Shape == FLT_MAX) & (minT_Media == FLT_MAX)) return;
+    if ((hit.reflectance != BLACK) | (hit.specular != BLACK))
+    {
+        TraceVisiblePoints(LightRay(hit.point, Shape::Reflect(lightRay.GetDirection(), hit.visibleNormal)),
+                           specularSteps - 1, travelled, visible);
+    }
+    if (hit.transmittance != BLACK)
+    {
+        TraceVisiblePoints(hit.shape->Refract(lightRay, hit), specularSteps - 1, travelled, visible);
+    }
+}
+
+float Scene::ProbeImportance(const LightRay &lightRay, const function<bool(const Point &)> &isVisible) const
+{
+    HitRecord hit = NearestHit(lightRay);
+    if (hit.shape == nullptr) return 0.0f;
+    LightRay ray = lightRay;
+    hit.shape->FillHitRecord(ray, hit);
+
+    // Follow the specular bounces of the photon, the most likely one at each of them.
+    bool caustic = false;
+    for (unsigned int step = 0; hit.diffuse == BLACK; ++step)
+    {
+        if (step == mSpecularSteps) return 0.0f;
+        if (hit.transmittance.MeanRGB() > hit.reflectance.MeanRGB() + hit.specular.MeanRGB())
+            ray = hit.shape->Refract(ray, hit);
+        else
+            ray = LightRay(hit.point, Shape::Reflect(ray.GetDirection(), hit.visibleNormal));
+        hit = NearestHit(ray);
+        if (hit.shape == nullptr) return 0.0f;
+        hit.shape->FillHitRecord(ray, hit);
+        caustic = true;
+    }
+    const Point &intersection = hit.point;
+    // Caustic photons are stored where they land.
+    if (caustic) return isVisible(intersection) ? 1.0f : 0.0f;
+
+    // Direct light isn't stored, photons that hit a diffuse surface are stored after their next bounce.
+    static constexpr unsigned int BOUNCES = 2;
+    const Frame frame(hit.visibleNormal);
+    unsigned int visibleBounces = 0;
+    for (unsigned int i = 0; i < BOUNCES; ++i)
+    {
+        float inclination, azimuth;
+        tie(inclination, azimuth) = UniformCosineSampling();
+        const Vect localRay(sin(inclination) * cos(azimuth), sin(inclination) * sin(azimuth), cos(inclination));
+        const LightRay bounce(intersection, frame.ToWorld(localRay));
+        const HitRecord bounceHit = NearestHit(bounce);
+        if (bounceHit.shape != nullptr && isVisible(bounce.GetPoint(bounceHit.t))) ++visibleBounces;
+    }
+    return static_cast<float>(visibleBounces) / BOUNCES;
+}
+
+EmissionMap Scene::BuildEmissionMap(const LightSource &light, const function<bool(const Point &)> &isVisible) const
+{
+    EmissionMap emissionMap;
+    const vector<Point> lights = light.GetLights();
+    // Probes are stratified inside every cell.
+    const unsigned int side = static_cast<unsigned int>(ceil(sqrt(static_cast<float>(IMPORTANCE_PROBES))));
+    for (unsigned int cell = 0; cell < emissionMap.GetCellCount(); ++cell)
+    {
+        float importance = 0.0f;
+        for (unsigned int probe = 0; probe < IMPORTANCE_PROBES; ++probe)
+        {
+            const float u = (probe % side + GetRandomValue()) / side, v = (probe / side + GetRandomValue()) / side;
+            const Point &origin = lights[min(static_cast<size_t>(GetRandomValue() * lights.size()),
+                                             lights.size() - 1)];
+            importance += ProbeImportance(LightRay(origin, emissionMap.GetDirection(cell, u, v)), isVisible);
+        }
+        emissionMap.SetImportance(cell, importance / IMPORTANCE_PROBES);
+    }
+    emissionMap.Build();
+    return emissionMap;
+}
 
-    // Is the ray of light inside the media?
-    bool isInside = false;
-    float nextInteraction = minT_Media;
-    float meanFreePath = 0;
-    // There is at least one participating media.
-    if (nearestMedia != nullptr)
+/**
+ * @param camera Camera of a scene.
+ * @return Hash of the camera's position, orientation, view plane and image size.
+ */
+static uint64_t HashCamera(const Camera &camera)
+{
+    uint64_t hash = HashValue(camera.GetWidth());
+    hash = HashValue(camera.GetHeight(), hash);
+    hash = HashValue(camera.GetPixelSize(), hash);
+    for (const Point &point : {camera.GetFocalPoint(), camera.GetFirstPixel()})
+    {
+        hash = HashValue(point.GetX(), hash);
+        hash = HashValue(point.GetY(), hash);
+        hash = HashValue(point.GetZ(), hash);
+    }
+    for (const Vect &vect : {camera.GetUp(), camera.GetRight(), camera.GetTowards()})
+    {
+        hash = HashValue(vect.GetX(), hash);
+        hash = HashValue(vect.GetY(), hash);
+        hash = HashValue(vect.GetZ(), hash);
+    }
+    return hash;
+}
+
+bool Scene::SavePhotonMaps(const string &filename, const uint64_t sceneHash, const uint64_t seed) const
+{
+    const PhaseTimer timer(PHOTON_MAP_IO);
+    vector<const KDTree *> maps = {&mDiffusePhotonMap, &mCausticsPhotonMap};
+    for (const tuple<shared_ptr<ParticipatingMedia>, KDTree> &mediaKDTree : mMediaPhotonMaps)
+        maps.push_back(&get<1>(mediaKDTree));
+
+    PhotonMapsHeader header = {};
+    memcpy(header.magic, PHOTON_MAPS_MAGIC, sizeof(PHOTON_MAPS_MAGIC));
+    header.version = PHOTON_MAPS_VERSION;
+    header.sceneHash = sceneHash;
+    header.seed = seed;
+    header.photonsEmitted = mPhotonsEmitted;
+    header.causticPhotonsEmitted = mCausticPhotonsEmitted;
+    header.mapCount = static_cast<uint32_t>(maps.size());
+    header.nodeSize = sizeof(Node);
+    // With importance sampling the photons are emitted towards what the camera sees.
+    header.importanceSampling = mImportanceSampling;
+    header.cameraHash = mImportanceSampling ? HashCamera(*mCamera) : 0;
+
+    ofstream file(filename, ios::binary);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const KDTree *map : maps)
     {
-        meanFreePath = nearestMedia->GetNextInteraction();
-        isInside = nearestMedia->IsInside(lightRay.GetSource());
-        // Next mean-free path
-        if (isInside) nextInteraction = meanFreePath;
-        // Next mean-free path after going into the media.
-        else nextInteraction += meanFreePath;
+        const uint32_t size = map->Size();
+        file.write(reinterpret_cast<const char *>(&size), sizeof(size));
     }
+    for (const KDTree *map : maps) map->WriteBinary(file);
+    file.close();
+    return file.good();
+}
 
-    // The shape is closer than the media, intersect directly with the shape.
-    if (minT_Shape <= minT_Media)
+bool Scene::LoadPhotonMaps(const string &filename, const uint64_t sceneHash, const uint64_t seed)
+{
+    const PhaseTimer timer(PHOTON_MAP_IO);
+    if (MappedFile::GetModificationTime(filename) < 0)
+    {
+        cerr << "Can't find the photon maps file " << filename << '\n';
+        return false;
+    }
+    shared_ptr<MappedFile> file = make_shared<MappedFile>(filename);
+    const char *data = file->GetData();
+    const PhotonMapsHeader *header = reinterpret_cast<const PhotonMapsHeader *>(data);
+    const uint32_t mapCount = static_cast<uint32_t>(2 + mMediaPhotonMaps.size());
+
+    if (file->GetSize() < sizeof(PhotonMapsHeader) + mapCount * sizeof(uint32_t) ||
+        memcmp(header->magic, PHOTON_MAPS_MAGIC, sizeof(PHOTON_MAPS_MAGIC)) != 0 ||
+        header->version != PHOTON_MAPS_VERSION || header->nodeSize != sizeof(Node))
+    {
+        cerr << filename << " isn't a valid photon maps file\n";
+        return false;
+    }
+    if (header->sceneHash != sceneHash || header->mapCount != mapCount)
+    {
+        cerr << "The photon maps in " << filename << " belong to another scene\n";
+        return false;
+    }
+    if (header->photonsEmitted != mPhotonsEmitted || header->causticPhotonsEmitted != mCausticPhotonsEmitted)
     {
-        GeometryInteraction(lightRay, nearestShape, lightRay.GetPoint(minT_Shape), save, fromCausticShape);
+        cerr << "The photon maps in " << filename << " have " << header->photonsEmitted << " photons and "
+             << header->causticPhotonsEmitted << " caustic photons, not " << mPhotonsEmitted << " and "
+             << mCausticPhotonsEmitted << '\n';
+        return false;
     }
-    // The media is closer than the shape.
-    else  // minT_Shape > minT_Media
+    if (header->importanceSampling != static_cast<uint32_t>(mImportanceSampling))
+    {
+        cerr << "The photon maps in " << filename << " were emitted "
+             << (header->importanceSampling ? "with" : "without") << " importance sampling\n";
+        return false;
+    }
+    if (mImportanceSampling && header->cameraHash != HashCamera(*mCamera))
+    {
+        cerr << "The photon maps in " << filename << " were emitted with importance sampling for another camera or "
+             << "image size\n";
+        return false;
+    }
+    // Photons emitted with another seed are as valid, but renders with them can't be reproduced with this seed.
+    if (header->seed != seed)
+    {
+        cout << "The photon maps in " << filename << " were emitted "
+             << (header->seed == ~0ull ? "without a seed" : "with the seed " + to_string(header->seed)) << '\n';
+    }
+
+    const uint32_t *sizes = reinterpret_cast<const uint32_t *>(data + sizeof(PhotonMapsHeader));
+    size_t expectedSize = sizeof(PhotonMapsHeader) + mapCount * sizeof(uint32_t);
+    for (uint32_t i = 0; i < mapCount; ++i) expectedSize += sizes[i] * sizeof(Node);
+    if (file->GetSize() != expectedSize)
+    {
+        cerr << "The photon maps file " << filename << " is truncated\n";
+        return false;
+    }
+
+    vector<KDTree *> maps = {&mDiffusePhotonMap, &mCausticsPhotonMap};
+    for (tuple<shared_ptr<ParticipatingMedia>, KDTree> &mediaKDTree : mMediaPhotonMaps)
+        maps.push_back(&get<1>(mediaKDTree));
+    const Node *nodes = reinterpret_cast<const Node *>(sizes + mapCount);
+    for (uint32_t i = 0; i < mapCount; ++i)
+    {
+        maps[i]->Clear();
+        maps[i]->SetBalanced(file, nodes, sizes[i]);
+        nodes += sizes[i];
+    }
+    return true;
+}
+
+EmissionMap Scene::BuildProjectionMap(const LightSource &light, unsigned int &markedCells) const
+{
+    EmissionMap projectionMap(PROJECTION_MAP_ROWS, 2 * PROJECTION_MAP_ROWS);
+    const unsigned int rows = PROJECTION_MAP_ROWS, columns = 2 * PROJECTION_MAP_ROWS;
+    const vector<Point> lights = light.GetLights();
+    const unsigned int side = static_cast<unsigned int>(ceil(sqrt(static_cast<float>(IMPORTANCE_PROBES))));
+
+    // Cells with any probe hitting a shape that reflects or refracts light.
+    vector<char> hits(projectionMap.GetCellCount(), 0);
+    for (unsigned int cell = 0; cell < projectionMap.GetCellCount(); ++cell)
+    {
+        for (unsigned int probe = 0; probe < IMPORTANCE_PROBES && !hits[cell]; ++probe)
+        {
+            const float u = (probe % side + GetRandomValue()) / side, v = (probe / side + GetRandomValue()) / side;
+            const Point &origin = lights[min(static_cast<size_t>(GetRandomValue() * lights.size()),
+                                             lights.size() - 1)];
+            const HitRecord hit = NearestHit(LightRay(origin, projectionMap.GetDirection(cell, u, v)));
+            if (hit.shape == nullptr) continue;
+            const shared_ptr<Material> material = hit.shape->GetMaterial();
+            hits[cell] = (material->GetSpecular() != BLACK) | (material->GetReflectance() != BLACK) |
+                         (material->GetTransmittance() != BLACK);
+        }
+    }
+
+    // Mark also the neighbours of those cells, so the edges of the shapes aren't missed between probes.
+    markedCells = 0;
+    for (unsigned int row = 0; row < rows; ++row)
+    {
+        for (unsigned int column = 0; column < columns; ++column)
+        {
+            bool marked = false;
+            for (int i = -1; i <= 1; ++i)
+            {
+                const int neighbourRow = static_cast<int>(row) + i;
+                if (neighbourRow < 0 || neighbourRow >= static_cast<int>(rows)) continue;
+                for (int j = -1; j <= 1; ++j)
+                {
+                    // The azimuth wraps around.
+                    const unsigned int neighbourColumn = (column + columns + j) % columns;
+                    marked |= hits[neighbourRow * columns + neighbourColumn] != 0;
+                }
+            }
+            projectionMap.SetImportance(row * columns + column, marked ? 1.0f : 0.0f);
+            markedCells += marked;
+        }
+    }
+    // Cells that aren't marked are never sampled.
+    projectionMap.Build(0.0f);
+    return projectionMap;
+}
+
+void Scene::PhotonInteraction(PhotonPath path)
+{
+    while (path.depth < MAX_PHOTON_BOUNCES)
     {
-        // We are exiting the media.
-        if (isInside & (nextInteraction > minT_Media))
+        RenderStats::Count(PHOTON_RAYS);
+        const ColoredLightRay &lightRay = path.ray;
+        /* Intersect with all the shapes in the
+         * scene to know which one is the nearest. */
+        HitRecord hit = NearestHit(lightRay);
+        // Distance to the nearest shape and the nearest media.
+        const float minT_Shape = hit.t;
+        float minT_Media = FLT_MAX;
+        // Nearest media intersected with the ray of light.
+        const ParticipatingMedia *nearestMedia = nullptr;
+
+        /* Intersect with all the medias in the
+         * scene to know which one is the nearest. */
+        for (unsigned int i = 0; i < mMedia.size(); ++i)
+        {
+            float previousMinT = minT_Media;
+            mMedia[i]->Intersect(lightRay, minT_Media);
+            if (minT_Media < previousMinT) nearestMedia = mMedia[i].get();
+        }
+
+        // No shape and no media have been found.
+        if ((minT_Shape == FLT_MAX) & (minT_Media == FLT_MAX)) return;
+
+        // Is the ray of light inside the media?
+        bool isInside = false;
+        float nextInteraction = minT_Media;
+        float meanFreePath = 0;
+        // There is at least one participating media.
+        if (nearestMedia != nullptr)
+        {
+            meanFreePath = nearestMedia->GetNextInteraction();
+            isInside = nearestMedia->IsInside(lightRay.GetSource());
+            // Next mean-free path
+            if (isInside) nextInteraction = meanFreePath;
+            // Next mean-free path after going into the media.
+            else nextInteraction += meanFreePath;
+        }
+
+        bool isAlive;
+        // The shape is closer than the media, intersect directly with the shape.
+        if (minT_Shape <= minT_Media)
         {
-            ColoredLightRay out(lightRay.GetPoint(minT_Media), lightRay.GetDirection(), lightRay.GetColor());
-            PhotonInteraction(out, save, fromCausticShape);
+            hit.shape->FillHitRecord(lightRay, hit);
+            isAlive = GeometryInteraction(path, hit);
+        }
+        // We are exiting the media, the photon goes on from its border.
+        else if (isInside & (nextInteraction > minT_Media))
+        {
+            path.ray = ColoredLightRay(lightRay.GetPoint(minT_Media), lightRay.GetDirection(), lightRay.GetColor());
+            continue;
         }
         // We remain in the media.
         else
         {
-            MediaInteraction(lightRay, nearestMedia, lightRay.GetPoint(nextInteraction), meanFreePath);
+            isAlive = MediaInteraction(path, *nearestMedia, lightRay.GetPoint(nextInteraction), meanFreePath);
         }
+        if (!isAlive) return;
+        ++path.depth;
     }
 }
 
-void Scene::GeometryInteraction(const ColoredLightRay &lightRay, const shared_ptr<Shape> &shape,
-                                const Point &intersection, bool save, bool fromCausticShape)
+bool Scene::GeometryInteraction(PhotonPath &path, const HitRecord &hit)
 {
+    const ColoredLightRay &lightRay = path.ray;
+    const Point &intersection = hit.point;
     // Save if the shape's material does not lead to caustics and its diffuse component is BLACK
-    auto material = shape->GetMaterial();
-    save &= !((material->GetDiffuse(intersection) == BLACK) & ((material->GetSpecular() != BLACK) |
-                                                               (material->GetTransmittance() != BLACK)));
+    bool save = path.save & !((hit.diffuse == BLACK) & ((hit.specular != BLACK) | (hit.transmittance != BLACK)));
 
     // Cosine of the photon direction with the shape normal.
-    float cosine = abs(lightRay.GetDirection().DotProduct(shape->GetNormal(intersection)));
+    float cosine = abs(lightRay.GetDirection().DotProduct(hit.normal));
     ColoredLightRay in(lightRay.GetSource(), lightRay.GetDirection(),
                        lightRay.GetColor() * cosine);
 
+    /* Photons that reached this point only through specular bounces (sharp caustics) are stored by the caustic pass
+     * if there is one, and everything else by the main pass. */
+    if (mCausticPhotonsEmitted > 0) save &= (path.fromCausticShape & path.specularPath) == mEmittingCaustics;
+
     if (save)
     {
-        if (fromCausticShape)
+        if (path.fromCausticShape)
+        {
             mCausticsPhotonMap.Store(intersection, Photon(in));
+            RenderStats::Count(CAUSTIC_PHOTONS_STORED);
+        }
         else
+        {
             mDiffusePhotonMap.Store(intersection, Photon(in));
+            RenderStats::Count(DIFFUSE_PHOTONS_STORED);
+        }
     }
 
     // Russian Roulette: follow the photon trajectory if it's still living.
     bool fromCaustic;
-    ColoredLightRay bouncedRay;
-    bool isAlive = shape->RussianRoulette(in, intersection, bouncedRay, fromCaustic);
-    if (isAlive) PhotonInteraction(bouncedRay, true, fromCausticShape | fromCaustic);
+    bool isAlive = hit.shape->RussianRoulette(in, hit, path.ray, fromCaustic);
+    // The caustic pass is done with a photon once it bounces off a diffuse surface.
+    isAlive &= !mEmittingCaustics | fromCaustic;
+    path.save = true;
+    path.fromCausticShape |= fromCaustic;
+    path.specularPath &= fromCaustic;
+    return isAlive;
 }
 
-void Scene::MediaInteraction(const ColoredLightRay &lightRay, const shared_ptr<ParticipatingMedia> &media,
-                             const Point &interaction, const float meanFreePath)
+bool Scene::MediaInteraction(PhotonPath &path, const ParticipatingMedia &media, const Point &interaction,
+                             const float meanFreePath)
 {
+    // The caustic pass only follows photons through specular bounces.
+    if (mEmittingCaustics) return false;
+
     for (tuple<shared_ptr<ParticipatingMedia>, KDTree> &mediaKDTree : mMediaPhotonMaps)
     {
-        if (get<0>(mediaKDTree) == media)
+        if (get<0>(mediaKDTree).get() == &media)
         {
-            get<1>(mediaKDTree).Store(interaction, Photon(lightRay));
+            get<1>(mediaKDTree).Store(interaction, Photon(path.ray));
+            RenderStats::Count(MEDIA_PHOTONS_STORED);
             break;
         }
     }
 
     // Russian Roulette: follow the photon trajectory if it's still living.
     ColoredLightRay bouncedRay;
-    bool isAlive = media->RussianRoulette(lightRay, interaction, bouncedRay);
-    if (isAlive)
-    {
-        /* Take into account the probability of the step made [(2 / extinction) ^ -1] and the
-         * transmittance of this step. It's not divided by extinction because in Russian Roulette
-         * it isn't also divided by the albedo and multiplied by the scattering. */
-        bouncedRay = ColoredLightRay(bouncedRay.GetSource(), bouncedRay.GetDirection(),
-                                     bouncedRay.GetColor() * media->GetTransmittance(meanFreePath) * 2);
-        PhotonInteraction(bouncedRay, true, false);
-    }
+    if (!media.RussianRoulette(path.ray, interaction, bouncedRay)) return false;
+
+    /* Take into account the probability of the step made [(2 / extinction) ^ -1] and the
+     * transmittance of this step. It's not divided by extinction because in Russian Roulette
+     * it isn't also divided by the albedo and multiplied by the scattering. */
+    path.ray = ColoredLightRay(bouncedRay.GetSource(), bouncedRay.GetDirection(),
+                               bouncedRay.GetColor() * media.GetTransmittance(meanFreePath) * 2);
+    path.save = true;
+    path.fromCausticShape = false;
+    path.specularPath = false;
+    return true;
 }
 
 Color Scene::GetLightRayColor(const LightRay &lightRay, const int specularSteps) const
@@ -283,39 +949,76 @@ Color Scene::GetLightRayColor(const LightRay &lightRay, const int specularSteps)
     /* The number of specular and indirect steps has been reached.
      * Following the light will get more accurate rendered
      * images, but with much more computing cost. */
-    if (specularSteps == 0) return BLACK;
+    if (specularSteps <= 0) return BLACK;
+    RenderStats::Count(CAMERA_RAYS);
 
-    // Distance to the nearest shape.
-    float minT = FLT_MAX;
-    // Nearest shape intersected with the ray of light.
-    shared_ptr<Shape> nearestShape;
+    /* Segments of the path still to follow. Reflection and refraction may both split it, the stack is kept between
+     * calls so it doesn't allocate once it has grown to the deepest path. */
+    static thread_local vector<CameraPath> pending;
+    pending.clear();
+    pending.push_back(CameraPath{lightRay, Color(1.0f, 1.0f, 1.0f), specularSteps, 0.0f});
 
-    /* Intersect with all the shapes in the
-     * scene to know which one is the nearest. */
-    for (unsigned int i = 0; i < mShapes.size(); ++i)
-        mShapes.at(i)->Intersect(lightRay, minT, nearestShape, mShapes.at(i));
+    Color retVal = BLACK;
+    while (!pending.empty())
+    {
+        const CameraPath path = pending.back();
+        pending.pop_back();
+        const LightRay &ray = path.ray;
 
-    // No shape has been found.
-    if (minT == FLT_MAX) return MediaEstimateRadiance(lightRay);
+        /* Intersect with all the shapes in the
+         * scene to know which one is the nearest. */
+        HitRecord hit = NearestHit(ray);
 
-    // Intersection point with the nearest shape found.
-    Point intersection(lightRay.GetPoint(minT));
-    // Normal to the shape in the intersection point.
-    Vect normal = nearestShape->GetVisibleNormal(intersection, lightRay);
+        // No shape has been found.
+        if (hit.shape == nullptr)
+        {
+            retVal += MediaEstimateRadiance(ray) * path.throughput;
+            continue;
+        }
+
+        // Distance travelled from the camera to the intersection.
+        const float totalDistance = path.distance + hit.t;
+        /* Surface data of the intersection, with the diffuse value of the surface averaged over the area seen through
+         * the pixel. */
+        hit.shape->FillHitRecord(ray, hit, mCamera->GetFootprint(totalDistance));
 
-    Color emittedLight = nearestShape->GetEmittedLight();
+        Color emittedLight = hit.shape->GetEmittedLight();
+        // Fraction of the light leaving the intersection that reaches the camera.
+        const Color throughput = path.throughput * PathTransmittance(ray, hit.t);
 
-    // Light is additive.
-    return (DirectLight(intersection, normal, lightRay, *nearestShape) +
-            SpecularLight(intersection, normal, lightRay, *nearestShape, specularSteps) +
-            GeometryEstimateRadiance(intersection, normal, lightRay, *nearestShape) +
-            emittedLight) * PathTransmittance(lightRay, minT) +
-           MediaEstimateRadiance(minT, intersection, lightRay);
+        // Light is additive.
+        retVal += (DirectLight(hit, ray) + GeometryEstimateRadiance(hit, ray) + emittedLight) * throughput +
+                  MediaEstimateRadiance(hit.t, hit.point, ray) * path.throughput;
+
+        // Follow the specular light (reflection and refraction) while there are steps left.
+        if (path.specularSteps <= 1) continue;
+        if (hit.reflectance != BLACK)
+        {
+            RenderStats::Count(SPECULAR_RAYS);
+            // Ray of light reflected in the intersection point.
+            pending.push_back(CameraPath{LightRay(hit.point, Shape::Reflect(ray.GetDirection(), hit.visibleNormal)),
+                                         throughput * hit.reflectance, path.specularSteps - 1, totalDistance});
+        }
+        if (hit.transmittance != BLACK)
+        {
+            RenderStats::Count(SPECULAR_RAYS);
+            // Ray of light refracted in the intersection point.
+            pending.push_back(CameraPath{hit.shape->Refract(ray, hit), throughput * hit.transmittance,
+                                         path.specularSteps - 1, totalDistance});
+        }
+    }
+    return retVal;
 }
 
-Color Scene::DirectLight(const Point &point, const Vect &normal,
-                         const LightRay &seenFrom, const Shape &shape) const
+Color Scene::DirectLight(const HitRecord &hit, const LightRay &seenFrom) const
 {
+    // Mirrors and glass have no BRDF, they don't need the shadow rays.
+    if ((hit.diffuse == BLACK) &
+        (hit.specular == BLACK))
+        return BLACK;
+
+    const Point &point = hit.point;
+    const Vect &normal = hit.visibleNormal;
     // Assume the path to light is blocked.
     Color retVal = BLACK;
     // Direct light to all the light sources.
@@ -341,9 +1044,9 @@ Color Scene::DirectLight(const Point &point, const Vect &normal,
                     retVal += // Li.
                               mLightSources[i]->GetColor(point) *
                               // Phong BRDF. Wo = seenFrom * -1, Wi = lightRay.
-                              shape.GetMaterial()->PhongBRDF(seenFrom.GetDirection() * -1,
-                                                             lightRay.GetDirection(),
-                                                             normal, point) *
+                              hit.material->PhongBRDF(seenFrom.GetDirection() * -1,
+                                                      lightRay.GetDirection(),
+                                                      normal, hit.diffuse) *
                               // Cosine.
                               multiplier *
                               // Transmittance along all the path.
@@ -355,43 +1058,15 @@ Color Scene::DirectLight(const Point &point, const Vect &normal,
     return retVal;
 }
 
-Color Scene::SpecularLight(const Point &point, const Vect &normal,
-                           const LightRay &in, const Shape &shape,
-                           const int specularSteps) const
+Color Scene::GeometryEstimateRadiance(const HitRecord &hit, const LightRay &in) const
 {
-    Color retVal = BLACK;
-
-    if (specularSteps<=0) return retVal;
-
-    if (shape.GetMaterial()->GetReflectance() != BLACK)
-    {
-        // Ray of light reflected in the intersection point.
-        Vect reflectedDir = Shape::Reflect(in.GetDirection(), normal);
-        LightRay reflectedRay = LightRay(point, reflectedDir);
-
-        retVal += GetLightRayColor(reflectedRay, specularSteps-1) *
-                  shape.GetMaterial()->GetReflectance();
-    }
-
-    if (shape.GetMaterial()->GetTransmittance() != BLACK)
-    {
-        // Ray of light refracted in the intersection point.
-        LightRay refractedRay = shape.Refract(in, point, normal);
-
-        retVal += GetLightRayColor(refractedRay, specularSteps-1) *
-                  shape.GetMaterial()->GetTransmittance();
-    }
-
-    return retVal;
-}
-
-Color Scene::GeometryEstimateRadiance(const Point &point, const Vect &normal,
-                                      const LightRay &in, const Shape &shape) const
-{
-    if ((shape.GetMaterial()->GetDiffuse(point) == BLACK) &
-        (shape.GetMaterial()->GetSpecular() == BLACK))
+    if ((hit.diffuse == BLACK) &
+        (hit.specular == BLACK))
         return BLACK;
 
+    const Point &point = hit.point;
+    const Vect &normal = hit.visibleNormal;
+
     Color retVal = BLACK;
 
     vector<const Node *> nodeList;
@@ -411,9 +1086,9 @@ Color Scene::GeometryEstimateRadiance(const Point &point, const Vect &normal,
             retVal += // Li.
                       tmpPhoton.GetFlux() *
                       // Phong BRDF. Wo = in * -1, Wi = tmpPhoton.
-                      shape.GetMaterial()->PhongBRDF(in.GetDirection() * -1,
-                                                     tmpPhoton.GetVect(),
-                                                     normal, point) *
+                      hit.material->PhongBRDF(in.GetDirection() * -1,
+                                              tmpPhoton.GetVect(),
+                                              normal, hit.diffuse) *
                       // Gaussian kernel.
                       GaussianKernel(point, (*nodeIt)->GetPoint(), radius);
         }
@@ -437,16 +1112,20 @@ Color Scene::GeometryEstimateRadiance(const Point &point, const Vect &normal,
             causticRetVal += // Li.
                              tmpPhoton.GetFlux() *
                              // Phong BRDF. Wo = in * -1, Wi = tmpPhoton.
-                             shape.GetMaterial()->PhongBRDF(in.GetDirection() * -1,
-                                                            tmpPhoton.GetVect(),
-                                                            normal, point) *
+                             hit.material->PhongBRDF(in.GetDirection() * -1,
+                                                     tmpPhoton.GetVect(),
+                                                     normal, hit.diffuse) *
                              // Gaussian kernel.
                              GaussianKernel(point, (*nodeIt)->GetPoint(), causticRadius);
         }
     }
 
-    // Divide the radiance between the sphere area that wraps the nearest photons.
-    return retVal / Sphere::Area(radius) + causticRetVal / Sphere::Area(causticRadius);
+    /* Divide the radiance between the sphere area that wraps the nearest photons. When a map has fewer photons than
+     * neighbours searched its radius is infinite and the estimate is 0, checked here because the fast math flags
+     * don't guarantee dividing by infinity (or even isinf) works. */
+    const Color diffuseEstimate = radius < FLT_MAX ? retVal / Sphere::Area(radius) : BLACK;
+    const Color causticEstimate = causticRadius < FLT_MAX ? causticRetVal / Sphere::Area(causticRadius) : BLACK;
+    return diffuseEstimate + causticEstimate;
 }
 
 Color Scene::MediaEstimateRadiance(const float tIntersection, const Point &intersection, const LightRay &in) const
@@ -604,6 +1283,7 @@ float Scene::PathTransmittance(const LightRay &lightRay, float tIntersection) co
 
 bool Scene::InShadow(const LightRay &lightRay, const Point &light) const
 {
+    RenderStats::Count(SHADOW_RAYS);
     // Distance from the intersection point to the point light.
     float tLight = lightRay.GetSource().Distance(light);
     // Check if the point light is hidden,
@@ -612,8 +1292,13 @@ bool Scene::InShadow(const LightRay &lightRay, const Point &light) const
         /* The point light is hidden, because there is
          * a shape that intersects the ray of light. */
         float tShape = mShapes[i]->Intersect(lightRay);
-        if (tShape < tLight) return true;
+        if (tShape < tLight)
+        {
+            RenderStats::Count(INTERSECTION_TESTS, i + 1);
+            return true;
+        }
     }
     // No shape has intersected the ray of light.
+    RenderStats::Count(INTERSECTION_TESTS, mShapes.size());
     return false;
 }
@@ -13,9 +13,13 @@
 #ifndef RAY_TRACER_SCENE_HPP
 #define RAY_TRACER_SCENE_HPP
 
+#include <atomic>
 #include "camera.hpp"
+#include "emissionMap.hpp"
+#include <functional>
 #include  "coloredLightRay.hpp"
 #include  "kdtree.hpp"
+#include "image.hpp"
 #include "lightSource.hpp"
 #include <memory>
 #include "participatingMedia.hpp"
@@ -24,6 +28,60 @@
 
 using namespace std;
 
+/** Cost of a pixel recorded in a heatmap. The counts need RAY_TRACER_STATS, without it they are always 0. */
+enum HeatmapMetric {HEATMAP_NANOSECONDS, HEATMAP_INTERSECTION_TESTS, HEATMAP_KNN_NODES};
+
+/** Stop conditions and snapshots of a progressive render. A value of 0 disables each of them. */
+struct ProgressiveSettings
+{
+    /** Seconds after which no more passes are started. A pass is not started if it's expected to end after it. */
+    float timeBudget = 0.0f;
+
+    /** Seconds between two consecutive snapshots of the image. */
+    float snapshotInterval = 0.0f;
+
+    /** Mean relative standard error of the pixels' luminance at which the render stops. */
+    float targetNoise = 0.0f;
+
+    /** Maximum number of passes. */
+    unsigned int maxPasses = 0;
+};
+
+/** State of a photon traced through the scene, updated in place at every bounce. */
+struct PhotonPath
+{
+    /** Position, direction and flux of the photon. */
+    ColoredLightRay ray;
+
+    /** Number of bounces since it was emitted. */
+    unsigned int depth;
+
+    /** true if its next intersection with a shape will be stored in a KDTree. */
+    bool save;
+
+    /** true if it has been reflected or refracted by a shape that leads to caustics. */
+    bool fromCausticShape;
+
+    /** true if it has only had specular interactions since it was emitted. */
+    bool specularPath;
+};
+
+/** Segment of a camera path that is still to be followed after a specular bounce. */
+struct CameraPath
+{
+    /** Ray of the segment. */
+    LightRay ray;
+
+    /** Fraction of the light coming along the ray that reaches the camera. */
+    Color throughput;
+
+    /** Specular steps left, including this one. */
+    int specularSteps;
+
+    /** Distance travelled from the camera before reaching the source of the ray. */
+    float distance;
+};
+
 class Scene
 {
 
@@ -89,6 +147,34 @@ public:
         mCamera->SetImageDimensions(width, height);
     }
 
+    /**
+     * Restricts the render methods to a rectangle of the image. The rendered images will have the size of the region,
+     * with exactly the same pixels as the full image would have in it. Rendering all the regions of a partition of the
+     * image (with the same random seed for the photons) and joining them gives the full image.
+     *
+     * @param x Column of the upper-left pixel of the region.
+     * @param y Row of the upper-left pixel of the region.
+     * @param width Width in pixels of the region.
+     * @param height Height in pixels of the region.
+     */
+    void SetRenderRegion(const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height);
+
+    /**
+     * @return Width in pixels of the image rendered by this Scene's camera.
+     */
+    unsigned int GetImageWidth() const
+    {
+        return mCamera->GetWidth();
+    }
+
+    /**
+     * @return Height in pixels of the image rendered by this Scene's camera.
+     */
+    unsigned int GetImageHeight() const
+    {
+        return mCamera->GetHeight();
+    }
+
     /**
      * Sets the number of specular steps to take when rendering the image.
      *
@@ -109,6 +195,18 @@ public:
         mPhotonsEmitted = photonCount;
     }
 
+    /**
+     * Sets the number of photons emitted by a dedicated caustic pass. They are fired only towards the directions of
+     * every light that hit shapes that reflect or refract light (marked in a projection map), so sharp caustics get
+     * many more photons. The caustics that only go through specular bounces are then left to this pass.
+     *
+     * @param photonCount Number of caustic photons, 0 to disable the caustic pass.
+     */
+    void SetCausticPhotons(unsigned int photonCount)
+    {
+        mCausticPhotonsEmitted = photonCount;
+    }
+
     /**
      * Sets the number of photons to search in each intersection in the final ray tracing step.
      *
@@ -120,28 +218,114 @@ public:
     }
 
     /**
-     * The main ray tracing algorithm. Traces lightRays from the camera to all the pixels in the image plane, calculates
-     * intersections (and all their complicated interactions), and saves the color of each pixel in an image object.
-     * Since this takes a while, it prints a beautiful progress bar indicating the percent of lines completed.
+     * Enables emitting the photons towards the directions whose photons land where the camera sees, instead of
+     * uniformly. Before emitting, a cheap pass traces rays from the camera to find the visible surfaces, and a few
+     * probe photons per direction of every light measure how many land on them. Photons carry weights that keep the
+     * estimates unbiased, so the same quality needs far fewer photons when most of the scene is out of view.
      *
-     * @return Pointer to the rendered Image.
+     * @param importance true to guide the emission by the camera's importance.
+     */
+    void SetImportanceSampling(bool importance)
+    {
+        mImportanceSampling = importance;
+    }
+
+    /**
+     * Sets the number of samples taken inside every pixel. With more than one sample the rays are jittered over the
+     * pixel's area and their colors averaged, which removes the aliasing in edges.
+     *
+     * @param samples Number of samples per pixel.
+     */
+    void SetSamplesPerPixel(unsigned int samples)
+    {
+        mSamplesPerPixel = samples > 0 ? samples : 1;
+    }
+
+    /**
+     * Enables adaptive sampling. Pixels start with the samples set with SetSamplesPerPixel (at least
+     * MIN_ADAPTIVE_SAMPLES) and keep taking that many more while the estimated error of their mean luminance is
+     * greater than threshold times the mean, up to maxSamples. Flat areas stop early and the samples go to edges,
+     * caustics and glass.
+     *
+     * @param threshold Relative error allowed in the luminance of a pixel. 0 disables adaptive sampling.
+     * @param maxSamples Maximum number of samples per pixel.
      */
-    unique_ptr<Image> Render() const;
+    void SetAdaptiveSampling(float threshold, unsigned int maxSamples)
+    {
+        mAdaptiveThreshold = threshold;
+        mMaxSamplesPerPixel = maxSamples;
+    }
 
     /**
-     * Divides the image into non contiguous lists of lines giving each list to a thread to render them separately.
+     * The main ray tracing algorithm. Traces lightRays from the camera through all the pixels of the render region and
+     * saves their colors in an image. The image is divided into tiles that the threads take one by one and render
+     * directly into the resulting image.
      *
      * @param threads Number of threads that will render the image.
+     * @param heatmap If not null, image of the same size as the rendered one where the cost of every pixel is written
+     *  in its three channels.
+     * @param metric Cost written in the heatmap.
      * @return Pointer to the rendered Image.
      */
-    unique_ptr<Image> RenderMultiThread(const unsigned int threads) const;
+    unique_ptr<Image> RenderMultiThread(const unsigned int threads, Image *heatmap = nullptr,
+                                        const HeatmapMetric metric = HEATMAP_NANOSECONDS) const;
+
+    /**
+     * Renders the image in successive passes, each of them adding one jittered sample to every pixel, until one of the
+     * stop conditions in settings is met. Any intermediate result is a complete image, just noisier.
+     *
+     * @param threads Number of threads that will render every pass.
+     * @param settings When to stop rendering and how often to take snapshots.
+     * @param snapshot Called with the mean of all the passes rendered so far and their number every
+     *  settings.snapshotInterval seconds.
+     * @return Pointer to the mean of all the passes rendered.
+     */
+    unique_ptr<Image> RenderProgressive(const unsigned int threads, const ProgressiveSettings &settings,
+                                        const function<void(const Image &, unsigned int)> &snapshot = nullptr) const;
 
     /**
      * Emits all the photons defined for all LightSources in this scene. After their first bounce, all photons will be
-     * stored in the internal KDTrees to later be accessed by the render method.
+     * stored in the internal KDTrees to later be accessed by the render method. Same as TracePhotons followed by
+     * BalancePhotonMaps.
      */
     void EmitPhotons();
 
+    /**
+     * Emits all the photons like EmitPhotons, but leaves the KDTrees unbalanced. Meant for measuring both steps apart.
+     */
+    void TracePhotons();
+
+    /**
+     * Balances the KDTrees with the photons traced so they can be searched by the render method.
+     */
+    void BalancePhotonMaps();
+
+    /**
+     * Saves all the photon maps of this scene in a binary file, so later renders of the same scene can load them
+     * instead of emitting the photons again.
+     *
+     * @param filename Name for the file that will be created, overwriting any file with that name.
+     * @param sceneHash Value identifying the scene, checked when loading the file.
+     * @param seed Seed used for the random generator when emitting the photons, ~0 if it wasn't seeded. It's saved
+     *  so loading the file with another seed can be reported.
+     * @return true if the file was written successfully.
+     */
+    bool SavePhotonMaps(const string &filename, const uint64_t sceneHash, const uint64_t seed) const;
+
+    /**
+     * Loads the photon maps saved with SavePhotonMaps, replacing EmitPhotons. The file is memory mapped and the maps
+     * use its nodes in place.
+     *
+     * @param filename Path to the photon maps file.
+     * @param sceneHash Value identifying the scene, must be the same used to save the file.
+     * @param seed Seed of the random generator, ~0 if it isn't seeded. The maps are loaded even if they were emitted
+     *  with another seed, but it's reported.
+     * @return true if the file was loaded. It's not if it can't be read, it's from another scene, has a different
+     *  number of photons, doesn't have a map for every media in this scene, or wasn't emitted with the same
+     *  importance sampling setting (and, with importance sampling, the same camera and image size).
+     */
+    bool LoadPhotonMaps(const string &filename, const uint64_t sceneHash, const uint64_t seed);
+
 private:
 
     /** Limit to the specular interactions allowed. */
@@ -150,9 +334,45 @@ private:
     /** Number of individual photons that will be emitted from each of the lightSources in the scene. */
     unsigned int mPhotonsEmitted = 100000;
 
+    /** Number of photons emitted by the caustic pass, 0 if there is no caustic pass. */
+    unsigned int mCausticPhotonsEmitted = 0;
+
+    /** True while the caustic pass is emitting photons. */
+    bool mEmittingCaustics = false;
+
+    /** Bounces after which a photon is no longer followed, so it can't loop forever between perfect mirrors. */
+    static constexpr unsigned int MAX_PHOTON_BOUNCES = 1000;
+
+    /** Rows of the projection maps, they have twice as many columns. */
+    static constexpr unsigned int PROJECTION_MAP_ROWS = 64;
+
     /** Number of individual photons that will be searched as the nearest neighbours. */
     unsigned int mPhotonsNeighbours = 5000;
 
+    /** Number of samples taken inside every pixel, the minimum if adaptive sampling is enabled. */
+    unsigned int mSamplesPerPixel = 1;
+
+    /** Relative error allowed in the luminance of a pixel before stopping, 0 if adaptive sampling is disabled. */
+    float mAdaptiveThreshold = 0.0f;
+
+    /** Maximum number of samples per pixel when adaptive sampling is enabled. */
+    unsigned int mMaxSamplesPerPixel = 64;
+
+    /** Rectangle of the image to render. A width and height of 0 render the full image. */
+    unsigned int mRegionX = 0, mRegionY = 0, mRegionWidth = 0, mRegionHeight = 0;
+
+    /** Minimum number of samples per pixel to estimate the variance when adaptive sampling is enabled. */
+    static constexpr unsigned int MIN_ADAPTIVE_SAMPLES = 4;
+
+    /** True to emit the photons guided by the camera's importance. */
+    bool mImportanceSampling = false;
+
+    /** Maximum number of camera rays per axis traced to find the visible surfaces for importance sampling. */
+    static constexpr unsigned int IMPORTANCE_RAYS = 128;
+
+    /** Probe photons traced per cell of the emission maps. */
+    static constexpr unsigned int IMPORTANCE_PROBES = 4;
+
     /** Radius of the beam used in the radiance estimation. */
     float mBeamRadius = 0.05f;
 
@@ -177,51 +397,157 @@ private:
     /** Participating media exclusive photon map. A different KDTree is used for every media in the scene. */
     vector<tuple<shared_ptr<ParticipatingMedia>, KDTree>> mMediaPhotonMaps;
 
+    /** Side in pixels of the tiles the image is divided into when rendering with several threads. */
+    static constexpr unsigned int TILE_SIZE = 2 * Image::TILE_ALIGNMENT;
+
+    /**
+     * @return Width in pixels of the region to render.
+     */
+    unsigned int GetRegionWidth() const;
+
+    /**
+     * @return Height in pixels of the region to render.
+     */
+    unsigned int GetRegionHeight() const;
+
     /**
-     * @param horizontalLines Lines which pixels will be trace and saved to the image.
-     * @param image Pointer to the image shared by all the threads rendering the scene and saving into it. No concurrency
-     *  issues are expected because each thread renders separate lines.
-     * @param printProgress If true, this thread will print a progress bar. Since the lines each thread renders are not
-     *  contiguous we expect every thread to take a similar amount of time so it doesn't matter if the progress bar
-     *  finishes before all other threads end. If all printed their own progress bar adding locks would make this slower.
+     * @param image Image to split.
+     * @return Views of the image in square tiles of TILE_SIZE pixels (smaller in the right and bottom edges).
      */
-    void RenderPixelRange(const shared_ptr<vector<unsigned int>> horizontalLines,
-                          const shared_ptr<Image> image, const bool printProgress) const;
+    static vector<ImageTile> SplitInTiles(Image &image);
 
     /**
-     * Basic path tracing interaction between photons and the scene.
+     * Renders all the tiles with several threads.
      *
-     * @param lightRay Direction and position from which the photon is thrown, and color of this photon.
-     * @param save true if the next intersection between the lightRay and a shape in the scene will be stored in a
-     *  KDTree.
+     * @param tiles Tiles of the image being rendered.
+     * @param threads Number of threads that will render the tiles.
+     * @param printProgress If true, a progress bar is printed.
+     * @param renderTile Renders a single tile.
      */
-    void PhotonInteraction(const ColoredLightRay &lightRay, const bool save, bool fromCausticShape);
+    void RenderInParallel(const vector<ImageTile> &tiles, const unsigned int threads, const bool printProgress,
+                          const function<void(const ImageTile &)> &renderTile) const;
 
     /**
-     * Basic path tracing interaction between photons and the scene geometry.
+     * Renders tiles from the list until all of them have been taken.
      *
-     * @param lightRay Direction and position from which the photon is thrown, and color of this photon.
-     * @param shape Shape intersected by the lightRay, and with which the photon is interacting.
-     * @param intersection Point where the lightRay intersects with the shape.
-     * @param save true if intersection between the lightRay and the shape will be stored in a KDTree.
+     * @param tiles Tiles of the image being rendered. No concurrency issues are expected because each tile is rendered
+     *  by a single thread and tiles don't share cache lines.
+     * @param nextTile Index of the next tile to render, shared by all the threads.
+     * @param threadIndex Index of this thread among the ones rendering, its statistics are reported as "render
+     *  threadIndex".
+     * @param printProgress If true, this thread will print a progress bar. Since all threads take tiles from the same
+     *  list the progress is the index of the last tile taken. If all printed their own progress bar adding locks would
+     *  make this slower.
+     * @param renderTile Renders a single tile.
      */
-    void GeometryInteraction(const ColoredLightRay &lightRay, const shared_ptr<Shape> &shape,
-                             const Point &intersection, bool save, bool fromCausticShape);
+    void RenderTiles(const vector<ImageTile> &tiles, atomic<unsigned int> &nextTile, const unsigned int threadIndex,
+                     const bool printProgress, const function<void(const ImageTile &)> &renderTile) const;
 
     /**
-     * Basic path tracing interaction between photons and the scene media.
+     * Adds one jittered sample to every pixel of the tile.
      *
-     * @param lightRay Direction and position from which the photon is thrown, and color of this photon.
+     * @param tile Region of the accumulation image in which the samples are added.
+     * @param pass Index of the pass, which is also the index of the sample in every pixel.
+     * @param means Running mean of the luminance of every pixel in the image.
+     * @param squaredDifferences Running sum of squared differences from the mean of every pixel in the image.
+     */
+    void RenderPass(const ImageTile &tile, const unsigned int pass,
+                    vector<float> &means, vector<float> &squaredDifferences) const;
+
+    /**
+     * @param tile Region of the image which pixels will be traced and saved.
+     * @param heatmap If not null, the same region of the heatmap, where the cost of every pixel is written.
+     * @param metric Cost written in the heatmap.
+     */
+    void RenderPixelRange(const ImageTile &tile, const ImageTile *heatmap = nullptr,
+                          const HeatmapMetric metric = HEATMAP_NANOSECONDS) const;
+
+    /**
+     * Traces several jittered rays through a pixel, taking more samples if adaptive sampling is enabled and the
+     * variance of the pixel is still too high.
+     *
+     * @param center Center of the pixel in the view plane.
+     * @param advanceX Vector from a pixel to the next one in the same row.
+     * @param advanceY Vector from a pixel to the one above it.
+     * @param x Column of the pixel in the image.
+     * @param y Row of the pixel in the image.
+     * @return Mean color of all the samples taken.
+     */
+    Color SamplePixel(const Point &center, const Vect &advanceX, const Vect &advanceY,
+                      const unsigned int x, const unsigned int y) const;
+
+    /**
+     * @param lightRay Ray to intersect with the scene's shapes.
+     * @return Nearest intersection of lightRay with the shapes, with a nullptr shape if there is none. Its surface data
+     *  isn't filled.
+     */
+    HitRecord NearestHit(const LightRay &lightRay) const;
+
+    /**
+     * Follows a camera ray through reflections and refractions, saving the diffuse surfaces it sees.
+     *
+     * @param lightRay Ray from the camera or a specular bounce of it.
+     * @param specularSteps Specular steps left.
+     * @param distance Distance travelled from the camera before reaching the source of lightRay.
+     * @param visible Updated with the points seen and the width of the ray at each of them.
+     */
+    void TraceVisiblePoints(const LightRay &lightRay, const int specularSteps, const float distance,
+                            vector<pair<Point, float>> &visible) const;
+
+    /**
+     * @param lightRay Direction of a photon emitted from a light source.
+     * @param isVisible Tells if the camera sees a point.
+     * @return Estimate, between 0 and 1, of how much the photons emitted along lightRay are stored where the camera
+     *  sees: after their specular bounces for caustics, or after the next bounce for indirect light.
+     */
+    float ProbeImportance(const LightRay &lightRay, const function<bool(const Point &)> &isVisible) const;
+
+    /**
+     * @param light Light source which emission is guided.
+     * @param isVisible Tells if the camera sees a point.
+     * @return EmissionMap with the importance of every direction of the light.
+     */
+    EmissionMap BuildEmissionMap(const LightSource &light, const function<bool(const Point &)> &isVisible) const;
+
+    /**
+     * @param light Light source which caustic emission is guided.
+     * @param markedCells Updated to the number of cells marked in the projection map.
+     * @return Projection map with the directions of the light that hit shapes which reflect or refract light (and
+     *  their neighbours) marked with importance 1, and the rest with 0.
+     */
+    EmissionMap BuildProjectionMap(const LightSource &light, unsigned int &markedCells) const;
+
+    /**
+     * Traces a photon through the scene, bouncing off shapes and media until it's absorbed or leaves the scene.
+     *
+     * @param path Photon emitted and its initial state.
+     */
+    void PhotonInteraction(PhotonPath path);
+
+    /**
+     * Interaction between a photon and the scene geometry. The photon is stored if it must and then bounced.
+     *
+     * @param path Photon interacting with the shape, updated to the bounced photon.
+     * @param hit Intersection of the photon with the shape, with its surface data filled.
+     * @return true if the photon survives the Russian Roulette and must be followed.
+     */
+    bool GeometryInteraction(PhotonPath &path, const HitRecord &hit);
+
+    /**
+     * Interaction between a photon and the scene media. The photon is stored and then scattered.
+     *
+     * @param path Photon interacting with the media, updated to the scattered photon.
      * @param media Media with which the photon is interacting.
-     * @param interaction Point where the lightRay interacts with the media.
-     * @param meanFreePath Distance of the step done by this lightRay before interacting with the media.
+     * @param interaction Point where the photon interacts with the media.
+     * @param meanFreePath Distance of the step done by the photon before interacting with the media.
+     * @return true if the photon survives the Russian Roulette and must be followed.
      */
-    void MediaInteraction(const ColoredLightRay &lightRay, const shared_ptr<ParticipatingMedia> &media,
-                          const Point &interaction, const float meanFreePath);
+    bool MediaInteraction(PhotonPath &path, const ParticipatingMedia &media, const Point &interaction,
+                          const float meanFreePath);
 
     /**
-     * Calculates the color of the first point that intersects the lightRay. If specularSteps is greater than 0 reflected
-     * and refracted paths will be followed.
+     * Calculates the color of the first point that intersects the lightRay. If specularSteps is greater than 1
+     * reflected and refracted paths will be followed, without recursion.
      *
      * @param lightRay LightRay to indicate where to look for intersections.
      * @param specularSteps Specular steps to take.
@@ -230,38 +556,21 @@ private:
     Color GetLightRayColor(const LightRay &lightRay, const int specularSteps) const;
 
     /**
-     * @param point that belongs to the shape [shape] and where the direct light is calculated.
-     * @param normal of the [shape]'s surface in the point [point] and seen from [seenFrom].
-     * @param seenFrom Direction from which the point [point] is seen.
-     * @param shape that defines the light distribution with its BRDF.
-     * @return a color in relation to the direct light reached in the point [point] of the shape [shape] from
-     *  all the light sources in the scene, and is distributed in the [seenFrom] * -1 direction.
-     */
-    Color DirectLight(const Point &point, const Vect &normal,
-                      const LightRay &seenFrom, const Shape &shape) const;
-
-    /**
-     * @param point that belongs to the shape [shape] and where the specular light is calculated.
-     * @param normal of the [shape]'s surface in the point [point].
-     * @param in Incoming ray of light that intersects the shape [shape] in the point [point].
-     * @param shape that defines the light distribution with its BRDF.
-     * @param specularSteps Number of steps remaining to stop the specular bounces.
-     * @return a color in relation to the specular light (reflection and refraction) reached in the point [point]
-     *  of the shape [shape], performing [specularSteps] bounces of specular light.
+     * @param hit Intersection where the direct light is calculated, with its surface data filled. Its material
+     *  defines the light distribution with its BRDF.
+     * @param seenFrom Direction from which the intersection is seen.
+     * @return a color in relation to the direct light reached in the intersection from all the light sources in the
+     *  scene, and is distributed in the [seenFrom] * -1 direction.
      */
-    Color SpecularLight(const Point &point, const Vect &normal,
-                        const LightRay &in, const Shape &shape,
-                        const int specularSteps) const;
+    Color DirectLight(const HitRecord &hit, const LightRay &seenFrom) const;
 
     /**
-     * @param point that belongs to the shape [shape] and where the diffuse light is estimated.
-     * @param normal of the [shape]'s surface in the point [point].
-     * @param in Incoming ray of light that intersects the shape [shape] in the point [point].
-     * @param shape that defines the light distribution with its BRDF.
-     * @return a color in relation to the estimated diffuse light reached in the point [point] of the shape [shape].
+     * @param hit Intersection where the diffuse light is estimated, with its surface data filled. Its material
+     *  defines the light distribution with its BRDF.
+     * @param in Incoming ray of light that intersects the shape.
+     * @return a color in relation to the estimated diffuse light reached in the intersection.
      */
-    Color GeometryEstimateRadiance(const Point &point, const Vect &normal,
-                                   const LightRay &in, const Shape &shape) const;
+    Color GeometryEstimateRadiance(const HitRecord &hit, const LightRay &in) const;
 
     /**
      * @param tIntersection Point distance from LightRay where the ray of light will intersect the nearest shape of the scene.
@@ -13,12 +13,13 @@
 
 #include <cmath>
 #include  "coloredLightRay.hpp"
+#include "frame.hpp"
+#include "hitRecord.hpp"
 #include  "lightRay.hpp"
 #include  "material.hpp"
 #include  "vectorModifier.hpp"
 #include  "mathUtils.hpp"
 #include <memory>
-#include  "poseTransformationMatrix.hpp"
 #include  "visibleNormal.hpp"
 
 using namespace std;
@@ -37,15 +38,10 @@ public:
 
     /**
      * @param lightRay Contains the point from which an intersection with this shape will measured.
-     * @param minT Minimum distance from the lightRay's origin to any shape so far. If this shape is closer to the origin
-     *  than this value then it will be updated to that distance.
-     * @param nearestShape Shape that is reportedly the closest to the lightRay's origin so far. Updated to thisShape
-     *  if this shape is at a distance from the lightRay's origin smaller than minT and this shape doesn't contain any
-     *  sub-shapes.
-     * @param thisShape shared_ptr to this shape.
+     * @param hit Nearest intersection found so far. Updated to the intersection with this shape if it's closer to the
+     *  lightRay's origin than hit.t. If this shape contains sub-shapes the one intersected is recorded instead.
      */
-    virtual void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                           shared_ptr<Shape> thisShape) const = 0;
+    virtual void Intersect(const LightRay &lightRay, HitRecord &hit) const = 0;
 
     /**
      * @param in Vector whose reflection is returned.
@@ -61,15 +57,16 @@ public:
      * Based on http://graphics.stanford.edu/courses/cs148-10-summer/docs/2006--degreve--reflection_refraction.pdf.
      *
      * @param in LightRay entering this shape.
-     * @param point Point at which in enters this shape.
-     * @param visibleNormal Normal for this shape at point.
-     * @return New lightRay refracted from in with origin point.
+     * @param hit Intersection of in with this shape, with its surface data filled.
+     * @return New lightRay refracted from in with origin at the intersection point.
      */
-    LightRay Refract(const LightRay &in, const Point &point, const Vect &visibleNormal) const
+    LightRay Refract(const LightRay &in, const HitRecord &hit) const
     {
+        const Point &point = hit.point;
+        const Vect &visibleNormal = hit.visibleNormal;
         float n;
         // The ray of light is arriving the shape medium.
-        if (visibleNormal == GetNormal(point))
+        if (visibleNormal == hit.normal)
             n = mN;
         // The ray of light is exiting the shape medium.
         else
@@ -88,23 +85,22 @@ public:
 
     /**
      * @param in LightRay that is directed at the shape.
-     * @param point Point in which the LightRay intersects the shape.
+     * @param hit Intersection of in with this shape, with its surface data filled.
      * @param out When the return value of this method is true this value is updated to the LightRay coming out
      *  of the shape at the given point.
      * @param isCaustic This is an output parameter. It's updated to a true value if the photon is reflected or
      *  refracted (it may origin a caustic), and false otherwise.
      * @return True if a new LightRay comes out of the intersection with this shape.
      */
-    bool RussianRoulette(const ColoredLightRay &in, const Point &point, ColoredLightRay &out, bool &isCaustic) const
+    bool RussianRoulette(const ColoredLightRay &in, const HitRecord &hit, ColoredLightRay &out, bool &isCaustic) const
     {
+        const Point &point = hit.point;
         float random = GetRandomValue();
         // Diffuse.
-        if (random < mMaterial->GetDiffuse(point).MeanRGB())
+        if (random < hit.diffuse.MeanRGB())
         {
-            /* Transformation matrix from the local coordinates with [point] as the
-             * reference point, and the normal of this shape as the z axis, to global coordinates. */
-            PoseTransformationMatrix fromLocalToGlobal =
-                    PoseTransformationMatrix::GetPoseTransformation(point, GetVisibleNormal(point, in));
+            // Local coordinates with the normal of this shape as the z axis.
+            const Frame frame(hit.visibleNormal);
             // Generate random angles.
             float inclination, azimuth;
             tie(inclination, azimuth) = UniformCosineSampling();
@@ -113,9 +109,9 @@ public:
                           sin(inclination) * sin(azimuth),
                           cos(inclination));
             // Transform the ray of light to global coordinates.
-            out = ColoredLightRay(point, fromLocalToGlobal * localRay,
-                                  in.GetColor() * mMaterial->GetDiffuse(point)
-                                                / mMaterial->GetDiffuse(point).MeanRGB());
+            out = ColoredLightRay(point, frame.ToWorld(localRay),
+                                  in.GetColor() * hit.diffuse
+                                                / hit.diffuse.MeanRGB());
                                                 // Uniform cosine PDF removed because:
                                                 // (kd * PI) / ((2 * sin * cos) * (1 / 2 * PI)) =
                                                 // kd (already counted) / (sin * cos).
@@ -124,50 +120,48 @@ public:
             return true;
         }
         // Specular.
-        else if (random < (mMaterial->GetDiffuse(point).MeanRGB() +
-                           mMaterial->GetSpecular().MeanRGB()))
+        else if (random < (hit.diffuse.MeanRGB() +
+                           hit.specular.MeanRGB()))
         {
-            /* Transformation matrix from the local coordinates with [point] as the
-             * reference point, and the normal of this shape as the z axis, to global coordinates. */
-            PoseTransformationMatrix fromLocalToGlobal =
-                    PoseTransformationMatrix::GetPoseTransformation(point, GetVisibleNormal(point, in));
+            // Local coordinates with the normal of this shape as the z axis.
+            const Frame frame(hit.visibleNormal);
             // Generate random angles.
             float inclination, azimuth;
-            tie(inclination, azimuth) = PhongSpecularLobeSampling(mMaterial->GetShininess());
+            tie(inclination, azimuth) = PhongSpecularLobeSampling(hit.material->GetLobeExponent());
             // Direction of the ray of light expressed in local coordinates.
             Vect localRay(sin(inclination) * cos(azimuth),
                           sin(inclination) * sin(azimuth),
                           cos(inclination));
-            out = ColoredLightRay(point, fromLocalToGlobal * localRay,
-                                  in.GetColor() * mMaterial->GetSpecular()
-                                                / mMaterial->GetSpecular().MeanRGB()
+            out = ColoredLightRay(point, frame.ToWorld(localRay),
+                                  in.GetColor() * hit.specular
+                                                / hit.specular.MeanRGB()
                                                 // Phong lobe PDF. Cos^alpha is removed!
-                                                * (mMaterial->GetShininess() + 2) / (mMaterial->GetShininess() + 1));
+                                                * hit.material->GetLobeWeight());
             isCaustic = true;
             return true;
         }
         // Reflective.
-        else if (random < (mMaterial->GetDiffuse(point).MeanRGB() +
-                           mMaterial->GetSpecular().MeanRGB() +
-                           mMaterial->GetReflectance().MeanRGB()))
+        else if (random < (hit.diffuse.MeanRGB() +
+                           hit.specular.MeanRGB() +
+                           hit.reflectance.MeanRGB()))
         {
-            Vect reflectedRay = Reflect(in.GetDirection(), GetVisibleNormal(point, in));
+            Vect reflectedRay = Reflect(in.GetDirection(), hit.visibleNormal);
             out = ColoredLightRay(point, reflectedRay,
-                                  in.GetColor() * mMaterial->GetReflectance()
-                                                / mMaterial->GetReflectance().MeanRGB());
+                                  in.GetColor() * hit.reflectance
+                                                / hit.reflectance.MeanRGB());
             isCaustic = true;
             return true;
         }
         // Refractive.
-        else if (random < (mMaterial->GetDiffuse(point).MeanRGB() +
-                           mMaterial->GetSpecular().MeanRGB() +
-                           mMaterial->GetReflectance().MeanRGB() +
-                           mMaterial->GetTransmittance().MeanRGB()))
+        else if (random < (hit.diffuse.MeanRGB() +
+                           hit.specular.MeanRGB() +
+                           hit.reflectance.MeanRGB() +
+                           hit.transmittance.MeanRGB()))
         {
-            LightRay refractedRay = Refract(in, point, GetVisibleNormal(point, in));
+            LightRay refractedRay = Refract(in, hit);
             out = ColoredLightRay(point, refractedRay.GetDirection(),
-                                  in.GetColor() * mMaterial->GetTransmittance()
-                                                / mMaterial->GetTransmittance().MeanRGB());
+                                  in.GetColor() * hit.transmittance
+                                                / hit.transmittance.MeanRGB());
             isCaustic = true;
             return true;
         }
@@ -187,6 +181,40 @@ public:
      */
     virtual Vect GetNormal(const Point &point) const = 0;
 
+    /**
+     * @param hit Intersection with this shape, with its point filled.
+     * @return Vector normal to this shape at the intersection. Shapes that can get it faster from the intersection
+     *  (like from the barycentric coordinates of a triangle) override it, by default it's GetNormal(hit.point).
+     */
+    virtual Vect GetHitNormal(const HitRecord &hit) const
+    {
+        return GetNormal(hit.point);
+    }
+
+    /**
+     * Fills the surface data of an intersection with this shape: point, normals and material parameters.
+     *
+     * @param lightRay LightRay that intersects this shape at hit.t.
+     * @param hit Intersection found with this shape, updated with its surface data.
+     * @param footprint If greater than 0, width of the ray at the intersection. The diffuse value is then averaged
+     *  over the area it covers (GetFilteredDiffuse) instead of taken at the point.
+     */
+    void FillHitRecord(const LightRay &lightRay, HitRecord &hit, const float footprint = 0.0f) const
+    {
+        hit.point = lightRay.GetPoint(hit.t);
+        hit.normal = GetHitNormal(hit);
+        hit.visibleNormal = VisibleNormal(hit.normal, lightRay.GetDirection());
+        if (mNormalModifier != nullptr) hit.visibleNormal = mNormalModifier->Modify(hit.visibleNormal, hit.point);
+        hit.material = mMaterial.get();
+        hit.diffuse = footprint > 0 ? mMaterial->GetFilteredDiffuse(hit.point, hit.visibleNormal,
+                                                                    lightRay.GetDirection(), footprint)
+                                    : mMaterial->GetDiffuse(hit.point);
+        hit.specular = mMaterial->GetSpecular();
+        hit.reflectance = mMaterial->GetReflectance();
+        hit.transmittance = mMaterial->GetTransmittance();
+        hit.shininess = mMaterial->GetShininess();
+    }
+
     /**
      * @param point Point of this shape which normal vector will be returned.
      * @param seenFrom LightRay from which this shape is seen.
@@ -246,7 +274,7 @@ public:
     /**
      * @return Emitted light as a color
      */
-    Color GetEmittedLight()
+    Color GetEmittedLight() const
     {
         return mEmitted * mPowerEmitted;
     }
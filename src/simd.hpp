@@ -0,0 +1,164 @@
+/** ---------------------------------------------------------------------------
+ ** simd.hpp
+ ** Storage and arithmetic of the three floats shared by Point, Vect and Color.
+ ** By default they are three plain floats and every operation is constexpr.
+ ** When built with RAY_TRACER_SIMD (the RAY_TRACER_SIMD CMake option) they are
+ ** four floats, the last one unused, and the operations are SSE instructions.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_SIMD_HPP
+#define RAY_TRACER_SIMD_HPP
+
+#ifdef RAY_TRACER_SIMD
+#include <smmintrin.h>
+/** Intrinsics can't be evaluated at compile time, so operations are only constexpr without SIMD. */
+#define SIMD_CONSTEXPR inline
+#else
+#define SIMD_CONSTEXPR constexpr
+#endif
+
+/** Three floats: x, y and z of points and vectors, or red, green and blue of colors. */
+struct Float3
+{
+#ifdef RAY_TRACER_SIMD
+    /** The fourth value is padding to fill an SSE register. It isn't aligned so Float3 can be read in place from
+     * memory mapped files. */
+    float values[4];
+#else
+    float values[3];
+#endif
+
+    constexpr float operator[](const unsigned int i) const
+    {
+        return values[i];
+    }
+
+    constexpr float &operator[](const unsigned int i)
+    {
+        return values[i];
+    }
+};
+
+/**
+ * @return New Float3 with the given values.
+ */
+constexpr Float3 MakeFloat3(const float x, const float y, const float z)
+{
+#ifdef RAY_TRACER_SIMD
+    return Float3{{x, y, z, 0.0f}};
+#else
+    return Float3{{x, y, z}};
+#endif
+}
+
+#ifdef RAY_TRACER_SIMD
+
+inline __m128 Load(const Float3 &a)
+{
+    return _mm_loadu_ps(a.values);
+}
+
+inline Float3 Store(const __m128 v)
+{
+    Float3 result;
+    _mm_storeu_ps(result.values, v);
+    return result;
+}
+
+inline Float3 Add(const Float3 &a, const Float3 &b)
+{
+    return Store(_mm_add_ps(Load(a), Load(b)));
+}
+
+inline Float3 Subtract(const Float3 &a, const Float3 &b)
+{
+    return Store(_mm_sub_ps(Load(a), Load(b)));
+}
+
+inline Float3 Multiply(const Float3 &a, const Float3 &b)
+{
+    return Store(_mm_mul_ps(Load(a), Load(b)));
+}
+
+inline Float3 Scale(const Float3 &a, const float k)
+{
+    return Store(_mm_mul_ps(Load(a), _mm_set1_ps(k)));
+}
+
+inline Float3 Divide(const Float3 &a, const float k)
+{
+    // Dividing the padding too would fill it with NaN when k is 0.
+    return Store(_mm_div_ps(Load(a), _mm_setr_ps(k, k, k, 1.0f)));
+}
+
+inline float Dot(const Float3 &a, const Float3 &b)
+{
+    // Only the first three values are multiplied, the result goes to the first one.
+    return _mm_cvtss_f32(_mm_dp_ps(Load(a), Load(b), 0x71));
+}
+
+inline Float3 Cross(const Float3 &a, const Float3 &b)
+{
+    const __m128 va = Load(a), vb = Load(b);
+    const __m128 aYZX = _mm_shuffle_ps(va, va, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 bYZX = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 0, 2, 1));
+    // Cross product with its values in z, x, y order.
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(va, bYZX), _mm_mul_ps(aYZX, vb));
+    return Store(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+}
+
+inline bool Equal(const Float3 &a, const Float3 &b)
+{
+    return (_mm_movemask_ps(_mm_cmpeq_ps(Load(a), Load(b))) & 0x7) == 0x7;
+}
+
+#else
+
+constexpr Float3 Add(const Float3 &a, const Float3 &b)
+{
+    return MakeFloat3(a[0] + b[0], a[1] + b[1], a[2] + b[2]);
+}
+
+constexpr Float3 Subtract(const Float3 &a, const Float3 &b)
+{
+    return MakeFloat3(a[0] - b[0], a[1] - b[1], a[2] - b[2]);
+}
+
+constexpr Float3 Multiply(const Float3 &a, const Float3 &b)
+{
+    return MakeFloat3(a[0] * b[0], a[1] * b[1], a[2] * b[2]);
+}
+
+constexpr Float3 Scale(const Float3 &a, const float k)
+{
+    return MakeFloat3(a[0] * k, a[1] * k, a[2] * k);
+}
+
+constexpr Float3 Divide(const Float3 &a, const float k)
+{
+    return MakeFloat3(a[0] / k, a[1] / k, a[2] / k);
+}
+
+constexpr float Dot(const Float3 &a, const Float3 &b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+constexpr Float3 Cross(const Float3 &a, const Float3 &b)
+{
+    return MakeFloat3(a[1] * b[2] - a[2] * b[1],
+                      a[2] * b[0] - a[0] * b[2],
+                      a[0] * b[1] - a[1] * b[0]);
+}
+
+constexpr bool Equal(const Float3 &a, const Float3 &b)
+{
+    return (a[0] == b[0]) & (a[1] == b[1]) & (a[2] == b[2]);
+}
+
+#endif // RAY_TRACER_SIMD
+
+#endif // RAY_TRACER_SIMD_HPP
@@ -7,12 +7,14 @@
  ** -------------------------------------------------------------------------*/
 
 #include  "simpleTexture.hpp"
+#include "textureCache.hpp"
 
 SimpleTexture::SimpleTexture(const string& filename, Dimension axis, float pixelSize, Vect shift)
-: Material(BLACK, BLACK, 0.0f, BLACK, BLACK), mImage(filename), mPixelSize(pixelSize), mShift(shift), mAxis(axis) {}
+: Material(TEXTURE_DIFFUSE, BLACK, BLACK, 0.0f, BLACK, BLACK), mTexture(TextureCache::GetMipMap(filename)), mPixelSize(pixelSize), mShift(shift), mAxis(axis) {}
 
 Color SimpleTexture::GetDiffuse(const Point &point) const
 {
+    const Image &image = mTexture->GetLevel(0);
     int x = static_cast<int>((point.GetX() > 0 ? point.GetX() + mShift.GetX(): -point.GetX() + mPixelSize + mShift.GetX()) / mPixelSize);
     int y = static_cast<int>((point.GetY() > 0 ? point.GetY() + mShift.GetY(): -point.GetY() + mPixelSize + mShift.GetY()) / mPixelSize);
     int z = static_cast<int>((point.GetZ() > 0 ? point.GetZ() + mShift.GetZ(): -point.GetZ() + mPixelSize + mShift.GetZ()) / mPixelSize);
@@ -20,19 +22,53 @@ Color SimpleTexture::GetDiffuse(const Point &point) const
     switch (mAxis)
     {
     case X:
-        i = y % mImage.GetHeight();
-        j = z % mImage.GetWidth();
+        i = y % image.GetHeight();
+        j = z % image.GetWidth();
         break;
     case Y:
-        i = z % mImage.GetHeight();
-        j = x % mImage.GetWidth();
+        i = z % image.GetHeight();
+        j = x % image.GetWidth();
         break;
     case Z:
-        i = y % mImage.GetHeight();
-        j = x % mImage.GetWidth();
+        i = y % image.GetHeight();
+        j = x % image.GetWidth();
         break;
     default:
         throw invalid_argument("Not a valid dimension\n");
     }
-    return mImage[i][j];
+    return image[i][j];
+}
+
+Color SimpleTexture::GetFilteredDiffuse(const Point &point, const Vect &normal,
+                                        const Vect &direction, const float footprint) const
+{
+    // Same mapping as GetDiffuse, without truncating to whole pixels.
+    float x = (point.GetX() > 0 ? point.GetX() + mShift.GetX(): -point.GetX() + mPixelSize + mShift.GetX()) / mPixelSize;
+    float y = (point.GetY() > 0 ? point.GetY() + mShift.GetY(): -point.GetY() + mPixelSize + mShift.GetY()) / mPixelSize;
+    float z = (point.GetZ() > 0 ? point.GetZ() + mShift.GetZ(): -point.GetZ() + mPixelSize + mShift.GetZ()) / mPixelSize;
+    float u, v;
+    Dimension uAxis, vAxis;
+    switch (mAxis)
+    {
+    case X:
+        v = y; vAxis = Y;
+        u = z; uAxis = Z;
+        break;
+    case Y:
+        v = z; vAxis = Z;
+        u = x; uAxis = X;
+        break;
+    case Z:
+        v = y; vAxis = Y;
+        u = x; uAxis = X;
+        break;
+    default:
+        throw invalid_argument("Not a valid dimension\n");
+    }
+
+    // Size of the region covered by the ray measured in pixels of the texture.
+    const float width = max(GetFootprintWidth(normal, direction, footprint, uAxis),
+                            GetFootprintWidth(normal, direction, footprint, vAxis)) / mPixelSize;
+    const float lod = width > 1.0f ? log2(width) : 0.0f;
+    return mTexture->Sample(u, v, lod);
 }
\ No newline at end of file
@@ -11,7 +11,7 @@
 #define RAY_TRACER_SIMPLETEXTURE_HPP
 
 #include  "material.hpp"
-#include  "image.hpp"
+#include  "mipMap.hpp"
 
 class SimpleTexture : public Material
 {
@@ -19,7 +19,7 @@ class SimpleTexture : public Material
 public:
 
     /**
-     * Loads the image filename
+     * Loads the image filename, or takes it from the texture cache if it was already loaded.
      *
      * @param filename Path to the texture image. Must be a .ppm image.
      * @return New Simple Texture material.
@@ -27,15 +27,29 @@ public:
     SimpleTexture(const string &filename, Dimension axis, float pixelSize = 0.0001f, Vect shift = Vect(0,0,0));
 
     /**
+     * Material::GetDiffuse calls it for materials of kind TEXTURE_DIFFUSE.
+     *
      * @return This material's color at the given point. Depends on the point's values relative to the world's axis
      *  and the texture loaded in this material.
      */
     Color GetDiffuse(const Point &point) const;
 
+    /**
+     * Trilinear lookup in the MipMap of the texture, choosing the level from the area covered by the ray.
+     *
+     * @param point Point for which the diffuse value is returned.
+     * @param normal Normal to the surface in point.
+     * @param direction Direction of the ray that reached point.
+     * @param footprint Width of the ray when it reaches point, measured perpendicularly to its direction.
+     * @return This material's color averaged around the given point.
+     */
+    Color GetFilteredDiffuse(const Point &point, const Vect &normal,
+                             const Vect &direction, const float footprint) const;
+
 private:
 
-    /** Texture. */
-    mutable Image mImage;
+    /** Texture and its downsampled versions, shared with every other material using the same file. */
+    shared_ptr<const MipMap> mTexture;
 
     /** Size of a pixel in the texture related to distance in the scene. */
     float mPixelSize;
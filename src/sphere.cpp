@@ -47,14 +47,14 @@ float Sphere::Intersect(const LightRay &lightRay) const
     }
 }
 
-void Sphere::Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                       shared_ptr<Shape> thisShape) const
+void Sphere::Intersect(const LightRay &lightRay, HitRecord &hit) const
 {
     float tmpT = Intersect(lightRay);
-    if (tmpT < minT)
+    if (tmpT < hit.t)
     {
-        minT = tmpT;
-        nearestShape = thisShape;
+        hit.t = tmpT;
+        hit.shape = this;
+        hit.u = hit.v = 0.0f;
     }
 }
 
@@ -31,14 +31,11 @@ public:
     float Intersect(const LightRay &lightRay) const;
 
     /**
-     * @param lightRay The LightRay we are checking for intersections.
-     * @param minT Distance from the lightRay's origin to nearestShape. Updated to this this Sphere's distance from
-     *  the lightRay's origin if that is smaller than minT.
-     * @param nearestShape Shape that is at distance t from the lightRay's origin. Updated to thisShape if this Sphere
-     *  is closer from the lightRay's origin than minT.
+     * @param lightRay Contains the point from which an intersection with this shape will measured.
+     * @param hit Nearest intersection found so far. Updated to the intersection with this Sphere if it's closer to
+     *  the lightRay's origin than hit.t.
      */
-    void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                   shared_ptr<Shape> thisShape) const;
+    void Intersect(const LightRay &lightRay, HitRecord &hit) const;
 
     /**
      * @param point Point to determine if it's inside this Sphere.
@@ -0,0 +1,78 @@
+/** ---------------------------------------------------------------------------
+ ** textureCache.cpp
+ ** Implementation for TextureCache class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <cstdio>
+#include "mappedFile.hpp"
+#include "textureCache.hpp"
+
+mutex TextureCache::mMutex;
+
+map<string, weak_ptr<const Image>> TextureCache::mTextures;
+
+map<string, weak_ptr<const MipMap>> TextureCache::mMipMaps;
+
+shared_ptr<const Image> TextureCache::Get(const string &filename)
+{
+    lock_guard<mutex> lock(mMutex);
+    return LoadImage(filename);
+}
+
+shared_ptr<const MipMap> TextureCache::GetMipMap(const string &filename)
+{
+    lock_guard<mutex> lock(mMutex);
+
+    shared_ptr<const MipMap> mipMap = mMipMaps[filename].lock();
+    if (mipMap == nullptr)
+    {
+        mipMap = make_shared<const MipMap>(LoadImage(filename));
+        mMipMaps[filename] = mipMap;
+    }
+    return mipMap;
+}
+
+shared_ptr<const Image> TextureCache::LoadImage(const string &filename)
+{
+    shared_ptr<const Image> image = mTextures[filename].lock();
+    if (image != nullptr) return image;
+
+    const string binaryPath = GetBinaryPath(filename);
+    const long long sourceSize = MappedFile::GetFileSize(filename);
+    const long long sourceTime = MappedFile::GetModificationTime(filename);
+    if (MappedFile::GetModificationTime(binaryPath) >= 0)
+    {
+        try
+        {
+            image = make_shared<const Image>(binaryPath, sourceSize, sourceTime);
+        }
+        catch (int)
+        {
+            // Outdated or corrupted binary, it'll be written again from the source.
+            image = nullptr;
+        }
+    }
+
+    if (image == nullptr)
+    {
+        shared_ptr<Image> decoded = make_shared<Image>(filename);
+        // Write to a temporary file first so no one can map a half written binary. If it can't be written the texture
+        // is simply decoded again next time.
+        const string temporaryPath = binaryPath + ".tmp";
+        const bool saved = decoded->SaveBinary(temporaryPath, sourceSize, sourceTime);
+        if (saved) rename(temporaryPath.c_str(), binaryPath.c_str());
+        else remove(temporaryPath.c_str());
+        image = decoded;
+    }
+
+    mTextures[filename] = image;
+    return image;
+}
+
+string TextureCache::GetBinaryPath(const string &filename)
+{
+    return filename + ".rtex";
+}
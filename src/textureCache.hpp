@@ -0,0 +1,66 @@
+/** ---------------------------------------------------------------------------
+ ** textureCache.hpp
+ ** Global cache of the images used as textures. Each file is decoded only once
+ ** and its pixels (and its MipMap) are shared by every material using it. Decoded images are also
+ ** stored next to their source in a binary format which later runs memory map
+ ** instead of parsing the ppm file again.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_TEXTURECACHE_HPP
+#define RAY_TRACER_TEXTURECACHE_HPP
+
+#include "image.hpp"
+#include <map>
+#include "mipMap.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+class TextureCache
+{
+
+public:
+
+    /**
+     * @param filename Path to the texture image.
+     * @return The image in filename, shared with every other user of the same path. It's loaded from its binary version
+     *  if there's one saved from a source file with exactly the current size and modification time, otherwise the
+     *  source is decoded and its binary version written.
+     */
+    static shared_ptr<const Image> Get(const string &filename);
+
+    /**
+     * @param filename Path to the texture image.
+     * @return MipMap of the image in filename, built only once and shared with every other user of the same path.
+     */
+    static shared_ptr<const MipMap> GetMipMap(const string &filename);
+
+    /**
+     * @param filename Path to the texture image.
+     * @return Path of the binary version of the image in filename.
+     */
+    static string GetBinaryPath(const string &filename);
+
+private:
+
+    /** Protects the list of textures. */
+    static mutex mMutex;
+
+    /** Textures loaded, by path. They are released once no material uses them. */
+    static map<string, weak_ptr<const Image>> mTextures;
+
+    /** MipMaps built, by path of their image. */
+    static map<string, weak_ptr<const MipMap>> mMipMaps;
+
+    /**
+     * Same as Get, but the caller must hold mMutex.
+     */
+    static shared_ptr<const Image> LoadImage(const string &filename);
+};
+
+#endif // RAY_TRACER_TEXTURECACHE_HPP
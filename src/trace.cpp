@@ -0,0 +1,118 @@
+/** ---------------------------------------------------------------------------
+ ** trace.cpp
+ ** Implementation for Trace class.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include "trace.hpp"
+#include <vector>
+
+atomic<bool> Trace::sEnabled(false);
+
+/** An event of the timeline, in microseconds since tracing was enabled. */
+struct TraceEvent
+{
+    const char *name;
+    string detail;
+    unsigned int track;
+    double start, duration;
+};
+
+/** Protects everything below. */
+static mutex traceMutex;
+
+/** Time at which tracing was enabled. */
+static chrono::steady_clock::time_point traceOrigin;
+
+/** Events recorded by all the threads. */
+static vector<TraceEvent> traceEvents;
+
+/** Names of the tracks, the i'th one being the track i + 1. */
+static vector<string> trackNames;
+
+/** Track of the calling thread, 0 if it hasn't been given one yet. */
+static thread_local unsigned int tTrack = 0;
+
+/**
+ * @param name Name of a track. Must be called with traceMutex locked.
+ * @return Track with that name, created if it didn't exist.
+ */
+static unsigned int GetTrack(const string &name)
+{
+    for (unsigned int i = 0; i < trackNames.size(); ++i)
+    {
+        if (trackNames[i] == name) return i + 1;
+    }
+    trackNames.push_back(name);
+    return static_cast<unsigned int>(trackNames.size());
+}
+
+/**
+ * @param text Any text.
+ * @return The text as a JSON string, quotes included.
+ */
+static string JsonString(const string &text)
+{
+    string quoted = "\"";
+    for (const char c : text)
+    {
+        if (c == '"' || c == '\\') quoted += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) quoted += c;
+    }
+    return quoted + '"';
+}
+
+void Trace::Enable()
+{
+    lock_guard<mutex> lock(traceMutex);
+    traceOrigin = chrono::steady_clock::now();
+    sEnabled = true;
+}
+
+void Trace::SetThreadName(const string &name)
+{
+    lock_guard<mutex> lock(traceMutex);
+    tTrack = GetTrack(name);
+}
+
+void Trace::AddEvent(const char *name, const string &detail, const chrono::steady_clock::time_point start,
+                     const chrono::steady_clock::time_point end)
+{
+    if (!IsEnabled()) return;
+    lock_guard<mutex> lock(traceMutex);
+    // Threads that were never named get a track of their own.
+    if (tTrack == 0) tTrack = GetTrack("thread " + to_string(trackNames.size() + 1));
+    traceEvents.push_back({name, detail, tTrack,
+                           chrono::duration<double, micro>(start - traceOrigin).count(),
+                           chrono::duration<double, micro>(end - start).count()});
+}
+
+bool Trace::Save(const string &filename)
+{
+    lock_guard<mutex> lock(traceMutex);
+    ofstream file(filename);
+    file << fixed << setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (unsigned int i = 0; i < trackNames.size(); ++i)
+    {
+        file << (i == 0 ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << i + 1
+             << ", \"args\": {\"name\": " << JsonString(trackNames[i]) << "}},\n"
+             << "{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << i + 1
+             << ", \"args\": {\"sort_index\": " << i + 1 << "}}";
+    }
+    for (unsigned int i = 0; i < traceEvents.size(); ++i)
+    {
+        const TraceEvent &event = traceEvents[i];
+        file << (i == 0 && trackNames.empty() ? "\n" : ",\n")
+             << "{\"name\": " << JsonString(event.name) << ", \"cat\": \"render\", \"ph\": \"X\", \"pid\": 1, "
+             << "\"tid\": " << event.track << ", \"ts\": " << event.start << ", \"dur\": " << event.duration;
+        if (!event.detail.empty()) file << ", \"args\": {\"detail\": " << JsonString(event.detail) << '}';
+        file << '}';
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
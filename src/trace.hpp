@@ -0,0 +1,115 @@
+/** ---------------------------------------------------------------------------
+ ** trace.hpp
+ ** Timeline of the work done by every thread, saved in the Chrome trace
+ ** format so it can be opened with chrome://tracing or Perfetto. Nothing is
+ ** recorded unless it's enabled.
+ **
+ ** Author: Miguel Jorge Galindo Ramos, NIA: 679954
+ **         Santiago Gil Begué, NIA: 683482
+ ** -------------------------------------------------------------------------*/
+
+#ifndef RAY_TRACER_TRACE_HPP
+#define RAY_TRACER_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+using namespace std;
+
+class Trace
+{
+
+public:
+
+    /**
+     * Starts recording events. Their times are measured from this moment.
+     */
+    static void Enable();
+
+    /**
+     * @return true if events are being recorded.
+     */
+    static bool IsEnabled()
+    {
+        return sEnabled.load(memory_order_relaxed);
+    }
+
+    /**
+     * Names the track of the calling thread. Threads given the same name share the same track, so the threads of
+     * consecutive renders don't add new ones.
+     *
+     * @param name Name of the track.
+     */
+    static void SetThreadName(const string &name);
+
+    /**
+     * Records an event of the calling thread, if enabled.
+     *
+     * @param name Name of the event.
+     * @param detail Extra information shown with the event, nothing if empty.
+     * @param start Time at which the event began.
+     * @param end Time at which the event ended.
+     */
+    static void AddEvent(const char *name, const string &detail, const chrono::steady_clock::time_point start,
+                         const chrono::steady_clock::time_point end);
+
+    /**
+     * Writes all the events recorded as a Chrome trace JSON file.
+     *
+     * @param filename Path of the file, overwritten if it exists.
+     * @return true if the file was written successfully.
+     */
+    static bool Save(const string &filename);
+
+private:
+
+    /** True while events are recorded. */
+    static atomic<bool> sEnabled;
+};
+
+/**
+ * Records an event from its construction to its destruction.
+ */
+class TraceScope
+{
+
+public:
+
+    /**
+     * @param name Name of the event, it must outlive this scope.
+     * @param detail Extra information shown with the event, nothing if empty.
+     */
+    explicit TraceScope(const char *name, const string &detail = "")
+    : mEnabled(Trace::IsEnabled()), mName(name)
+    {
+        if (!mEnabled) return;
+        mDetail = detail;
+        mStart = chrono::steady_clock::now();
+    }
+
+    ~TraceScope()
+    {
+        if (mEnabled) Trace::AddEvent(mName, mDetail, mStart, chrono::steady_clock::now());
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+
+    /** Whether tracing was enabled when the event began. */
+    bool mEnabled;
+
+    /** Name of the event. */
+    const char *mName;
+
+    /** Extra information of the event. */
+    string mDetail;
+
+    /** Time at which the event began. */
+    chrono::steady_clock::time_point mStart;
+};
+
+#endif // RAY_TRACER_TRACE_HPP
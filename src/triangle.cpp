@@ -24,6 +24,12 @@ Triangle::Triangle(const Point &a, const Point &b, const Point &c)
 {}
 
 float Triangle::Intersect(const LightRay &lightRay) const
+{
+    float alpha, beta;
+    return Intersect(lightRay, alpha, beta);
+}
+
+float Triangle::Intersect(const LightRay &lightRay, float &alpha, float &beta) const
 {
     // Intersection of the ray of light with the plane.
     float t = Plane::Intersect(lightRay);
@@ -35,21 +41,23 @@ float Triangle::Intersect(const LightRay &lightRay) const
     float d20 = v2.DotProduct(v0);
     float d21 = v2.DotProduct(v1);
     // Barycentric coordinates.
-    float alpha = (d11 * d20 - d01 * d21) / denominator;
-    float beta = (d00 * d21 - d01 * d20) / denominator;
+    alpha = (d11 * d20 - d01 * d21) / denominator;
+    beta = (d00 * d21 - d01 * d20) / denominator;
     // Gamma is not necessary: float gamma = 1.0f - alpha - beta;
     // Check if the intersection point is inside the triangle bounds.
     return (alpha >= 0) & (beta >= 0) & (alpha + beta < 1) ? t : FLT_MAX;
 }
 
-void Triangle::Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                         shared_ptr<Shape> thisShape) const
+void Triangle::Intersect(const LightRay &lightRay, HitRecord &hit) const
 {
-    float tmpT = Intersect(lightRay);
-    if (tmpT < minT)
+    float alpha, beta;
+    float tmpT = Intersect(lightRay, alpha, beta);
+    if (tmpT < hit.t)
     {
-        minT = tmpT;
-        nearestShape = thisShape;
+        hit.t = tmpT;
+        hit.shape = this;
+        hit.u = alpha;
+        hit.v = beta;
     }
 }
 
@@ -32,14 +32,11 @@ public:
     float Intersect(const LightRay &lightRay) const;
 
     /**
-     * @param lightRay The LightRay we are checking for intersections.
-     * @param minT Distance from the lightRay's origin to nearestShape. Updated to this this Triangle's distance from
-     *  the lightRay's origin if that is smaller than minT.
-     * @param nearestShape Shape that is at distance t from the lightRay's origin. Updated to thisShape if this Triangle
-     *  is closer from the lightRay's origin than minT.
+     * @param lightRay Contains the point from which an intersection with this shape will measured.
+     * @param hit Nearest intersection found so far. Updated to the intersection with this Triangle if it's closer to
+     *  the lightRay's origin than hit.t.
      */
-    void Intersect(const LightRay &lightRay, float &minT, shared_ptr<Shape> &nearestShape,
-                   shared_ptr<Shape> thisShape) const;
+    void Intersect(const LightRay &lightRay, HitRecord &hit) const;
 
     /**
      * @return This triangle's barycenter.
@@ -63,6 +60,14 @@ public:
 
 protected:
 
+    /**
+     * @param lightRay Contains the point from which an intersection with this shape will measured.
+     * @param alpha Updated to the barycentric coordinate of the intersection with respect to point B.
+     * @param beta Updated to the barycentric coordinate of the intersection with respect to point C.
+     * @return The distance from the lightRay's origin to this Triangle, FLT_MAX if it doesn't intersect it.
+     */
+    float Intersect(const LightRay &lightRay, float &alpha, float &beta) const;
+
     /** The three points that define this triangle. */
     Point mA, mB, mC;
 
@@ -11,7 +11,9 @@
 #ifndef RAY_TRACER_VECT_HPP
 #define RAY_TRACER_VECT_HPP
 
+#include <cmath>
 #include <ostream>
+#include "simd.hpp"
 
 class Vect {
 
@@ -21,9 +23,9 @@ public:
     static constexpr float H = 0;
 
     /**
-     * @return New empty vector with values [0, 0, 0].
+     * @return New vector. Its values are [0, 0, 0] if it's value initialized (Vect()), undefined otherwise.
      */
-    Vect();
+    Vect() = default;
 
     /**
      * @param x Value for x.
@@ -31,80 +33,137 @@ public:
      * @param z Value for z.
      * @return New vector with values [x, y, z].
      */
-    Vect(const float x, const float y, const float z);
+    constexpr Vect(const float x, const float y, const float z)
+    : mValues(MakeFloat3(x, y, z))
+    {}
+
+    /**
+     * @param values Values for x, y and z.
+     * @return New vector with the given values.
+     */
+    constexpr explicit Vect(const Float3 &values)
+    : mValues(values)
+    {}
 
     /**
      * @return Value for x.
      */
-    float GetX() const;
+    constexpr float GetX() const
+    {
+        return mValues[0];
+    }
 
     /**
      * @return Value for y.
      */
-    float GetY() const;
+    constexpr float GetY() const
+    {
+        return mValues[1];
+    }
 
     /**
      * @return Value for z.
      */
-    float GetZ() const;
+    constexpr float GetZ() const
+    {
+        return mValues[2];
+    }
+
+    /**
+     * @return Values of this vector.
+     */
+    constexpr const Float3 &GetValues() const
+    {
+        return mValues;
+    }
 
     /**
      * @return The size (magnitude) of this vector.
      */
-    float Abs() const;
+    float Abs() const
+    {
+        return std::sqrt(DotProduct(*this));
+    }
 
     /**
      * @return New vector result of normalising this vector (dividing each value by the vector's magnitude).
      */
-    Vect Normalise() const;
+    Vect Normalise() const
+    {
+        return *this / Abs();
+    }
 
     /**
      * @param k Value by which this vector will be multiplied.
      * @return New vector product of this one and k.
      */
-    Vect operator*(const float k) const;
+    SIMD_CONSTEXPR Vect operator*(const float k) const
+    {
+        return Vect(Scale(mValues, k));
+    }
 
     /**
      * @param k Value by which this vector will be divided.
      * @return New vector result of dividing this vector by k.
      */
-    Vect operator/(const float k) const;
+    SIMD_CONSTEXPR Vect operator/(const float k) const
+    {
+        return Vect(Divide(mValues, k));
+    }
 
     /**
      * @param v Vector to add to this one.
      * @return New vector result of adding v to this vector.
      */
-    Vect operator+(const Vect &v) const;
+    SIMD_CONSTEXPR Vect operator+(const Vect &v) const
+    {
+        return Vect(Add(mValues, v.mValues));
+    }
 
     /**
      * @param v Vector to subtract to this one.
      * @return New vector result of subtracting v from this vector.
      */
-    Vect operator-(const Vect &v) const;
+    SIMD_CONSTEXPR Vect operator-(const Vect &v) const
+    {
+        return Vect(Subtract(mValues, v.mValues));
+    }
 
     /**
      * @param v Vector by which this one will be multiplied.
      * @return Value result of multiplying this vector by v.
      */
-    float DotProduct(const Vect &v) const;
+    SIMD_CONSTEXPR float DotProduct(const Vect &v) const
+    {
+        return Dot(mValues, v.mValues);
+    }
 
     /**
      * @param v Vector by which this one will be multiplied.
      * @return New vector result of multiplying this vector by v. A vector perpendicular to this and v.
      */
-    Vect CrossProduct(const Vect &v) const;
+    SIMD_CONSTEXPR Vect CrossProduct(const Vect &v) const
+    {
+        return Vect(Cross(mValues, v.mValues));
+    }
 
     /**
      * @param m Vector to compare this one to.
      * @return True if this vector and v are the same.
      */
-    bool operator==(const Vect &v) const;
+    SIMD_CONSTEXPR bool operator==(const Vect &v) const
+    {
+        return Equal(mValues, v.mValues);
+    }
 
     /**
      * @param m Vector to compare this one to.
      * @return True if this vector and v are different.
      */
-    bool operator!=(const Vect &v) const;
+    SIMD_CONSTEXPR bool operator!=(const Vect &v) const
+    {
+        return !(*this == v);
+    }
 
     /**
      * Pretty print.
@@ -113,12 +172,16 @@ public:
      * @param v vector to send to the stream as a string.
      * @return Stream with a string version of v.
      */
-    friend std::ostream& operator<<(std::ostream &out, const Vect &v);
+    friend std::ostream& operator<<(std::ostream &out, const Vect &v)
+    {
+        out << "Vector(" << v.GetX() << ", " << v.GetY() << ", " << v.GetZ() << ")";
+        return out;
+    }
 
 private:
 
     /** Values in this vector. */
-    float mX, mY, mZ;
+    Float3 mValues;
 };
 
 #endif // RAY_TRACER_VECT_HPP
\ No newline at end of file